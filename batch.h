@@ -0,0 +1,311 @@
+/*
+ * batch.h - applies one set of edits to a whole directory of images
+ *
+ * usage:
+ *   #define BATCH_IMPLEMENTATION
+ *   #include "batch.h"
+ *
+ *   BatchRecipe recipe = {.blur_intensity = 4, .brightness_intensity = 10};
+ *   int failed =
+ *       batch_run("photos", "photos/edited", recipe, 0, memory_cap, false);
+ *
+ * no window is needed. every png and jpeg in the input directory goes
+ * through three stages that overlap:
+ *
+ *   decode (several files at once) -> queue -> render + encode
+ *
+ * decoding is single threaded per file, so a few decoder threads work on
+ * different files at the same time. the decoded images wait in a short queue,
+ * and two writer threads take them from there and stream them out through
+ * image_export_write(), rendering a strip and encoding it on every core
+ * through the tile pool. with two writers, one can read tiles and write its
+ * file while the other has the pool.
+ *
+ * the queue only keeps the decoders from running ahead, it doesn't bound the
+ * memory on its own: a decoder that finds it full holds on to the image it
+ * just decoded. so up to decoders + 2 * writers images are decoded at once,
+ * each one on the heap only while it's under the memory cap. bigger baseline
+ * jpegs are decoded straight into a mapped cache file, other files that big
+ * count as failed (see image_loader_decode()). fewer decoders keep less in
+ * memory.
+ */
+
+#include "raylib.h"
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "image_pipeline.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// the edits, the same ones ImageObject holds. text positions are in source
+// pixels
+typedef struct {
+  float blur_intensity;
+  float brightness_intensity;
+  const TextObject *texts;
+  int text_count;
+  // same as EditParams.region, zero sized for the whole image
+  Rectangle region;
+} BatchRecipe;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// writes every edited image to output_dir under its own name, creating the
+// directory if needed. output_dir can't be input_dir, and files already in
+// it are left alone and count as failed unless overwrite is set. decoders is
+// how many files are decoded at once, 0 picks half the cores. returns how
+// many files failed, or -1 if the directories couldn't be used at all
+int batch_run(const char *input_dir, const char *output_dir,
+              BatchRecipe recipe, int decoders, size_t memory_cap,
+              bool overwrite);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BATCH_H
+
+/*
+ * BATCH IMPLEMENTATION
+ */
+#if defined(BATCH_IMPLEMENTATION)
+
+#include "image_export.h"
+#include "image_loader.h"
+#include "tile_pool.h"
+#include "tiled_image.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>  // Required for: printf(), fprintf(), snprintf()
+#include <stdlib.h> // Required for: malloc(), calloc(), free()
+#include <string.h> // Required for: strdup()
+
+#if defined(_WIN32)
+#include <direct.h> // Required for: _mkdir()
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h> // Required for: mkdir(), stat()
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+#define BATCH_WRITERS 2
+#define BATCH_MAX_DECODERS 16
+
+typedef struct {
+  int index;
+  // no tiles if the file couldn't be decoded
+  TiledImage image;
+} DecodedFile;
+
+typedef struct {
+  BatchRecipe recipe;
+  size_t memory_cap;
+  char **inputs;
+  char **outputs;
+  int count;
+
+  // next file a decoder picks up
+  atomic_int next;
+
+  // decoded files waiting for a writer
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+  DecodedFile *queue;
+  int capacity;
+  int head;
+  int size;
+  int decoders_running;
+
+  // only touched under lock
+  int finished;
+  int failed;
+} Batch;
+
+// whether two existing directories are the same one, however they're named
+static bool same_directory(const char *a, const char *b) {
+#if defined(_WIN32)
+  char full_a[_MAX_PATH], full_b[_MAX_PATH];
+  if (!_fullpath(full_a, a, sizeof(full_a)) ||
+      !_fullpath(full_b, b, sizeof(full_b)))
+    return false;
+  size_t length_a = strlen(full_a), length_b = strlen(full_b);
+  if (length_a > 1 && (full_a[length_a - 1] == '\\'))
+    full_a[--length_a] = '\0';
+  if (length_b > 1 && (full_b[length_b - 1] == '\\'))
+    full_b[--length_b] = '\0';
+  return _stricmp(full_a, full_b) == 0;
+#else
+  struct stat info_a, info_b;
+  return stat(a, &info_a) == 0 && stat(b, &info_b) == 0 &&
+         info_a.st_dev == info_b.st_dev && info_a.st_ino == info_b.st_ino;
+#endif
+}
+
+static TiledImage decode_file(const char *path, size_t memory_cap) {
+  int size = 0;
+  unsigned char *data = LoadFileData(path, &size);
+  if (data == NULL)
+    return (TiledImage){0};
+  TiledImage image =
+      image_loader_decode(data, size, GetFileExtension(path), memory_cap);
+  UnloadFileData(data);
+  return image;
+}
+
+static void *batch_decoder_main(void *arg) {
+  Batch *batch = arg;
+  for (;;) {
+    int index = atomic_fetch_add(&batch->next, 1);
+    if (index >= batch->count)
+      break;
+    DecodedFile file = {index,
+                        decode_file(batch->inputs[index], batch->memory_cap)};
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->size == batch->capacity)
+      pthread_cond_wait(&batch->not_full, &batch->lock);
+    batch->queue[(batch->head + batch->size) % batch->capacity] = file;
+    batch->size++;
+    pthread_cond_signal(&batch->not_empty);
+    pthread_mutex_unlock(&batch->lock);
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  // the writers stop once the queue is empty and nobody can fill it anymore
+  if (--batch->decoders_running == 0)
+    pthread_cond_broadcast(&batch->not_empty);
+  pthread_mutex_unlock(&batch->lock);
+  return NULL;
+}
+
+static void *batch_writer_main(void *arg) {
+  Batch *batch = arg;
+  EditParams params = {batch->recipe.texts,
+                       batch->recipe.text_count,
+                       batch->recipe.blur_intensity,
+                       batch->recipe.brightness_intensity,
+                       false,
+                       (Vector2){0},
+                       batch->recipe.region};
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    while (batch->size == 0 && batch->decoders_running > 0)
+      pthread_cond_wait(&batch->not_empty, &batch->lock);
+    if (batch->size == 0) {
+      pthread_mutex_unlock(&batch->lock);
+      break;
+    }
+    DecodedFile file = batch->queue[batch->head];
+    batch->head = (batch->head + 1) % batch->capacity;
+    batch->size--;
+    pthread_cond_signal(&batch->not_full);
+    pthread_mutex_unlock(&batch->lock);
+
+    bool ok = file.image.tiles &&
+              image_export_write(&file.image, params,
+                                 batch->outputs[file.index], NULL);
+    tiled_image_free(&file.image);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->finished++;
+    if (!ok)
+      batch->failed++;
+    if (ok)
+      printf("[%d/%d] %s\n", batch->finished, batch->count,
+             batch->outputs[file.index]);
+    else
+      fprintf(stderr, "[%d/%d] couldn't process %s\n", batch->finished,
+              batch->count, batch->inputs[file.index]);
+    pthread_mutex_unlock(&batch->lock);
+  }
+  return NULL;
+}
+
+int batch_run(const char *input_dir, const char *output_dir,
+              BatchRecipe recipe, int decoders, size_t memory_cap,
+              bool overwrite) {
+  if (!DirectoryExists(input_dir))
+    return -1;
+  if (!DirectoryExists(output_dir))
+    make_directory(output_dir);
+  if (!DirectoryExists(output_dir))
+    return -1;
+  // the outputs would replace the inputs while other files still read them
+  if (same_directory(input_dir, output_dir)) {
+    fprintf(stderr, "%s is the input directory\n", output_dir);
+    return -1;
+  }
+
+  Batch batch = {0};
+  batch.recipe = recipe;
+  batch.memory_cap = memory_cap;
+
+  FilePathList files = LoadDirectoryFiles(input_dir);
+  batch.inputs = calloc(files.count + 1, sizeof(char *));
+  batch.outputs = calloc(files.count + 1, sizeof(char *));
+  int skipped = 0;
+  for (unsigned int i = 0; i < files.count; i++) {
+    const char *path = files.paths[i];
+    if (!IsFileExtension(path, ".png;.jpg;.jpeg"))
+      continue;
+    const char *output = TextFormat("%s/%s", output_dir, GetFileName(path));
+    if (!overwrite && FileExists(output)) {
+      fprintf(stderr, "%s already exists, not replacing it\n", output);
+      skipped++;
+      continue;
+    }
+    batch.inputs[batch.count] = strdup(path);
+    batch.outputs[batch.count] = strdup(output);
+    batch.count++;
+  }
+  UnloadDirectoryFiles(files);
+
+  if (decoders <= 0)
+    decoders = tile_pool_thread_count(tile_pool_shared()) / 2;
+  decoders = decoders < 1 ? 1
+             : decoders > BATCH_MAX_DECODERS ? BATCH_MAX_DECODERS
+                                             : decoders;
+  if (decoders > batch.count)
+    decoders = batch.count > 0 ? batch.count : 1;
+
+  atomic_init(&batch.next, 0);
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.not_full, NULL);
+  pthread_cond_init(&batch.not_empty, NULL);
+  // one file ready for each writer is enough to keep them busy
+  batch.capacity = BATCH_WRITERS;
+  batch.queue = calloc(batch.capacity, sizeof(DecodedFile));
+  batch.decoders_running = decoders;
+
+  pthread_t decoder_threads[BATCH_MAX_DECODERS];
+  pthread_t writer_threads[BATCH_WRITERS];
+  for (int i = 0; i < decoders; i++)
+    pthread_create(&decoder_threads[i], NULL, batch_decoder_main, &batch);
+  for (int i = 0; i < BATCH_WRITERS; i++)
+    pthread_create(&writer_threads[i], NULL, batch_writer_main, &batch);
+  for (int i = 0; i < decoders; i++)
+    pthread_join(decoder_threads[i], NULL);
+  for (int i = 0; i < BATCH_WRITERS; i++)
+    pthread_join(writer_threads[i], NULL);
+
+  for (int i = 0; i < batch.count; i++) {
+    free(batch.inputs[i]);
+    free(batch.outputs[i]);
+  }
+  free(batch.inputs);
+  free(batch.outputs);
+  free(batch.queue);
+  pthread_cond_destroy(&batch.not_empty);
+  pthread_cond_destroy(&batch.not_full);
+  pthread_mutex_destroy(&batch.lock);
+  return batch.failed + skipped;
+}
+
+#endif // BATCH_IMPLEMENTATION
@@ -0,0 +1,284 @@
+/*
+ * benchmark.c - times the edit pipeline on synthetic images, no window
+ *
+ * build:
+ *   clang -O2 benchmark.c -o benchmark -lraylib -lm -lpthread
+ *
+ * usage:
+ *   ./benchmark [--sizes 1,12,50,100] [--runs 10] [--seed 1]
+ *
+ * every size (in megapixels) gets a generated image, a gradient with noise
+ * from a fixed seed, so two runs of the benchmark see the same pixels. each
+ * case runs once to warm up and then --runs times, and the median, the 95th
+ * percentile and the throughput in source megapixels per second of the
+ * median are printed.
+ *
+ *   tile        cutting the decoded image into tiles
+ *   open        a new image in the render worker, every mip level and stage
+ *               from scratch (finish_loading_image())
+ *   slider      one blur slider step through the render worker, only the
+ *               blur and what comes after it reruns on the proxy
+ *               (update_and_reflect_image_changes())
+ *   resize      a new canvas size through the render worker
+ *               (handle_dynamic_canvas_resizing())
+ *   blur        rendering every row with just the blur a strip at a time, the
+ *               way a save or a batch does (pipeline_render_rows())
+ *   brightness  same with just the brightness
+ *   export      same with both effects
+ *
+ * texts are left out, drawing them needs raylib's default font and with it a
+ * window.
+ */
+
+// for the posix and gnu calls in tiled_image.h and friends, see main.c
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "raylib.h"
+
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
+#undef PROFILER_IMPLEMENTATION
+
+#define BLUR_IMPLEMENTATION
+#include "blur.h"
+#undef BLUR_IMPLEMENTATION
+
+#define TILE_POOL_IMPLEMENTATION
+#include "tile_pool.h"
+#undef TILE_POOL_IMPLEMENTATION
+
+#define TILED_IMAGE_IMPLEMENTATION
+#include "tiled_image.h"
+#undef TILED_IMAGE_IMPLEMENTATION
+
+#define IMAGE_PIPELINE_IMPLEMENTATION
+#include "image_pipeline.h"
+#undef IMAGE_PIPELINE_IMPLEMENTATION
+
+#define RENDER_WORKER_IMPLEMENTATION
+#include "render_worker.h"
+#undef RENDER_WORKER_IMPLEMENTATION
+
+#define MAX_SIZES 16
+#define MAX_RUNS 1000
+// same as EXPORT_STRIP_PIXELS
+#define STRIP_PIXELS (4 << 20)
+
+typedef struct {
+  double megapixels;
+  // what a decoder would hand over
+  Image flat;
+  TiledImage source;
+  RenderWorker *worker;
+  // what the worker rendered last, the cases change it a bit at a time
+  EditParams params;
+} Bench;
+
+typedef struct {
+  const char *name;
+  // returns the seconds of the part worth timing
+  double (*run)(Bench *bench, int run);
+} BenchCase;
+
+static double bench_now(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static Image synthetic_image(int width, int height, unsigned int seed) {
+  Color *pixels = malloc((size_t)width * height * sizeof(Color));
+  unsigned int state = seed ? seed : 1;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      // xorshift32
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      pixels[(size_t)y * width + x] = (Color){
+          x * 191 / width + (state & 63), y * 191 / height + (state >> 6 & 63),
+          (x + y) * 191 / (width + height) + (state >> 12 & 63), 255};
+    }
+  }
+  return (Image){pixels, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+}
+
+// posts like the ui does and spins until the preview is back
+static void wait_for_preview(Bench *bench) {
+  render_worker_post(bench->worker, bench->params);
+  Image preview;
+  while (!render_worker_poll(bench->worker, &preview))
+    sched_yield();
+  UnloadImage(preview);
+}
+
+static double bench_tile(Bench *bench, int run) {
+  (void)run;
+  double start = bench_now();
+  TiledImage tiled = tiled_image_from_image(bench->flat);
+  double seconds = bench_now() - start;
+  tiled_image_free(&tiled);
+  return seconds;
+}
+
+static double bench_open(Bench *bench, int run) {
+  (void)run;
+  double start = bench_now();
+  render_worker_set_source(bench->worker, &bench->source);
+  wait_for_preview(bench);
+  return bench_now() - start;
+}
+
+static double bench_slider(Bench *bench, int run) {
+  // the radius is in source pixels and the preview blurs a proxy, step it by
+  // a pixel of the proxy so every run really blurs again
+  int level = pick_proxy_level(&bench->source, bench->params.preview_size);
+  bench->params.blur_intensity = (2 + run % 2) << level;
+  double start = bench_now();
+  wait_for_preview(bench);
+  return bench_now() - start;
+}
+
+static double bench_resize(Bench *bench, int run) {
+  bench->params.preview_size =
+      run % 2 ? (Vector2){800, 600} : (Vector2){640, 480};
+  double start = bench_now();
+  wait_for_preview(bench);
+  return bench_now() - start;
+}
+
+// the full resolution render a save streams out, with the other effect at 0
+// in the single effect cases
+static double bench_rows(Bench *bench, float blur, float brightness) {
+  int width = bench->source.width, height = bench->source.height;
+  int strip_height = STRIP_PIXELS / width < 16 ? 16 : STRIP_PIXELS / width;
+  Color *strip = malloc((size_t)strip_height * width * sizeof(Color));
+  EditParams params = {0};
+  params.blur_intensity = blur;
+  params.brightness_intensity = brightness;
+
+  double start = bench_now();
+  for (int y = 0; y < height; y += strip_height) {
+    int rows = height - y < strip_height ? height - y : strip_height;
+    pipeline_render_rows(&bench->source, params, y, y + rows, strip);
+  }
+  double seconds = bench_now() - start;
+  free(strip);
+  return seconds;
+}
+
+static double bench_blur(Bench *bench, int run) {
+  (void)run;
+  return bench_rows(bench, 4, 0);
+}
+
+static double bench_brightness(Bench *bench, int run) {
+  (void)run;
+  return bench_rows(bench, 0, 20);
+}
+
+static double bench_export(Bench *bench, int run) {
+  (void)run;
+  return bench_rows(bench, 4, 20);
+}
+
+static const BenchCase cases[] = {
+    {"tile", bench_tile},       {"open", bench_open},
+    {"slider", bench_slider},   {"resize", bench_resize},
+    {"blur", bench_blur},       {"brightness", bench_brightness},
+    {"export", bench_export},
+};
+
+static int compare_seconds(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void run_case(Bench *bench, BenchCase bench_case, int runs) {
+  static double seconds[MAX_RUNS];
+  bench_case.run(bench, 0);
+  for (int i = 0; i < runs; i++)
+    seconds[i] = bench_case.run(bench, i + 1);
+  qsort(seconds, runs, sizeof(double), compare_seconds);
+
+  // nearest rank
+  double median = seconds[(runs - 1) / 2];
+  double p95 = seconds[(int)ceil(runs * 0.95) - 1];
+  printf("%-8.4g %-12s %10.2f %10.2f %10.1f\n", bench->megapixels,
+         bench_case.name, median * 1000, p95 * 1000,
+         bench->megapixels / median);
+  fflush(stdout);
+}
+
+static void run_size(double megapixels, int runs, unsigned int seed) {
+  // 3:2 like most cameras
+  int width = sqrt(megapixels * 1e6 * 1.5);
+  int height = megapixels * 1e6 / width;
+  if (width < 1 || height < 1)
+    return;
+
+  Bench bench = {0};
+  bench.megapixels = megapixels;
+  bench.flat = synthetic_image(width, height, seed);
+  bench.source = tiled_image_from_image(bench.flat);
+  bench.worker = render_worker_create();
+  // a budget no render misses, so there are never any drafts
+  render_worker_set_frame_budget(bench.worker, 1e9);
+  bench.params = (EditParams){
+      .blur_intensity = 4,
+      .brightness_intensity = 20,
+      .preview_size = {640, 480},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    run_case(&bench, cases[i], runs);
+
+  render_worker_destroy(bench.worker);
+  tiled_image_free(&bench.source);
+  UnloadImage(bench.flat);
+}
+
+int main(int argc, char **argv) {
+  double sizes[MAX_SIZES] = {1, 12, 50, 100};
+  int size_count = 4;
+  int runs = 10;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+      size_count = 0;
+      for (char *next = argv[++i]; *next && size_count < MAX_SIZES;) {
+        sizes[size_count++] = strtod(next, &next);
+        while (*next == ',' || *next == ' ')
+          next++;
+      }
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--sizes 1,12,50,100] [--runs 10] [--seed 1]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  runs = runs < 1 ? 1 : runs > MAX_RUNS ? MAX_RUNS : runs;
+
+  SetTraceLogLevel(LOG_WARNING);
+  printf("%d threads, %d runs, seed %u\n",
+         tile_pool_thread_count(tile_pool_shared()), runs, seed);
+  printf("%-8s %-12s %10s %10s %10s\n", "MP", "case", "median ms", "p95 ms",
+         "MP/s");
+  for (int i = 0; i < size_count; i++)
+    run_size(sizes[i], runs, seed);
+  return 0;
+}
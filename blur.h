@@ -0,0 +1,505 @@
+/*
+ * blur.h - daisy's own blur engine
+ *
+ * usage:
+ *   #define BLUR_IMPLEMENTATION
+ *   #include "blur.h"
+ *
+ * the blur is separable: one horizontal pass over every row, then one vertical
+ * pass over every column, each working on a float line buffer of
+ * premultiplied rgba. the radius means the same thing as raylib's
+ * ImageBlurGaussian() blurSize (three box passes of that radius), so the
+ * slider still looks the same:
+ *
+ *   - small radii use a real gaussian kernel with the same variance
+ *   - bigger radii use the three box cascade with running sums, which costs
+ *     the same no matter how big the radius is
+ *
+ * the inner loops have sse2 and avx2 versions, avx2 is picked at runtime.
+ * the gaussian puts two neighbouring pixels of a line in an avx2 register.
+ * the running sums can't be split up along a line, so with avx2 the box
+ * cascade blurs two lines at once instead (two rows, or two columns), one in
+ * each half of the register. define BLUR_FORCE_SCALAR to build only the
+ * plain c loops.
+ */
+
+#include "raylib.h"
+
+#ifndef BLUR_H
+#define BLUR_H
+
+// largest radius that still goes through the gaussian kernel
+#define BLUR_GAUSSIAN_MAX_RADIUS 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// how far outside a pixel the blur reads, per pass
+int blur_halo(int radius);
+
+// blur the [x0, x1) x [y0, y1) part of src into dst, reading up to
+// blur_halo() pixels outside of it (clamped to the image). both buffers are
+// width x height rgba8. src and dst may be the same buffer as long as the
+// rectangle spans whole lines in the pass direction
+void blur_pass_horizontal(const Color *src, Color *dst, int width, int height,
+                          int radius, int x0, int y0, int x1, int y1);
+void blur_pass_vertical(const Color *src, Color *dst, int width, int height,
+                        int radius, int x0, int y0, int x1, int y1);
+
+// in place replacement for ImageBlurGaussian() on rgba8 images
+void blur_image(Image *image, int radius);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLUR_H
+
+/*
+ * BLUR IMPLEMENTATION
+ */
+#if defined(BLUR_IMPLEMENTATION)
+
+#include <math.h>   // Required for: sqrtf(), expf(), ceilf()
+#include <string.h> // Required for: memcpy()
+
+#if !defined(BLUR_FORCE_SCALAR) && (defined(__x86_64__) || defined(_M_X64))
+#define BLUR_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define BLUR_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#define BLUR_MAX_TAPS (2 * 16 + 1)
+
+typedef struct BlurKernel BlurKernel;
+typedef void (*ConvolveLineFn)(const float *, float *, int,
+                               const BlurKernel *);
+typedef void (*BoxLineFn)(const float *, float *, int, int);
+
+struct BlurKernel {
+  int radius;
+  // gaussian kernel, only used when taps > 0
+  float weights[BLUR_MAX_TAPS];
+  int taps;
+  // inner loops picked for this cpu. box_line_pair runs the box filter over
+  // two interleaved lines, NULL when there's nothing faster than doing them
+  // one after the other
+  ConvolveLineFn convolve_line;
+  BoxLineFn box_line;
+  BoxLineFn box_line_pair;
+};
+
+static ConvolveLineFn pick_convolve_line(void);
+static BoxLineFn pick_box_line(void);
+static BoxLineFn pick_box_line_pair(void);
+
+// three box passes of radius r have a variance of r * (r + 1), use a
+// gaussian with the same spread so small radii look like the big ones
+static BlurKernel make_kernel(int radius) {
+  BlurKernel kernel = {0};
+  kernel.radius = radius;
+  kernel.convolve_line = pick_convolve_line();
+  kernel.box_line = pick_box_line();
+  kernel.box_line_pair = pick_box_line_pair();
+  if (radius > BLUR_GAUSSIAN_MAX_RADIUS)
+    return kernel;
+
+  float sigma = sqrtf((float)radius * (radius + 1));
+  int half = ceilf(3 * sigma);
+  float sum = 0;
+  kernel.taps = 2 * half + 1;
+  for (int i = 0; i < kernel.taps; i++) {
+    float d = i - half;
+    kernel.weights[i] = expf(-(d * d) / (2 * sigma * sigma));
+    sum += kernel.weights[i];
+  }
+  for (int i = 0; i < kernel.taps; i++)
+    kernel.weights[i] /= sum;
+  return kernel;
+}
+
+static int kernel_halo(const BlurKernel *kernel) {
+  return kernel->taps > 0 ? kernel->taps / 2 : 3 * kernel->radius;
+}
+
+int blur_halo(int radius) {
+  BlurKernel kernel = make_kernel(radius);
+  return kernel_halo(&kernel);
+}
+
+static inline int clamp_index(int i, int count) {
+  return i < 0 ? 0 : (i >= count ? count - 1 : i);
+}
+
+//------------------------------------------------------------------------------
+// line loading and storing, rgba8 <-> premultiplied float rgba
+//------------------------------------------------------------------------------
+static inline void load_pixel(Color c, float *out) {
+#if defined(BLUR_SSE2)
+  int packed;
+  memcpy(&packed, &c, sizeof(Color));
+  __m128i v = _mm_cvtsi32_si128(packed);
+  v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+  v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+  __m128 f = _mm_cvtepi32_ps(v);
+  __m128 a = _mm_set_ps(1.f, c.a / 255.f, c.a / 255.f, c.a / 255.f);
+  _mm_storeu_ps(out, _mm_mul_ps(f, a));
+#else
+  float a = c.a / 255.f;
+  out[0] = c.r * a;
+  out[1] = c.g * a;
+  out[2] = c.b * a;
+  out[3] = c.a;
+#endif
+}
+
+static inline void store_pixel(const float *p, Color *out) {
+  float alpha = p[3];
+  float unpremultiply = alpha > 0.5f ? 255.f / alpha : 0.f;
+#if defined(BLUR_SSE2)
+  __m128 scale = _mm_set_ps(1.f, unpremultiply, unpremultiply, unpremultiply);
+  __m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(p), scale));
+  v = _mm_packs_epi32(v, v);
+  v = _mm_packus_epi16(v, v);
+  int packed = _mm_cvtsi128_si32(v);
+  memcpy(out, &packed, sizeof(Color));
+#else
+  float r = p[0] * unpremultiply + 0.5f;
+  float g = p[1] * unpremultiply + 0.5f;
+  float b = p[2] * unpremultiply + 0.5f;
+  float a = alpha + 0.5f;
+  *out = (Color){r > 255 ? 255 : (r < 0 ? 0 : r),
+                 g > 255 ? 255 : (g < 0 ? 0 : g),
+                 b > 255 ? 255 : (b < 0 ? 0 : b),
+                 a > 255 ? 255 : (a < 0 ? 0 : a)};
+#endif
+}
+
+// reads count pixels starting at pixel `first` along a line of `length`
+// pixels, step apart. indices outside the line repeat the edge pixel
+static void load_line(const Color *line, int step, int length, int first,
+                      int count, float *out) {
+  for (int i = 0; i < count; i++)
+    load_pixel(line[(size_t)clamp_index(first + i, length) * step],
+               out + 4 * i);
+}
+
+static void store_line(const float *in, Color *line, int step, int count) {
+  for (int i = 0; i < count; i++)
+    store_pixel(in + 4 * i, &line[(size_t)i * step]);
+}
+
+// the same for two lines at once, pixel i of both lines next to each other
+static void load_line_pair(const Color *line0, const Color *line1, int step,
+                           int length, int first, int count, float *out) {
+  for (int i = 0; i < count; i++) {
+    size_t at = (size_t)clamp_index(first + i, length) * step;
+    load_pixel(line0[at], out + 8 * i);
+    load_pixel(line1[at], out + 8 * i + 4);
+  }
+}
+
+static void store_line_pair(const float *in, Color *line0, Color *line1,
+                            int step, int count) {
+  for (int i = 0; i < count; i++) {
+    store_pixel(in + 8 * i, &line0[(size_t)i * step]);
+    store_pixel(in + 8 * i + 4, &line1[(size_t)i * step]);
+  }
+}
+
+//------------------------------------------------------------------------------
+// gaussian convolution, out[i] = sum(weights[k] * in[i + k])
+//------------------------------------------------------------------------------
+#if defined(BLUR_SSE2)
+// one pixel per register, the four channels share the weight
+static void convolve_line_sse2(const float *in, float *out, int count,
+                               const BlurKernel *kernel) {
+  for (int i = 0; i < count; i++) {
+    __m128 acc = _mm_setzero_ps();
+    for (int k = 0; k < kernel->taps; k++) {
+      __m128 w = _mm_set1_ps(kernel->weights[k]);
+      acc = _mm_add_ps(acc, _mm_mul_ps(w, _mm_loadu_ps(in + 4 * (i + k))));
+    }
+    _mm_storeu_ps(out + 4 * i, acc);
+  }
+}
+#else
+static void convolve_line_scalar(const float *in, float *out, int count,
+                                 const BlurKernel *kernel) {
+  for (int i = 0; i < count; i++) {
+    float r = 0, g = 0, b = 0, a = 0;
+    for (int k = 0; k < kernel->taps; k++) {
+      const float *p = in + 4 * (i + k);
+      float w = kernel->weights[k];
+      r += w * p[0];
+      g += w * p[1];
+      b += w * p[2];
+      a += w * p[3];
+    }
+    out[4 * i + 0] = r;
+    out[4 * i + 1] = g;
+    out[4 * i + 2] = b;
+    out[4 * i + 3] = a;
+  }
+}
+#endif
+
+#if defined(BLUR_AVX2)
+// two neighbouring pixels per register, they read the same taps shifted by
+// one pixel so a single unaligned load covers both
+__attribute__((target("avx2"))) static void
+convolve_line_avx2(const float *in, float *out, int count,
+                   const BlurKernel *kernel) {
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < kernel->taps; k++) {
+      __m256 w = _mm256_set1_ps(kernel->weights[k]);
+      acc = _mm256_add_ps(acc,
+                          _mm256_mul_ps(w, _mm256_loadu_ps(in + 4 * (i + k))));
+    }
+    _mm256_storeu_ps(out + 4 * i, acc);
+  }
+  if (i < count)
+    convolve_line_sse2(in + 4 * i, out + 4 * i, count - i, kernel);
+}
+#endif
+
+//------------------------------------------------------------------------------
+// box filter with a running sum, indices past either end repeat the edge
+//------------------------------------------------------------------------------
+#if defined(BLUR_SSE2)
+static void box_line_sse2(const float *in, float *out, int length,
+                          int radius) {
+  __m128 sum = _mm_setzero_ps();
+  __m128 inv = _mm_set1_ps(1.f / (2 * radius + 1));
+  for (int j = -radius; j <= radius; j++)
+    sum = _mm_add_ps(sum, _mm_loadu_ps(in + 4 * clamp_index(j, length)));
+
+  // the middle part never clamps, keep the branches out of it
+  int start = radius < length ? radius : length;
+  int end = length - radius - 1;
+  int i = 0;
+  for (; i < start; i++) {
+    _mm_storeu_ps(out + 4 * i, _mm_mul_ps(sum, inv));
+    __m128 add = _mm_loadu_ps(in + 4 * clamp_index(i + radius + 1, length));
+    __m128 sub = _mm_loadu_ps(in + 4 * clamp_index(i - radius, length));
+    sum = _mm_add_ps(sum, _mm_sub_ps(add, sub));
+  }
+  for (; i < end; i++) {
+    _mm_storeu_ps(out + 4 * i, _mm_mul_ps(sum, inv));
+    __m128 add = _mm_loadu_ps(in + 4 * (i + radius + 1));
+    __m128 sub = _mm_loadu_ps(in + 4 * (i - radius));
+    sum = _mm_add_ps(sum, _mm_sub_ps(add, sub));
+  }
+  for (; i < length; i++) {
+    _mm_storeu_ps(out + 4 * i, _mm_mul_ps(sum, inv));
+    __m128 add = _mm_loadu_ps(in + 4 * clamp_index(i + radius + 1, length));
+    __m128 sub = _mm_loadu_ps(in + 4 * clamp_index(i - radius, length));
+    sum = _mm_add_ps(sum, _mm_sub_ps(add, sub));
+  }
+}
+#else
+static void box_line_scalar(const float *in, float *out, int length,
+                            int radius) {
+  float sum[4] = {0};
+  float inv = 1.f / (2 * radius + 1);
+  for (int j = -radius; j <= radius; j++)
+    for (int c = 0; c < 4; c++)
+      sum[c] += in[4 * clamp_index(j, length) + c];
+
+  for (int i = 0; i < length; i++) {
+    const float *add = in + 4 * clamp_index(i + radius + 1, length);
+    const float *sub = in + 4 * clamp_index(i - radius, length);
+    for (int c = 0; c < 4; c++) {
+      out[4 * i + c] = sum[c] * inv;
+      sum[c] += add[c] - sub[c];
+    }
+  }
+}
+#endif
+
+#if defined(BLUR_AVX2)
+// box_line_sse2() over two interleaved lines, 8 floats per position
+__attribute__((target("avx2"))) static void
+box_line_pair_avx2(const float *in, float *out, int length, int radius) {
+  __m256 sum = _mm256_setzero_ps();
+  __m256 inv = _mm256_set1_ps(1.f / (2 * radius + 1));
+  for (int j = -radius; j <= radius; j++)
+    sum = _mm256_add_ps(sum, _mm256_loadu_ps(in + 8 * clamp_index(j, length)));
+
+  int start = radius < length ? radius : length;
+  int end = length - radius - 1;
+  int i = 0;
+  for (; i < start; i++) {
+    _mm256_storeu_ps(out + 8 * i, _mm256_mul_ps(sum, inv));
+    __m256 add =
+        _mm256_loadu_ps(in + 8 * clamp_index(i + radius + 1, length));
+    __m256 sub = _mm256_loadu_ps(in + 8 * clamp_index(i - radius, length));
+    sum = _mm256_add_ps(sum, _mm256_sub_ps(add, sub));
+  }
+  for (; i < end; i++) {
+    _mm256_storeu_ps(out + 8 * i, _mm256_mul_ps(sum, inv));
+    __m256 add = _mm256_loadu_ps(in + 8 * (i + radius + 1));
+    __m256 sub = _mm256_loadu_ps(in + 8 * (i - radius));
+    sum = _mm256_add_ps(sum, _mm256_sub_ps(add, sub));
+  }
+  for (; i < length; i++) {
+    _mm256_storeu_ps(out + 8 * i, _mm256_mul_ps(sum, inv));
+    __m256 add =
+        _mm256_loadu_ps(in + 8 * clamp_index(i + radius + 1, length));
+    __m256 sub = _mm256_loadu_ps(in + 8 * clamp_index(i - radius, length));
+    sum = _mm256_add_ps(sum, _mm256_sub_ps(add, sub));
+  }
+}
+#endif
+
+static ConvolveLineFn pick_convolve_line(void) {
+#if defined(BLUR_AVX2)
+  if (__builtin_cpu_supports("avx2"))
+    return convolve_line_avx2;
+#endif
+#if defined(BLUR_SSE2)
+  return convolve_line_sse2;
+#else
+  return convolve_line_scalar;
+#endif
+}
+
+static BoxLineFn pick_box_line(void) {
+#if defined(BLUR_SSE2)
+  return box_line_sse2;
+#else
+  return box_line_scalar;
+#endif
+}
+
+static BoxLineFn pick_box_line_pair(void) {
+#if defined(BLUR_AVX2)
+  if (__builtin_cpu_supports("avx2"))
+    return box_line_pair_avx2;
+#endif
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+// passes
+//------------------------------------------------------------------------------
+// blurs `count` pixels of a line starting at `first`. line buffers a and b
+// hold count + 2 * halo pixels
+static void blur_line(const Color *src, Color *dst, int step, int length,
+                      int first, int count, const BlurKernel *kernel,
+                      float *a, float *b) {
+  int halo = kernel_halo(kernel);
+  int padded = count + 2 * halo;
+  load_line(src, step, length, first - halo, padded, a);
+
+  if (kernel->taps > 0) {
+    kernel->convolve_line(a, b, count, kernel);
+    store_line(b, dst + (size_t)first * step, step, count);
+  } else {
+    // the halo already holds the repeated edge, clamping at the ends of the
+    // padded buffer gives the same result as clamping at the image edge
+    kernel->box_line(a, b, padded, kernel->radius);
+    kernel->box_line(b, a, padded, kernel->radius);
+    kernel->box_line(a, b, padded, kernel->radius);
+    store_line(b + 4 * halo, dst + (size_t)first * step, step, count);
+  }
+}
+
+// blur_line() for two lines with the same step, box cascade only. the
+// buffers hold twice as many floats
+static void blur_line_pair(const Color *src0, const Color *src1, Color *dst0,
+                           Color *dst1, int step, int length, int first,
+                           int count, const BlurKernel *kernel, float *a,
+                           float *b) {
+  int halo = kernel_halo(kernel);
+  int padded = count + 2 * halo;
+  load_line_pair(src0, src1, step, length, first - halo, padded, a);
+  kernel->box_line_pair(a, b, padded, kernel->radius);
+  kernel->box_line_pair(b, a, padded, kernel->radius);
+  kernel->box_line_pair(a, b, padded, kernel->radius);
+  store_line_pair(b + 8 * halo, dst0 + (size_t)first * step,
+                  dst1 + (size_t)first * step, step, count);
+}
+
+// whether blur_line_pair() can be used, and pays off
+static bool use_line_pairs(const BlurKernel *kernel) {
+  return kernel->taps == 0 && kernel->box_line_pair != NULL;
+}
+
+void blur_pass_horizontal(const Color *src, Color *dst, int width, int height,
+                          int radius, int x0, int y0, int x1, int y1) {
+  if (radius <= 0 || x1 <= x0 || y1 <= y0)
+    return;
+
+  BlurKernel kernel = make_kernel(radius);
+  int padded = (x1 - x0) + 2 * kernel_halo(&kernel);
+  float *a = RL_MALLOC(padded * 8 * sizeof(float));
+  float *b = RL_MALLOC(padded * 8 * sizeof(float));
+
+  int y = y0;
+  if (use_line_pairs(&kernel)) {
+    for (; y + 1 < y1; y += 2) {
+      blur_line_pair(src + (size_t)y * width, src + (size_t)(y + 1) * width,
+                     dst + (size_t)y * width, dst + (size_t)(y + 1) * width,
+                     1, width, x0, x1 - x0, &kernel, a, b);
+    }
+  }
+  for (; y < y1; y++) {
+    blur_line(src + (size_t)y * width, dst + (size_t)y * width, 1, width, x0,
+              x1 - x0, &kernel, a, b);
+  }
+
+  RL_FREE(a);
+  RL_FREE(b);
+  (void)height;
+}
+
+void blur_pass_vertical(const Color *src, Color *dst, int width, int height,
+                        int radius, int x0, int y0, int x1, int y1) {
+  if (radius <= 0 || x1 <= x0 || y1 <= y0)
+    return;
+
+  BlurKernel kernel = make_kernel(radius);
+  int padded = (y1 - y0) + 2 * kernel_halo(&kernel);
+  float *a = RL_MALLOC(padded * 8 * sizeof(float));
+  float *b = RL_MALLOC(padded * 8 * sizeof(float));
+
+  // neighbouring columns share cache lines, walking them in order keeps the
+  // rows of the strip hot
+  int x = x0;
+  if (use_line_pairs(&kernel)) {
+    for (; x + 1 < x1; x += 2) {
+      blur_line_pair(src + x, src + x + 1, dst + x, dst + x + 1, width,
+                     height, y0, y1 - y0, &kernel, a, b);
+    }
+  }
+  for (; x < x1; x++) {
+    blur_line(src + x, dst + x, width, height, y0, y1 - y0, &kernel, a, b);
+  }
+
+  RL_FREE(a);
+  RL_FREE(b);
+}
+
+void blur_image(Image *image, int radius) {
+  if (radius <= 0 || image->data == NULL)
+    return;
+  if (image->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+    ImageFormat(image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  Color *pixels = image->data;
+  int width = image->width;
+  int height = image->height;
+  blur_pass_horizontal(pixels, pixels, width, height, radius, 0, 0, width,
+                       height);
+  blur_pass_vertical(pixels, pixels, width, height, radius, 0, 0, width,
+                     height);
+}
+
+#endif // BLUR_IMPLEMENTATION
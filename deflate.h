@@ -0,0 +1,524 @@
+/*
+ * deflate.h - deflate compressor for daisy's png export
+ *
+ * usage:
+ *   #define DEFLATE_IMPLEMENTATION
+ *   #include "deflate.h"
+ *
+ * compresses data in independent chunks that join up into one deflate
+ * stream, the way pigz does it, so a big image can be compressed on every
+ * core at once:
+ *
+ *   - every chunk but the last ends on a byte boundary (an empty stored
+ *     block) and without the final block bit, so chunks are just
+ *     concatenated
+ *   - a chunk may reference the 32kb of data before it, which the caller
+ *     passes in as a dictionary, so splitting costs next to nothing in size
+ *
+ * matches come from hash chains, blocks get their own huffman codes. the
+ * adler32 checksum of the zlib wrapper can be computed per chunk too and
+ * combined afterwards.
+ */
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// how far back a match may reach, the most dictionary that is useful
+#define DEFLATE_WINDOW_SIZE 32768
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// compresses window[dictionary_size, dictionary_size + size), matching
+// against the dictionary_size (at most DEFLATE_WINDOW_SIZE) bytes before it.
+// the result is malloc'd, its length goes to out_size
+unsigned char *deflate_chunk(const unsigned char *window, int dictionary_size,
+                             int size, bool last, int *out_size);
+
+// start with adler = 1
+unsigned int deflate_adler32(unsigned int adler, const unsigned char *data,
+                             size_t size);
+// adler32 of a followed by b, from the checksums of both and b's length
+unsigned int deflate_adler32_combine(unsigned int a, unsigned int b,
+                                     size_t b_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEFLATE_H
+
+/*
+ * DEFLATE IMPLEMENTATION
+ */
+#if defined(DEFLATE_IMPLEMENTATION)
+
+#include <stdint.h> // Required for: uint64_t
+#include <stdlib.h> // Required for: malloc(), realloc(), free()
+#include <string.h> // Required for: memcpy(), memset()
+
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+// candidates tried per position, about zlib's level 6
+#define DEFLATE_MAX_CHAIN 64
+// a match this long is good enough to stop looking
+#define DEFLATE_NICE_MATCH 128
+#define DEFLATE_BLOCK_TOKENS 32768
+
+#define DEFLATE_LITERALS 286
+#define DEFLATE_DISTANCES 30
+
+static const unsigned short length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                               1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                               4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short distance_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// order the code length code lengths are sent in
+static const unsigned char code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// a literal when distance is 0, a match otherwise
+typedef struct {
+  unsigned short length;
+  unsigned short distance;
+} DeflateToken;
+
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+  uint64_t bits;
+  int bit_count;
+} BitWriter;
+
+typedef struct {
+  BitWriter out;
+  DeflateToken *tokens;
+  int token_count;
+  // symbol lookups, so tokens don't have to search the base tables
+  unsigned char length_symbol[DEFLATE_MAX_MATCH + 1];
+  unsigned char distance_symbol[512];
+} Deflater;
+
+//------------------------------------------------------------------------------
+// output
+//------------------------------------------------------------------------------
+static void put_bits(BitWriter *w, unsigned int value, int count) {
+  w->bits |= (uint64_t)value << w->bit_count;
+  w->bit_count += count;
+  if (w->bit_count < 32)
+    return;
+  if (w->size + 8 > w->capacity) {
+    w->capacity = w->capacity * 2 + 4096;
+    w->data = realloc(w->data, w->capacity);
+  }
+  while (w->bit_count >= 8) {
+    w->data[w->size++] = w->bits & 0xFF;
+    w->bits >>= 8;
+    w->bit_count -= 8;
+  }
+}
+
+// pads to a byte boundary and writes out everything
+static void flush_bits(BitWriter *w) {
+  put_bits(w, 0, (8 - w->bit_count % 8) % 8);
+  if (w->size + 8 > w->capacity) {
+    w->capacity = w->size + 8;
+    w->data = realloc(w->data, w->capacity);
+  }
+  while (w->bit_count > 0) {
+    w->data[w->size++] = w->bits & 0xFF;
+    w->bits >>= 8;
+    w->bit_count -= 8;
+  }
+  w->bit_count = 0;
+}
+
+//------------------------------------------------------------------------------
+// huffman codes
+//------------------------------------------------------------------------------
+typedef struct {
+  unsigned int weight;
+  int parent;
+} HuffmanNode;
+
+static int compare_weights(const void *a, const void *b) {
+  const HuffmanNode *x = a, *y = b;
+  return (x->weight > y->weight) - (x->weight < y->weight);
+}
+
+// code lengths of at most `limit` bits. whenever the tree gets too deep the
+// frequencies are flattened and it is built again, which is never far from
+// optimal in practice
+static void build_lengths(const unsigned int *frequencies, int count,
+                          int limit, unsigned char *lengths) {
+  HuffmanNode nodes[2 * DEFLATE_LITERALS];
+  int symbols[DEFLATE_LITERALS];
+  unsigned int weights[DEFLATE_LITERALS];
+  memcpy(weights, frequencies, count * sizeof(unsigned int));
+  memset(lengths, 0, count);
+
+  for (;;) {
+    int leaves = 0;
+    for (int i = 0; i < count; i++)
+      if (weights[i])
+        nodes[leaves++] = (HuffmanNode){weights[i], i};
+    // a code needs two symbols, pad it out with unused ones
+    if (leaves < 2) {
+      int used = leaves ? nodes[0].parent : 0;
+      lengths[used] = 1;
+      lengths[used == 0 ? 1 : 0] = 1;
+      return;
+    }
+
+    // leaves sorted by weight, with their symbol kept in symbols[]
+    qsort(nodes, leaves, sizeof(HuffmanNode), compare_weights);
+    for (int i = 0; i < leaves; i++) {
+      symbols[i] = nodes[i].parent;
+      nodes[i].parent = -1;
+    }
+
+    // two queue construction: leaves in order, then merged nodes in the
+    // order they were made, which is sorted too
+    int leaf = 0, merged = leaves, next = leaves;
+    for (int i = 0; i < leaves - 1; i++) {
+      int pick[2];
+      for (int j = 0; j < 2; j++) {
+        if (leaf < leaves &&
+            (merged >= next || nodes[leaf].weight <= nodes[merged].weight))
+          pick[j] = leaf++;
+        else
+          pick[j] = merged++;
+      }
+      nodes[next] =
+          (HuffmanNode){nodes[pick[0]].weight + nodes[pick[1]].weight, -1};
+      nodes[pick[0]].parent = nodes[pick[1]].parent = next++;
+    }
+
+    // depth of every node, parents always come after their children
+    int depth[2 * DEFLATE_LITERALS];
+    depth[next - 1] = 0;
+    int deepest = 0;
+    for (int i = next - 2; i >= 0; i--) {
+      depth[i] = depth[nodes[i].parent] + 1;
+      deepest = depth[i] > deepest ? depth[i] : deepest;
+    }
+    if (deepest <= limit) {
+      for (int i = 0; i < leaves; i++)
+        lengths[symbols[i]] = depth[i];
+      return;
+    }
+    for (int i = 0; i < count; i++)
+      if (weights[i])
+        weights[i] = (weights[i] + 1) / 2;
+  }
+}
+
+// canonical codes from the lengths, bit reversed since deflate sends huffman
+// codes starting from their top bit
+static void build_codes(const unsigned char *lengths, int count,
+                        unsigned short *codes) {
+  int length_count[16] = {0};
+  for (int i = 0; i < count; i++)
+    length_count[lengths[i]]++;
+  length_count[0] = 0;
+
+  int next_code[16], code = 0;
+  for (int bits = 1; bits < 16; bits++) {
+    code = (code + length_count[bits - 1]) << 1;
+    next_code[bits] = code;
+  }
+  for (int i = 0; i < count; i++) {
+    int length = lengths[i];
+    if (length == 0)
+      continue;
+    int value = next_code[length]++, reversed = 0;
+    for (int bit = 0; bit < length; bit++)
+      reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+    codes[i] = reversed;
+  }
+}
+
+//------------------------------------------------------------------------------
+// blocks
+//------------------------------------------------------------------------------
+static int distance_symbol(const Deflater *d, int distance) {
+  return distance <= 256 ? d->distance_symbol[distance - 1]
+                         : d->distance_symbol[256 + ((distance - 1) >> 7)];
+}
+
+// run length encoded code lengths of both trees, as (symbol, extra) pairs
+static int encode_lengths(const unsigned char *lengths, int count,
+                          unsigned char *symbols, unsigned char *extras) {
+  int n = 0;
+  for (int i = 0; i < count;) {
+    int value = lengths[i], run = 1;
+    while (i + run < count && lengths[i + run] == value)
+      run++;
+    i += run;
+
+    if (value == 0) {
+      while (run >= 11) {
+        int take = run > 138 ? 138 : run;
+        symbols[n] = 18, extras[n++] = take - 11;
+        run -= take;
+      }
+      if (run >= 3) {
+        symbols[n] = 17, extras[n++] = run - 3;
+        run = 0;
+      }
+    } else {
+      symbols[n] = value, extras[n++] = 0;
+      run--;
+      while (run >= 3) {
+        int take = run > 6 ? 6 : run;
+        symbols[n] = 16, extras[n++] = take - 3;
+        run -= take;
+      }
+    }
+    while (run-- > 0)
+      symbols[n] = value, extras[n++] = 0;
+  }
+  return n;
+}
+
+static void write_block(Deflater *d, bool final) {
+  unsigned int literal_counts[DEFLATE_LITERALS] = {0};
+  unsigned int distance_counts[DEFLATE_DISTANCES] = {0};
+  for (int i = 0; i < d->token_count; i++) {
+    DeflateToken t = d->tokens[i];
+    if (t.distance == 0) {
+      literal_counts[t.length]++;
+    } else {
+      literal_counts[257 + d->length_symbol[t.length]]++;
+      distance_counts[distance_symbol(d, t.distance)]++;
+    }
+  }
+  literal_counts[256] = 1;
+
+  unsigned char literal_lengths[DEFLATE_LITERALS];
+  unsigned char distance_lengths[DEFLATE_DISTANCES];
+  build_lengths(literal_counts, DEFLATE_LITERALS, 15, literal_lengths);
+  build_lengths(distance_counts, DEFLATE_DISTANCES, 15, distance_lengths);
+
+  int literal_count = DEFLATE_LITERALS, distance_count = DEFLATE_DISTANCES;
+  while (literal_count > 257 && literal_lengths[literal_count - 1] == 0)
+    literal_count--;
+  while (distance_count > 1 && distance_lengths[distance_count - 1] == 0)
+    distance_count--;
+  // both trees' lengths go out as one sequence
+  unsigned char lengths[DEFLATE_LITERALS + DEFLATE_DISTANCES];
+  memcpy(lengths, literal_lengths, literal_count);
+  memcpy(lengths + literal_count, distance_lengths, distance_count);
+
+  unsigned char symbols[DEFLATE_LITERALS + DEFLATE_DISTANCES];
+  unsigned char extras[DEFLATE_LITERALS + DEFLATE_DISTANCES];
+  int n = encode_lengths(lengths, literal_count + distance_count, symbols,
+                         extras);
+  unsigned int code_length_counts[19] = {0};
+  for (int i = 0; i < n; i++)
+    code_length_counts[symbols[i]]++;
+  unsigned char code_lengths[19];
+  unsigned short code_length_codes[19];
+  build_lengths(code_length_counts, 19, 7, code_lengths);
+  build_codes(code_lengths, 19, code_length_codes);
+  int order_count = 19;
+  while (order_count > 4 &&
+         code_lengths[code_length_order[order_count - 1]] == 0)
+    order_count--;
+
+  // header
+  BitWriter *w = &d->out;
+  put_bits(w, final, 1);
+  put_bits(w, 2, 2);
+  put_bits(w, literal_count - 257, 5);
+  put_bits(w, distance_count - 1, 5);
+  put_bits(w, order_count - 4, 4);
+  for (int i = 0; i < order_count; i++)
+    put_bits(w, code_lengths[code_length_order[i]], 3);
+  static const unsigned char extra_bits[19] = {[16] = 2, [17] = 3, [18] = 7};
+  for (int i = 0; i < n; i++) {
+    put_bits(w, code_length_codes[symbols[i]], code_lengths[symbols[i]]);
+    if (symbols[i] >= 16)
+      put_bits(w, extras[i], extra_bits[symbols[i]]);
+  }
+
+  // data
+  unsigned short literal_codes[DEFLATE_LITERALS];
+  unsigned short distance_codes[DEFLATE_DISTANCES];
+  build_codes(literal_lengths, DEFLATE_LITERALS, literal_codes);
+  build_codes(distance_lengths, DEFLATE_DISTANCES, distance_codes);
+  for (int i = 0; i < d->token_count; i++) {
+    DeflateToken t = d->tokens[i];
+    if (t.distance == 0) {
+      put_bits(w, literal_codes[t.length], literal_lengths[t.length]);
+      continue;
+    }
+    int ls = d->length_symbol[t.length];
+    put_bits(w, literal_codes[257 + ls], literal_lengths[257 + ls]);
+    put_bits(w, t.length - length_base[ls], length_extra[ls]);
+    int ds = distance_symbol(d, t.distance);
+    put_bits(w, distance_codes[ds], distance_lengths[ds]);
+    put_bits(w, t.distance - distance_base[ds], distance_extra[ds]);
+  }
+  put_bits(w, literal_codes[256], literal_lengths[256]);
+  d->token_count = 0;
+}
+
+static void add_token(Deflater *d, int length, int distance) {
+  d->tokens[d->token_count++] = (DeflateToken){length, distance};
+  if (d->token_count == DEFLATE_BLOCK_TOKENS)
+    write_block(d, false);
+}
+
+static void fill_symbol_tables(Deflater *d) {
+  for (int s = 0; s < 29; s++) {
+    int end = length_base[s] + (1 << length_extra[s]);
+    for (int l = length_base[s]; l < end && l <= DEFLATE_MAX_MATCH; l++)
+      d->length_symbol[l] = s;
+  }
+  // 258 has a symbol of its own, not the top of the one before
+  d->length_symbol[DEFLATE_MAX_MATCH] = 28;
+  // distances up to 256 directly, the rest by their top bits
+  for (int s = 0; s < 30; s++) {
+    int end = distance_base[s] + (1 << distance_extra[s]);
+    for (int v = distance_base[s]; v < end; v++) {
+      if (v <= 256)
+        d->distance_symbol[v - 1] = s;
+      else
+        d->distance_symbol[256 + ((v - 1) >> 7)] = s;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// matching
+//------------------------------------------------------------------------------
+static unsigned int hash3(const unsigned char *p) {
+  return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+}
+
+unsigned char *deflate_chunk(const unsigned char *window, int dictionary_size,
+                             int size, bool last, int *out_size) {
+  Deflater d = {0};
+  d.tokens = malloc(DEFLATE_BLOCK_TOKENS * sizeof(DeflateToken));
+  fill_symbol_tables(&d);
+
+  const int total = dictionary_size + size;
+  int *head = malloc((1 << DEFLATE_HASH_BITS) * sizeof(int));
+  int *previous = malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+  memset(head, 0xFF, (1 << DEFLATE_HASH_BITS) * sizeof(int));
+
+#define INSERT(position)                                                       \
+  do {                                                                         \
+    unsigned int h = hash3(window + (position));                               \
+    previous[position] = head[h];                                              \
+    head[h] = (position);                                                      \
+  } while (0)
+
+  for (int i = 0; i < dictionary_size && i + DEFLATE_MIN_MATCH <= total; i++)
+    INSERT(i);
+
+  for (int i = dictionary_size; i < total;) {
+    int best = 0, best_distance = 0;
+    int longest = total - i < DEFLATE_MAX_MATCH ? total - i : DEFLATE_MAX_MATCH;
+    if (longest >= DEFLATE_MIN_MATCH) {
+      int chain = DEFLATE_MAX_CHAIN;
+      for (int candidate = head[hash3(window + i)];
+           candidate >= 0 && i - candidate <= DEFLATE_WINDOW_SIZE && chain--;
+           candidate = previous[candidate]) {
+        const unsigned char *a = window + candidate, *b = window + i;
+        // can't beat the best without matching one byte further
+        if (a[best] != b[best])
+          continue;
+        int length = 0;
+        while (length < longest && a[length] == b[length])
+          length++;
+        if (length > best) {
+          best = length;
+          best_distance = i - candidate;
+          if (length >= DEFLATE_NICE_MATCH || length == longest)
+            break;
+        }
+      }
+      INSERT(i);
+    }
+
+    if (best >= DEFLATE_MIN_MATCH) {
+      add_token(&d, best, best_distance);
+      for (int j = i + 1; j < i + best && j + DEFLATE_MIN_MATCH <= total; j++)
+        INSERT(j);
+      i += best;
+    } else {
+      add_token(&d, window[i], 0);
+      i++;
+    }
+  }
+#undef INSERT
+
+  write_block(&d, last);
+  if (!last) {
+    // empty stored block, lines the next chunk up on a byte boundary
+    put_bits(&d.out, 0, 3);
+    flush_bits(&d.out);
+    put_bits(&d.out, 0x0000, 16);
+    put_bits(&d.out, 0xFFFF, 16);
+  }
+  flush_bits(&d.out);
+
+  free(head);
+  free(previous);
+  free(d.tokens);
+  *out_size = d.out.size;
+  return d.out.data;
+}
+
+//------------------------------------------------------------------------------
+// adler32
+//------------------------------------------------------------------------------
+#define ADLER_BASE 65521u
+// most bytes that can be summed before the sums have to be reduced
+#define ADLER_NMAX 5552
+
+unsigned int deflate_adler32(unsigned int adler, const unsigned char *data,
+                             size_t size) {
+  unsigned int a = adler & 0xFFFF, b = adler >> 16;
+  while (size > 0) {
+    size_t n = size < ADLER_NMAX ? size : ADLER_NMAX;
+    size -= n;
+    while (n--) {
+      a += *data++;
+      b += a;
+    }
+    a %= ADLER_BASE;
+    b %= ADLER_BASE;
+  }
+  return b << 16 | a;
+}
+
+unsigned int deflate_adler32_combine(unsigned int a, unsigned int b,
+                                     size_t b_size) {
+  uint64_t remainder = b_size % ADLER_BASE;
+  uint64_t sum1 = a & 0xFFFF;
+  uint64_t sum2 = remainder * sum1 % ADLER_BASE;
+  sum1 += (b & 0xFFFF) + ADLER_BASE - 1;
+  sum2 += (a >> 16) + (b >> 16) + ADLER_BASE - remainder;
+  sum1 %= ADLER_BASE;
+  sum2 %= ADLER_BASE;
+  return sum2 << 16 | sum1;
+}
+
+#endif // DEFLATE_IMPLEMENTATION
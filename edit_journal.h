@@ -0,0 +1,205 @@
+/*
+ * edit_journal.h - undo/redo history of daisy's edits
+ *
+ * usage:
+ *   #define EDIT_JOURNAL_IMPLEMENTATION
+ *   #include "edit_journal.h"
+ *
+ * edits are never baked into the image, the pipeline renders whatever the
+ * current EditParams say. so the history only has to remember parameters: it
+ * is a journal of small operations (an effect, its value and the context
+ * region it was made in) and the edit state is what you get by replaying it.
+ *
+ * every JOURNAL_CHECKPOINT_INTERVAL operations the state is saved as a
+ * checkpoint, so undo replays at most that many operations from the closest
+ * one and redo applies a single operation. no image is ever copied, the
+ * pipeline caches take care of re-rendering.
+ *
+ * texts are referenced by their index in the caller's text list, which only
+ * grows. the journal tells the caller which of them are visible.
+ */
+
+#include "raylib.h"
+
+#ifndef EDIT_JOURNAL_H
+#define EDIT_JOURNAL_H
+
+#include <stdbool.h>
+
+#define JOURNAL_CHECKPOINT_INTERVAL 16
+
+typedef enum {
+  EDIT_ADD_TEXT,
+  EDIT_BLUR,
+  EDIT_BRIGHTNESS,
+  EDIT_SNAP_PIXELS,
+  // the "undo all changes" button, undoable itself
+  EDIT_RESET
+} EditKind;
+
+// the range of the sliders, anything recorded stays inside it
+#define EDIT_BLUR_MAX 20
+#define EDIT_BRIGHTNESS_MIN -100
+#define EDIT_BRIGHTNESS_MAX 100
+
+typedef struct {
+  EditKind kind;
+  // new blur or brightness, 0/1 for snapping. unused by texts and resets
+  float value;
+  // context region the edit was made in, same units as EditParams.region
+  Rectangle region;
+} EditOp;
+
+// what replaying the journal up to some point gives
+typedef struct {
+  // texts [text_first, text_end) of the caller's list are visible
+  int text_first;
+  int text_end;
+  float blur;
+  float brightness;
+  bool snap_pixels;
+  Rectangle region;
+} EditState;
+
+typedef struct {
+  EditOp *ops;
+  int count;
+  int capacity;
+  // ops before the cursor are applied, the ones after it can be redone
+  int cursor;
+
+  // checkpoints[i] is the state after i * JOURNAL_CHECKPOINT_INTERVAL ops
+  EditState *checkpoints;
+  int checkpoint_capacity;
+
+  EditState state;
+} EditJournal;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// drops whatever could still be redone. with merge set, an op of the same
+// kind as the last one replaces it instead, so dragging a slider is a single
+// step in the history
+void journal_record(EditJournal *journal, EditOp op, bool merge);
+bool journal_undo(EditJournal *journal);
+bool journal_redo(EditJournal *journal);
+bool journal_can_undo(const EditJournal *journal);
+bool journal_can_redo(const EditJournal *journal);
+void journal_free(EditJournal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EDIT_JOURNAL_H
+
+/*
+ * EDIT_JOURNAL IMPLEMENTATION
+ */
+#if defined(EDIT_JOURNAL_IMPLEMENTATION)
+
+#include <stdlib.h> // Required for: realloc(), free()
+
+static EditState apply_op(EditState state, EditOp op) {
+  switch (op.kind) {
+  case EDIT_ADD_TEXT:
+    state.text_end++;
+    break;
+  case EDIT_BLUR:
+    state.blur = op.value;
+    break;
+  case EDIT_BRIGHTNESS:
+    state.brightness = op.value;
+    break;
+  case EDIT_SNAP_PIXELS:
+    state.snap_pixels = op.value != 0;
+    break;
+  case EDIT_RESET:
+    state.blur = 0;
+    state.brightness = 0;
+    state.snap_pixels = false;
+    state.text_first = state.text_end;
+    break;
+  }
+  state.region = op.region;
+  return state;
+}
+
+// the state after the first `position` ops, from the closest checkpoint
+static EditState replay(const EditJournal *journal, int position) {
+  int checkpoint = position / JOURNAL_CHECKPOINT_INTERVAL;
+  EditState state = journal->checkpoints ? journal->checkpoints[checkpoint]
+                                         : (EditState){0};
+  for (int i = checkpoint * JOURNAL_CHECKPOINT_INTERVAL; i < position; i++)
+    state = apply_op(state, journal->ops[i]);
+  return state;
+}
+
+static void save_checkpoint(EditJournal *journal) {
+  if (journal->count % JOURNAL_CHECKPOINT_INTERVAL != 0)
+    return;
+  int index = journal->count / JOURNAL_CHECKPOINT_INTERVAL;
+  if (index >= journal->checkpoint_capacity) {
+    journal->checkpoint_capacity = journal->checkpoint_capacity * 2 + 4;
+    journal->checkpoints =
+        realloc(journal->checkpoints,
+                journal->checkpoint_capacity * sizeof(EditState));
+  }
+  journal->checkpoints[index] = journal->state;
+}
+
+void journal_record(EditJournal *journal, EditOp op, bool merge) {
+  // the very first checkpoint is the untouched state
+  if (journal->checkpoints == NULL)
+    save_checkpoint(journal);
+
+  journal->count = journal->cursor;
+  if (merge && journal->count > 0 &&
+      journal->ops[journal->count - 1].kind == op.kind &&
+      op.kind != EDIT_ADD_TEXT) {
+    journal->count--;
+    journal->state = replay(journal, journal->count);
+  }
+
+  if (journal->count == journal->capacity) {
+    journal->capacity = journal->capacity * 2 + 16;
+    journal->ops = realloc(journal->ops, journal->capacity * sizeof(EditOp));
+  }
+  journal->ops[journal->count++] = op;
+  journal->cursor = journal->count;
+  journal->state = apply_op(journal->state, op);
+  save_checkpoint(journal);
+}
+
+bool journal_undo(EditJournal *journal) {
+  if (!journal_can_undo(journal))
+    return false;
+  journal->cursor--;
+  journal->state = replay(journal, journal->cursor);
+  return true;
+}
+
+bool journal_redo(EditJournal *journal) {
+  if (!journal_can_redo(journal))
+    return false;
+  journal->state = apply_op(journal->state, journal->ops[journal->cursor++]);
+  return true;
+}
+
+bool journal_can_undo(const EditJournal *journal) {
+  return journal->cursor > 0;
+}
+
+bool journal_can_redo(const EditJournal *journal) {
+  return journal->cursor < journal->count;
+}
+
+void journal_free(EditJournal *journal) {
+  free(journal->ops);
+  free(journal->checkpoints);
+  *journal = (EditJournal){0};
+}
+
+#endif // EDIT_JOURNAL_IMPLEMENTATION
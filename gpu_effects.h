@@ -0,0 +1,257 @@
+/*
+ * gpu_effects.h - shader path for blur and brightness
+ *
+ * usage:
+ *   #define GPU_EFFECTS_IMPLEMENTATION
+ *   #include "gpu_effects.h"
+ *
+ * the cpu pipeline still rasterizes text and scales the image down to the
+ * preview, then that layer is uploaded once. blur (two separable passes) and
+ * brightness run as fragment shaders between render textures, so moving a
+ * slider only costs a few draw calls. everything here has to run on the
+ * thread that owns the gl context.
+ *
+ * if the shaders don't compile (no gl 3.3, broken driver) gpu_effects_init()
+ * returns false and the caller keeps using the cpu path. it works on mesa's
+ * software rasterizer too:
+ *
+ *   LIBGL_ALWAYS_SOFTWARE=1 ./app --gpu
+ */
+
+#include "raylib.h"
+
+#ifndef GPU_EFFECTS_H
+#define GPU_EFFECTS_H
+
+#include "texture_sync.h"
+
+#include <stdbool.h>
+
+typedef struct {
+  bool ready;
+  Shader blur;
+  int blur_step_loc;
+  int blur_sigma_loc;
+  int blur_half_width_loc;
+  int blur_region_loc;
+  Shader brightness;
+  int brightness_shift_loc;
+  int brightness_region_loc;
+
+  // the uploaded layer and the two targets the passes ping-pong between
+  Texture2D layer;
+  TextureStaging staging;
+  RenderTexture2D targets[2];
+  // which target holds the finished result
+  int result;
+} GpuEffects;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool gpu_effects_init(GpuEffects *gpu);
+void gpu_effects_unload(GpuEffects *gpu);
+// uploads the text layer, same size as the preview. previous is the layer
+// set last time, only what changed since is uploaded
+void gpu_effects_set_layer(GpuEffects *gpu, Image layer, Image previous);
+// blur radius is in layer pixels, brightness like ImageColorBrightness().
+// region is a fraction of the layer like EditParams.region, pixels outside
+// of it are left alone
+void gpu_effects_render(GpuEffects *gpu, float blur, int brightness,
+                        Rectangle region);
+void gpu_effects_draw(GpuEffects *gpu, Rectangle dest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPU_EFFECTS_H
+
+/*
+ * GPU_EFFECTS IMPLEMENTATION
+ */
+#if defined(GPU_EFFECTS_IMPLEMENTATION)
+
+#include "rlgl.h" // Required for: rlGetShaderIdDefault()
+
+#include <math.h> // Required for: sqrtf(), ceilf()
+
+// one direction of the separable gaussian, premultiplied so transparent
+// pixels don't bleed their colour into the neighbours
+static const char *blur_fragment_shader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec2 step;\n"
+    "uniform float sigma;\n"
+    "uniform int halfWidth;\n"
+    "uniform vec4 region;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "  if (any(lessThan(fragTexCoord, region.xy)) ||\n"
+    "      any(greaterThanEqual(fragTexCoord, region.zw))) {\n"
+    "    finalColor = texture(texture0, fragTexCoord);\n"
+    "    return;\n"
+    "  }\n"
+    "  vec4 sum = vec4(0.0);\n"
+    "  float total = 0.0;\n"
+    "  for (int i = -halfWidth; i <= halfWidth; i++) {\n"
+    "    float w = exp(-float(i * i) / (2.0 * sigma * sigma));\n"
+    "    vec4 c = texture(texture0, fragTexCoord + step * float(i));\n"
+    "    sum += vec4(c.rgb * c.a, c.a) * w;\n"
+    "    total += w;\n"
+    "  }\n"
+    "  sum /= total;\n"
+    "  finalColor = sum.a > 0.0 ? vec4(sum.rgb / sum.a, sum.a) : vec4(0.0);\n"
+    "}\n";
+
+static const char *brightness_fragment_shader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform float shift;\n"
+    "uniform vec4 region;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "  vec4 c = texture(texture0, fragTexCoord);\n"
+    "  bool inside = all(greaterThanEqual(fragTexCoord, region.xy)) &&\n"
+    "                all(lessThan(fragTexCoord, region.zw));\n"
+    "  finalColor = inside ? vec4(clamp(c.rgb + shift, 0.0, 1.0), c.a) : c;\n"
+    "}\n";
+
+// raylib hands back its default shader when compiling fails
+static bool shader_compiled(Shader shader) {
+  return shader.id > 0 && shader.id != rlGetShaderIdDefault();
+}
+
+bool gpu_effects_init(GpuEffects *gpu) {
+  *gpu = (GpuEffects){0};
+  gpu->blur = LoadShaderFromMemory(NULL, blur_fragment_shader);
+  gpu->brightness = LoadShaderFromMemory(NULL, brightness_fragment_shader);
+  if (!shader_compiled(gpu->blur) || !shader_compiled(gpu->brightness)) {
+    TraceLog(LOG_WARNING, "DAISY: shaders unavailable, using the cpu path");
+    gpu_effects_unload(gpu);
+    return false;
+  }
+
+  gpu->blur_step_loc = GetShaderLocation(gpu->blur, "step");
+  gpu->blur_sigma_loc = GetShaderLocation(gpu->blur, "sigma");
+  gpu->blur_half_width_loc = GetShaderLocation(gpu->blur, "halfWidth");
+  gpu->blur_region_loc = GetShaderLocation(gpu->blur, "region");
+  gpu->brightness_shift_loc = GetShaderLocation(gpu->brightness, "shift");
+  gpu->brightness_region_loc = GetShaderLocation(gpu->brightness, "region");
+  gpu->ready = true;
+  return true;
+}
+
+static void unload_targets(GpuEffects *gpu) {
+  for (int i = 0; i < 2; i++) {
+    if (gpu->targets[i].id > 0)
+      UnloadRenderTexture(gpu->targets[i]);
+    gpu->targets[i] = (RenderTexture2D){0};
+  }
+}
+
+void gpu_effects_unload(GpuEffects *gpu) {
+  if (shader_compiled(gpu->blur))
+    UnloadShader(gpu->blur);
+  if (shader_compiled(gpu->brightness))
+    UnloadShader(gpu->brightness);
+  if (gpu->layer.id > 0)
+    UnloadTexture(gpu->layer);
+  texture_staging_free(&gpu->staging);
+  unload_targets(gpu);
+  *gpu = (GpuEffects){0};
+}
+
+void gpu_effects_set_layer(GpuEffects *gpu, Image layer, Image previous) {
+  if (!texture_sync(&gpu->layer, layer, previous, &gpu->staging))
+    return;
+
+  // new size, the targets have to follow
+  unload_targets(gpu);
+  for (int i = 0; i < 2; i++) {
+    gpu->targets[i] = LoadRenderTexture(layer.width, layer.height);
+    // the blur samples past the border, repeat the edge instead of wrapping
+    SetTextureWrap(gpu->targets[i].texture, TEXTURE_WRAP_CLAMP);
+  }
+  SetTextureWrap(gpu->layer, TEXTURE_WRAP_CLAMP);
+}
+
+// render textures come out upside down, flip every time one is drawn so the
+// orientation stays the same from pass to pass
+static void run_pass(GpuEffects *gpu, int from, Shader shader) {
+  Texture2D source = gpu->targets[from].texture;
+  BeginTextureMode(gpu->targets[1 - from]);
+  ClearBackground(BLANK);
+  BeginShaderMode(shader);
+  DrawTextureRec(source, (Rectangle){0, 0, source.width, -source.height},
+                 (Vector2){0, 0}, WHITE);
+  EndShaderMode();
+  EndTextureMode();
+  gpu->result = 1 - from;
+}
+
+void gpu_effects_render(GpuEffects *gpu, float blur, int brightness,
+                        Rectangle region) {
+  if (!gpu->ready || gpu->layer.id == 0)
+    return;
+
+  // the targets hold the image bottom up, so the region is flipped to match
+  // the texture coordinates the passes see
+  float bounds[4] = {0, 0, 1, 1};
+  if (region.width > 0 && region.height > 0) {
+    bounds[0] = region.x;
+    bounds[1] = 1 - (region.y + region.height);
+    bounds[2] = region.x + region.width;
+    bounds[3] = 1 - region.y;
+  }
+  SetShaderValue(gpu->blur, gpu->blur_region_loc, bounds,
+                 SHADER_UNIFORM_VEC4);
+  SetShaderValue(gpu->brightness, gpu->brightness_region_loc, bounds,
+                 SHADER_UNIFORM_VEC4);
+
+  BeginTextureMode(gpu->targets[0]);
+  ClearBackground(BLANK);
+  DrawTexture(gpu->layer, 0, 0, WHITE);
+  EndTextureMode();
+  gpu->result = 0;
+
+  if (blur > 0) {
+    // same spread as three box passes of that radius, like the cpu blur
+    float sigma = sqrtf(blur * (blur + 1));
+    int half_width = ceilf(3 * sigma);
+    SetShaderValue(gpu->blur, gpu->blur_sigma_loc, &sigma,
+                   SHADER_UNIFORM_FLOAT);
+    SetShaderValue(gpu->blur, gpu->blur_half_width_loc, &half_width,
+                   SHADER_UNIFORM_INT);
+
+    Vector2 horizontal = {1.f / gpu->layer.width, 0};
+    SetShaderValue(gpu->blur, gpu->blur_step_loc, &horizontal,
+                   SHADER_UNIFORM_VEC2);
+    run_pass(gpu, gpu->result, gpu->blur);
+
+    Vector2 vertical = {0, 1.f / gpu->layer.height};
+    SetShaderValue(gpu->blur, gpu->blur_step_loc, &vertical,
+                   SHADER_UNIFORM_VEC2);
+    run_pass(gpu, gpu->result, gpu->blur);
+  }
+
+  if (brightness != 0) {
+    float shift = brightness / 255.f;
+    SetShaderValue(gpu->brightness, gpu->brightness_shift_loc, &shift,
+                   SHADER_UNIFORM_FLOAT);
+    run_pass(gpu, gpu->result, gpu->brightness);
+  }
+}
+
+void gpu_effects_draw(GpuEffects *gpu, Rectangle dest) {
+  Texture2D result = gpu->targets[gpu->result].texture;
+  DrawTexturePro(result, (Rectangle){0, 0, result.width, -result.height}, dest,
+                 (Vector2){0, 0}, 0, WHITE);
+}
+
+#endif // GPU_EFFECTS_IMPLEMENTATION
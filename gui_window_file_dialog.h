@@ -8,14 +8,31 @@
  *
  *       INIT: GuiWindowFileDialogState state = GuiInitWindowFileDialog();
  *       DRAW: GuiWindowFileDialog(&state);
+ *       DEINIT: UnloadGuiWindowFileDialog(&state);
  *
  *   NOTE: This module depends on some raylib file system functions:
- *       - LoadDirectoryFiles()
- *       - UnloadDirectoryFiles()
  *       - GetWorkingDirectory()
+ *       - GetFileModTime()
  *       - DirectoryExists()
  *       - FileExists()
  *
+ *   NOTE: Outside of Windows the implementation uses fstatat() and dirfd(),
+ *   define _GNU_SOURCE (or _POSIX_C_SOURCE 200809L) before any system header
+ *   when building with a strict -std=c11.
+ *
+ *   Directories are read in a single pass that keeps every entry's type, size
+ *   and modification time, and recently visited ones are cached for as long
+ *   as their modification time doesn't change. Rewriting a file doesn't
+ *   change its directory, so the entries of a cached listing are stat()ed
+ *   again once they get drawn.
+ *
+ *   The grid view shows a thumbnail of every image, made in the background
+ *   and kept on disk between runs (see thumbnail_cache.h).
+ *
+ *   Typing while no text box is being edited searches the current directory:
+ *   files are kept when the typed letters appear in their name in order, best
+ *   matches first.
+ *
  *   LICENSE: zlib/libpng
  *
  *   Copyright (c) 2019-2023 Ramon Santamaria (@raysan5)
@@ -46,6 +63,60 @@
 #ifndef GUI_WINDOW_FILE_DIALOG_H
 #define GUI_WINDOW_FILE_DIALOG_H
 
+#include "thumbnail_cache.h"
+
+// Directory entry type
+typedef enum { FILE_TYPE_FILE = 0, FILE_TYPE_DIRECTORY } FileType;
+
+// Detailed file info, read when its directory is scanned
+typedef struct FileInfo {
+  const char *name; // Points into the listing's string pool
+  unsigned int nameOffset;
+  long long size;
+  long modTime;
+  int type;
+  int icon;   // 0 until the entry is first drawn
+  bool stale; // Size and modTime are read again the next time it's drawn
+} FileInfo;
+
+// Files of one directory, sorted directories first and then by name
+typedef struct DirectoryListing {
+  char path[1024];
+  char filter[256];
+  long modTime;  // Directory modification time when it was scanned
+  long scanTime; // When it was scanned
+  FileInfo *files;
+  int count;
+  int capacity;
+  // Every name, one after the other. Entries are addressed by offset while
+  // the pool still grows
+  char *names;
+  unsigned int namesSize;
+  unsigned int namesCapacity;
+  unsigned int lastUsed;
+  unsigned int serial; // Different for every scan
+  // Search index, built the first time the listing is searched: the names
+  // lowercased (same offsets as names) and the characters in each of them
+  char *lowerNames;
+  unsigned long long *charMasks;
+} DirectoryListing;
+
+// A file of a listing that matches a search
+typedef struct FileMatch {
+  int index; // Into the listing
+  int score;
+} FileMatch;
+
+// Files of a listing matching a search, best match first
+typedef struct FileSearch {
+  char query[256];            // What the matches are for, lowercase
+  unsigned int listingSerial; // And in which listing
+  FileMatch *matches;
+  FileInfo *files; // The matches in order, what the list shows
+  int count;
+  int capacity;
+} FileSearch;
+
 // Gui file dialog context data
 typedef struct {
 
@@ -68,11 +139,16 @@ typedef struct {
   char fileNameText[1024];
   bool SelectFilePressed;
   bool CancelFilePressed;
-  int fileTypeActive;
   int itemFocused;
+  bool thumbnailMode; // Grid of thumbnails instead of the list
+  bool searchEditMode;
+  char searchText[256]; // Only files with these letters in order in the name
 
   // Custom state variables
-  FilePathList dirFiles;
+  DirectoryListing *dirFiles; // Points into the directory cache
+  ThumbnailCache *thumbnails;  // Created the first time the grid is shown
+  size_t thumbnailMemoryCap;  // Bigger decoded images get no thumbnail
+  FileSearch search;
   char filterExt[256];
   char dirPathTextCopy[1024];
   char fileNameTextCopy[1024];
@@ -107,6 +183,7 @@ extern "C" { // Prevents name mangling of functions
 //----------------------------------------------------------------------------------
 GuiWindowFileDialogState InitGuiWindowFileDialog(const char *initPath);
 void GuiWindowFileDialog(GuiWindowFileDialogState *state);
+void UnloadGuiWindowFileDialog(GuiWindowFileDialogState *state);
 
 #ifdef __cplusplus
 }
@@ -123,52 +200,63 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state);
 
 #include "raygui.h"
 
+#include <stdlib.h> // Required for: qsort()
 #include <string.h> // Required for: strcpy()
+#include <time.h>   // Required for: time()
+
+#if defined(_WIN32)
+#include <io.h>       // Required for: _findfirst64(), _findnext64()
+#include <sys/stat.h> // Required for: _stat64()
+#else
+#include <dirent.h>   // Required for: opendir(), readdir(), closedir()
+#include <sys/stat.h> // Required for: fstatat(), stat()
+#endif
 
 //----------------------------------------------------------------------------------
 // Defines and Macros
 //----------------------------------------------------------------------------------
-#define MAX_DIRECTORY_FILES 2048
-#define MAX_ICON_PATH_LENGTH 512
+#define DIRECTORY_CACHE_SIZE 8
+#define GRID_THUMBNAIL_SIZE 64 // Longest side of a thumbnail in the grid
 #ifdef _WIN32
 #define PATH_SEPERATOR "\\"
 #else
 #define PATH_SEPERATOR "/"
 #endif
 
-//----------------------------------------------------------------------------------
-// Types and Structures Definition
-//----------------------------------------------------------------------------------
-#if defined(USE_CUSTOM_LISTVIEW_FILEINFO)
-// Detailed file info type
-typedef struct FileInfo {
-  const char *name;
-  int size;
-  int modTime;
-  int type;
-  int icon;
-} FileInfo;
-#else
-// Filename only
-typedef char *FileInfo; // Files are just a path string
-#endif
-
 //----------------------------------------------------------------------------------
 // Global Variables Definition
 //----------------------------------------------------------------------------------
-FileInfo *dirFilesIcon = NULL; // Path string + icon (for fancy drawing)
+// Recently visited directories, going back to one that didn't change since
+// doesn't touch the file system beyond a single stat()
+static DirectoryListing directoryCache[DIRECTORY_CACHE_SIZE] = {0};
+static unsigned int directoryCacheClock = 0;
+static unsigned int directorySerial = 0;
 
 //----------------------------------------------------------------------------------
 // Internal Module Functions Definition
 //----------------------------------------------------------------------------------
 // Read files in new path
 static void ReloadDirectoryFiles(GuiWindowFileDialogState *state);
+static void UnloadDirectoryListing(DirectoryListing *listing);
+// Match the search text against the current listing, if anything changed
+static void UpdateFileSearch(GuiWindowFileDialogState *state);
+// Files the list shows, the search results while there is a search
+static FileInfo *GetShownFiles(GuiWindowFileDialogState *state, int *count);
+
+// Read the size and modification time of an entry again, if it's stale
+static void RefreshFileInfo(const char *dirPath, FileInfo *file);
 
-#if defined(USE_CUSTOM_LISTVIEW_FILEINFO)
 // List View control for files info with extended parameters
-static int GuiListViewFiles(Rectangle bounds, FileInfo *files, int count,
-                            int *focus, int *scrollIndex, int active);
-#endif
+static int GuiListViewFiles(Rectangle bounds, const char *dirPath,
+                            FileInfo *files, int count, int *focus,
+                            int *scrollIndex, int *active);
+// Grid View control for files info, with thumbnails of the images
+static int GuiGridViewFiles(Rectangle bounds, const char *dirPath,
+                            FileInfo *files, int count, int *focus,
+                            int *scrollIndex, int *active,
+                            ThumbnailCache *thumbnails);
+// Icon for a file, from its extension
+static int GetFileIcon(const char *name, int type);
 
 //----------------------------------------------------------------------------------
 // Module Functions Definition
@@ -195,8 +283,6 @@ GuiWindowFileDialogState InitGuiWindowFileDialog(const char *initPath) {
   state.SelectFilePressed = false;
   state.CancelFilePressed = false;
 
-  state.fileTypeActive = 0;
-
   strcpy(state.fileNameText, "\0");
 
   // Custom variables initialization
@@ -213,9 +299,10 @@ GuiWindowFileDialogState InitGuiWindowFileDialog(const char *initPath) {
   strcpy(state.fileNameTextCopy, state.fileNameText);
 
   state.filterExt[0] = '\0';
+  state.thumbnailMemoryCap = (size_t)-1; // No cap unless the caller sets one
   // strcpy(state.filterExt, "all");
 
-  state.dirFiles.count = 0;
+  state.dirFiles = NULL;
 
   return state;
 }
@@ -265,20 +352,36 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
     }
     //----------------------------------------------------------------------------------------
 
-    // Load dirFilesIcon and state->dirFiles lazily on windows open
-    // NOTE: They are automatically unloaded at fileDialog closing
+    // Load state->dirFiles lazily on windows open
+    // NOTE: The listing stays in the directory cache at fileDialog closing
     //----------------------------------------------------------------------------------------
-    if (dirFilesIcon == NULL) {
-      dirFilesIcon = (FileInfo *)RL_CALLOC(
-          MAX_DIRECTORY_FILES, sizeof(FileInfo)); // Max files to read
-      for (int i = 0; i < MAX_DIRECTORY_FILES; i++)
-        dirFilesIcon[i] =
-            (char *)RL_CALLOC(MAX_ICON_PATH_LENGTH, 1); // Max file name length
-    }
-
-    // Load current directory files
-    if (state->dirFiles.paths == NULL)
+    if (state->dirFiles == NULL)
       ReloadDirectoryFiles(state);
+
+    // Typing anywhere in the dialog starts a search, the search box keeps the
+    // rest of the typing
+    if (!state->dirPathEditMode && !state->fileNameEditMode &&
+        !state->searchEditMode) {
+      int codepoint = GetCharPressed();
+      int length = (int)strlen(state->searchText);
+      int codepointSize = 0;
+      const char *encoded = CodepointToUTF8(codepoint, &codepointSize);
+      if ((codepoint >= 32) &&
+          (length + codepointSize < (int)sizeof(state->searchText))) {
+        memcpy(state->searchText + length, encoded, codepointSize);
+        state->searchText[length + codepointSize] = '\0';
+        state->searchEditMode = true;
+        textBoxCursorIndex = length + codepointSize;
+      }
+    }
+    UpdateFileSearch(state);
+
+    // Upload the thumbnails decoded since the last frame
+    if (state->thumbnailMode && (state->thumbnails == NULL))
+      state->thumbnails = thumbnail_cache_create(GRID_THUMBNAIL_SIZE,
+                                                 state->thumbnailMemoryCap);
+    if (state->thumbnails != NULL)
+      thumbnail_cache_update(state->thumbnails);
     //----------------------------------------------------------------------------------------
 
     // Draw window and controls
@@ -302,10 +405,16 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
       memset(state->fileNameTextCopy, 0, 1024);
     }
 
+    // Draw list/grid toggle
+    GuiToggle(
+        (Rectangle){state->windowBounds.x + state->windowBounds.width - 48 - 32,
+                    state->windowBounds.y + 24 + 12, 24, 24},
+        "#97#", &state->thumbnailMode);
+
     // Draw current directory text box info + path editing logic
     if (GuiTextBox((Rectangle){state->windowBounds.x + 8,
                                state->windowBounds.y + 24 + 12,
-                               state->windowBounds.width - 48 - 16, 24},
+                               state->windowBounds.width - 48 - 32 - 24, 24},
                    state->dirPathText, 1024, state->dirPathEditMode)) {
       if (state->dirPathEditMode) {
         // Verify if a valid path has been introduced
@@ -326,22 +435,22 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
     int prevElementsHeight = GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT);
     GuiSetStyle(LISTVIEW, TEXT_ALIGNMENT, TEXT_ALIGN_LEFT);
     GuiSetStyle(LISTVIEW, LIST_ITEMS_HEIGHT, 24);
-#if defined(USE_CUSTOM_LISTVIEW_FILEINFO)
-    state->filesListActive = GuiListViewFiles(
-        (Rectangle){state->position.x + 8, state->position.y + 48 + 20,
-                    state->windowBounds.width - 16,
-                    state->windowBounds.height - 60 - 16 - 68},
-        fileInfo, state->dirFiles.count, &state->itemFocused,
-        &state->filesListScrollIndex, state->filesListActive);
-#else
-    GuiListViewEx((Rectangle){state->windowBounds.x + 8,
-                              state->windowBounds.y + 48 + 20,
-                              state->windowBounds.width - 16,
-                              state->windowBounds.height - 60 - 16 - 68},
-                  (const char **)dirFilesIcon, state->dirFiles.count,
-                  &state->filesListScrollIndex, &state->filesListActive,
-                  &state->itemFocused);
-#endif
+    Rectangle filesBounds = {state->windowBounds.x + 8,
+                             state->windowBounds.y + 48 + 20,
+                             state->windowBounds.width - 16,
+                             state->windowBounds.height - 60 - 16 - 68};
+    // Both keep the first visible file in the scroll index, switching between
+    // them stays at the same place
+    int shownCount = 0;
+    FileInfo *shownFiles = GetShownFiles(state, &shownCount);
+    if (state->thumbnailMode)
+      GuiGridViewFiles(filesBounds, state->dirPathText, shownFiles, shownCount,
+                       &state->itemFocused, &state->filesListScrollIndex,
+                       &state->filesListActive, state->thumbnails);
+    else
+      GuiListViewFiles(filesBounds, state->dirPathText, shownFiles, shownCount,
+                       &state->itemFocused, &state->filesListScrollIndex,
+                       &state->filesListActive);
     GuiSetStyle(LISTVIEW, TEXT_ALIGNMENT, prevTextAlignment);
     GuiSetStyle(LISTVIEW, LIST_ITEMS_HEIGHT, prevElementsHeight);
 
@@ -352,11 +461,10 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
     //&& (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) || IsKeyPressed(KEY_ENTER) ||
     //IsKeyPressed(KEY_DPAD_A)))
     {
-      strcpy(state->fileNameText,
-             GetFileName(state->dirFiles.paths[state->filesListActive]));
+      const FileInfo *file = &shownFiles[state->filesListActive];
+      strcpy(state->fileNameText, file->name);
 
-      if (DirectoryExists(
-              TextFormat("%s/%s", state->dirPathText, state->fileNameText))) {
+      if (file->type == FILE_TYPE_DIRECTORY) {
         if (TextIsEqual(state->fileNameText, ".."))
           strcpy(state->dirPathText, GetPrevDirectoryPath(state->dirPathText));
         else
@@ -398,9 +506,12 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
         // Verify if a valid filename has been introduced
         if (FileExists(
                 TextFormat("%s/%s", state->dirPathText, state->fileNameText))) {
-          // Select filename from list view
-          for (int i = 0; i < state->dirFiles.count; i++) {
-            if (TextIsEqual(state->fileNameText, state->dirFiles.paths[i])) {
+          // Select filename from list view, out of every file
+          state->searchText[0] = '\0';
+          UpdateFileSearch(state);
+          for (int i = 0; i < state->dirFiles->count; i++) {
+            if (TextIsEqual(state->fileNameText,
+                            state->dirFiles->files[i].name)) {
               state->filesListActive = i;
               strcpy(state->fileNameTextCopy, state->fileNameText);
               break;
@@ -418,12 +529,14 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
                          state->windowBounds.y + state->windowBounds.height -
                              24 - 12,
                          68, 24},
-             "File filter:");
-    GuiComboBox((Rectangle){state->windowBounds.x + 72,
-                            state->windowBounds.y + state->windowBounds.height -
-                                24 - 12,
-                            state->windowBounds.width - 184, 24},
-                "All files", &state->fileTypeActive);
+             "Search:");
+    if (GuiTextBox((Rectangle){state->windowBounds.x + 72,
+                               state->windowBounds.y +
+                                   state->windowBounds.height - 24 - 12,
+                               state->windowBounds.width - 184, 24},
+                   state->searchText, sizeof(state->searchText),
+                   state->searchEditMode))
+      state->searchEditMode = !state->searchEditMode;
 
     state->SelectFilePressed = GuiButton(
         (Rectangle){state->windowBounds.x + state->windowBounds.width - 96 - 8,
@@ -444,254 +557,501 @@ void GuiWindowFileDialog(GuiWindowFileDialogState *state) {
     if (state->SelectFilePressed)
       state->windowActive = false;
 
-    // File dialog has been closed, free all memory before exit
+    // File dialog has been closed
     if (!state->windowActive) {
-      // Free dirFilesIcon memory
-      for (int i = 0; i < MAX_DIRECTORY_FILES; i++)
-        RL_FREE(dirFilesIcon[i]);
+      // The listing stays in the directory cache, it's checked against the
+      // directory's modification time when the dialog opens again
+      state->dirFiles = NULL;
+    }
+  }
+}
 
-      RL_FREE(dirFilesIcon);
-      dirFilesIcon = NULL;
+// Unload file dialog, the thumbnails and the directory cache
+void UnloadGuiWindowFileDialog(GuiWindowFileDialogState *state) {
+  thumbnail_cache_destroy(state->thumbnails);
+  state->thumbnails = NULL;
+  state->dirFiles = NULL;
 
-      // Unload directory file paths
-      UnloadDirectoryFiles(state->dirFiles);
+  RL_FREE(state->search.matches);
+  RL_FREE(state->search.files);
+  memset(&state->search, 0, sizeof(FileSearch));
 
-      // Reset state variables
-      state->dirFiles.count = 0;
-      state->dirFiles.capacity = 0;
-      state->dirFiles.paths = NULL;
-    }
+  for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++)
+    UnloadDirectoryListing(&directoryCache[i]);
+}
+
+// Icon for a file, from its extension (for some recognized extensions)
+static int GetFileIcon(const char *name, int type) {
+  if (type == FILE_TYPE_DIRECTORY)
+    return 1;
+  if (IsFileExtension(name, ".png;.bmp;.tga;.gif;.jpg;.jpeg;.psd;.hdr;.qoi;"
+                            ".dds;.pkm;.ktx;.pvr;.astc"))
+    return 12;
+  if (IsFileExtension(name, ".wav;.mp3;.ogg;.flac;.xm;.mod;.it;.wma;.aiff"))
+    return 11;
+  if (IsFileExtension(name, ".txt;.info;.md;.nfo;.xml;.json;.c;.cpp;.cs;.lua;"
+                            ".py;.glsl;.vs;.fs"))
+    return 10;
+  if (IsFileExtension(name, ".exe;.bin;.raw;.msi"))
+    return 200;
+  return 218;
+}
+
+// Add an entry to a listing, same filter rules as LoadDirectoryFilesEx():
+// files need a matching extension, directories a "DIR" in the filter
+static void AddDirectoryEntry(DirectoryListing *listing, const char *name,
+                              int type, long long size, long modTime) {
+  if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
+    return;
+  if (listing->filter[0] != '\0') {
+    if ((type == FILE_TYPE_FILE) && !IsFileExtension(name, listing->filter))
+      return;
+    if ((type == FILE_TYPE_DIRECTORY) &&
+        (TextFindIndex(listing->filter, "DIR") < 0))
+      return;
   }
+
+  if (listing->count == listing->capacity) {
+    listing->capacity = (listing->capacity == 0) ? 64 : listing->capacity * 2;
+    listing->files =
+        RL_REALLOC(listing->files, listing->capacity * sizeof(FileInfo));
+  }
+
+  unsigned int length = strlen(name) + 1;
+  if (listing->namesSize + length > listing->namesCapacity) {
+    unsigned int capacity =
+        (listing->namesCapacity == 0) ? 4096 : listing->namesCapacity;
+    while (listing->namesSize + length > capacity)
+      capacity *= 2;
+    listing->names = RL_REALLOC(listing->names, capacity);
+    listing->namesCapacity = capacity;
+  }
+  memcpy(listing->names + listing->namesSize, name, length);
+
+  FileInfo *file = &listing->files[listing->count++];
+  file->name = NULL;
+  file->nameOffset = listing->namesSize;
+  listing->namesSize += length;
+  file->size = size;
+  file->modTime = modTime;
+  file->type = type;
+  // Looking at the extension waits until the entry is drawn
+  file->icon = 0;
+  file->stale = false;
 }
 
-// Compare two files from a directory
-static inline int FileCompare(const char *d1, const char *d2, const char *dir) {
-  const bool b1 = DirectoryExists(TextFormat("%s/%s", dir, d1));
-  const bool b2 = DirectoryExists(TextFormat("%s/%s", dir, d2));
+// Read a whole directory in a single pass, every entry is stat()ed exactly
+// once (on Windows the directory read itself returns all of it)
+static bool ScanDirectory(DirectoryListing *listing) {
+#if defined(_WIN32)
+  struct __finddata64_t data;
+  intptr_t handle = _findfirst64(TextFormat("%s\\*", listing->path), &data);
+  if (handle == -1)
+    return false;
+  do {
+    AddDirectoryEntry(listing, data.name,
+                      (data.attrib & _A_SUBDIR) ? FILE_TYPE_DIRECTORY
+                                                : FILE_TYPE_FILE,
+                      data.size, (long)data.time_write);
+  } while (_findnext64(handle, &data) == 0);
+  _findclose(handle);
+#else
+  DIR *dir = opendir(listing->path);
+  if (dir == NULL)
+    return false;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    struct stat info;
+    if (fstatat(dirfd(dir), entry->d_name, &info, 0) != 0)
+      continue;
+    AddDirectoryEntry(listing, entry->d_name,
+                      S_ISDIR(info.st_mode) ? FILE_TYPE_DIRECTORY
+                                            : FILE_TYPE_FILE,
+                      info.st_size, (long)info.st_mtime);
+  }
+  closedir(dir);
+#endif
+  return true;
+}
 
-  if (b1 && !b2)
-    return -1;
-  if (!b1 && b2)
-    return 1;
+// Compare two files from a directory, directories go first
+static int FileCompare(const void *a, const void *b) {
+  const FileInfo *f1 = (const FileInfo *)a;
+  const FileInfo *f2 = (const FileInfo *)b;
 
-  if (!FileExists(TextFormat("%s/%s", dir, d1)))
-    return 1;
-  if (!FileExists(TextFormat("%s/%s", dir, d2)))
-    return -1;
+  if (f1->type != f2->type)
+    return (f1->type == FILE_TYPE_DIRECTORY) ? -1 : 1;
+
+  return strcmp(f1->name, f2->name);
+}
 
-  return strcmp(d1, d2);
+static void UnloadDirectoryListing(DirectoryListing *listing) {
+  RL_FREE(listing->files);
+  RL_FREE(listing->names);
+  RL_FREE(listing->lowerNames);
+  RL_FREE(listing->charMasks);
+  memset(listing, 0, sizeof(DirectoryListing));
+}
+
+// Get the listing of a directory, from the cache while the directory's
+// modification time didn't change since it was scanned. The entries of a
+// cached listing are only as old as their last stat(), they get marked to be
+// read again when they're drawn
+static DirectoryListing *LoadDirectoryListing(const char *path,
+                                              const char *filter) {
+  long modTime = GetFileModTime(path);
+  DirectoryListing *listing = NULL;
+
+  for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+    DirectoryListing *cached = &directoryCache[i];
+    if ((cached->files != NULL) && (strcmp(cached->path, path) == 0) &&
+        (strcmp(cached->filter, filter) == 0)) {
+      // Modification times only have a resolution of a second, a change
+      // made in the second the directory was scanned wouldn't show
+      if ((cached->modTime == modTime) && (modTime < cached->scanTime)) {
+        cached->lastUsed = ++directoryCacheClock;
+        for (int j = 0; j < cached->count; j++)
+          cached->files[j].stale = true;
+        return cached;
+      }
+      listing = cached;
+      break;
+    }
+  }
+
+  // Reuse the least recently used slot
+  if (listing == NULL) {
+    listing = &directoryCache[0];
+    for (int i = 1; i < DIRECTORY_CACHE_SIZE; i++) {
+      if (directoryCache[i].lastUsed < listing->lastUsed)
+        listing = &directoryCache[i];
+    }
+  }
+  UnloadDirectoryListing(listing);
+
+  strncpy(listing->path, path, sizeof(listing->path) - 1);
+  strncpy(listing->filter, filter, sizeof(listing->filter) - 1);
+  listing->modTime = modTime;
+  listing->scanTime = (long)time(NULL);
+  listing->lastUsed = ++directoryCacheClock;
+  listing->serial = ++directorySerial;
+  // A directory that can't be read is just empty
+  ScanDirectory(listing);
+
+  // The pool doesn't move anymore, point into it
+  for (int i = 0; i < listing->count; i++)
+    listing->files[i].name = listing->names + listing->files[i].nameOffset;
+
+  // Sort on the metadata read during the scan, no file system access
+  qsort(listing->files, listing->count, sizeof(FileInfo), FileCompare);
+  return listing;
+}
+
+// A file can be rewritten in place without its directory changing, a
+// listing from the cache reads what it shows again
+static void RefreshFileInfo(const char *dirPath, FileInfo *file) {
+  if (!file->stale)
+    return;
+  file->stale = false;
+  const char *path = TextFormat("%s" PATH_SEPERATOR "%s", dirPath, file->name);
+#if defined(_WIN32)
+  struct __stat64 info;
+  if (_stat64(path, &info) != 0)
+    return;
+#else
+  struct stat info;
+  if (stat(path, &info) != 0)
+    return;
+#endif
+  file->size = info.st_size;
+  file->modTime = (long)info.st_mtime;
 }
 
 // Read files in new path
 static void ReloadDirectoryFiles(GuiWindowFileDialogState *state) {
-  UnloadDirectoryFiles(state->dirFiles);
-
-  state->dirFiles = LoadDirectoryFilesEx(
-      state->dirPathText,
-      (state->filterExt[0] == '\0') ? NULL : state->filterExt, false);
+  state->dirFiles = LoadDirectoryListing(state->dirPathText, state->filterExt);
   state->itemFocused = 0;
+  state->filesListScrollIndex = 0;
+  // A search is about the directory it was typed in
+  state->searchText[0] = '\0';
+  state->searchEditMode = false;
+}
 
-  // Reset dirFilesIcon memory
-  for (int i = 0; i < MAX_DIRECTORY_FILES; i++)
-    memset(dirFilesIcon[i], 0, MAX_ICON_PATH_LENGTH);
-
-  // Copy paths as icon + fileNames into dirFilesIcon
-  for (int i = 0; i < state->dirFiles.count; i++) {
-    if (IsPathFile(state->dirFiles.paths[i])) {
-      // Path is a file, a file icon for convenience (for some recognized
-      // extensions)
-      if (IsFileExtension(state->dirFiles.paths[i],
-                          ".png;.bmp;.tga;.gif;.jpg;.jpeg;.psd;.hdr;.qoi;.dds;."
-                          "pkm;.ktx;.pvr;.astc")) {
-        strcpy(dirFilesIcon[i],
-               TextFormat("#12#%s", GetFileName(state->dirFiles.paths[i])));
-      } else if (IsFileExtension(
-                     state->dirFiles.paths[i],
-                     ".wav;.mp3;.ogg;.flac;.xm;.mod;.it;.wma;.aiff")) {
-        strcpy(dirFilesIcon[i],
-               TextFormat("#11#%s", GetFileName(state->dirFiles.paths[i])));
-      } else if (IsFileExtension(state->dirFiles.paths[i],
-                                 ".txt;.info;.md;.nfo;.xml;.json;.c;.cpp;.cs;."
-                                 "lua;.py;.glsl;.vs;.fs")) {
-        strcpy(dirFilesIcon[i],
-               TextFormat("#10#%s", GetFileName(state->dirFiles.paths[i])));
-      } else if (IsFileExtension(state->dirFiles.paths[i],
-                                 ".exe;.bin;.raw;.msi")) {
-        strcpy(dirFilesIcon[i],
-               TextFormat("#200#%s", GetFileName(state->dirFiles.paths[i])));
-      } else
-        strcpy(dirFilesIcon[i],
-               TextFormat("#218#%s", GetFileName(state->dirFiles.paths[i])));
-    } else {
-      // Path is a directory, add a directory icon
-      strcpy(dirFilesIcon[i],
-             TextFormat("#1#%s", GetFileName(state->dirFiles.paths[i])));
-    }
+// Lowercase ASCII letters, file names are searched without case
+static char LowerChar(char c) {
+  return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+// A bit for every letter and digit in a lowercase text, everything else
+// shares the bits left. A name can only match a search when it has every
+// bit of it
+static unsigned long long CharacterMask(const char *text) {
+  unsigned long long mask = 0;
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+    int bit = 0;
+    if ((*c >= 'a') && (*c <= 'z'))
+      bit = *c - 'a';
+    else if ((*c >= '0') && (*c <= '9'))
+      bit = 26 + *c - '0';
+    else
+      bit = 36 + *c % 28;
+    mask |= 1ull << bit;
   }
+  return mask;
 }
 
-#if defined(USE_CUSTOM_LISTVIEW_FILEINFO)
-// List View control for files info with extended parameters
-static int GuiListViewFiles(Rectangle bounds, FileInfo *files, int count,
-                            int *focus, int *scrollIndex, int *active) {
+// Search index of a listing, built once and kept for as long as the listing
+static void BuildSearchIndex(DirectoryListing *listing) {
+  if ((listing->charMasks != NULL) || (listing->count == 0))
+    return;
+
+  listing->lowerNames = RL_MALLOC(listing->namesSize);
+  for (unsigned int i = 0; i < listing->namesSize; i++)
+    listing->lowerNames[i] = LowerChar(listing->names[i]);
+
+  listing->charMasks =
+      RL_MALLOC(listing->count * sizeof(unsigned long long));
+  for (int i = 0; i < listing->count; i++)
+    listing->charMasks[i] =
+        CharacterMask(listing->lowerNames + listing->files[i].nameOffset);
+}
+
+// Score of a file name for a lowercase query, -1 when the letters of the
+// query aren't all in the name in that order. Letters right after each other
+// and letters starting the name or a word in it count more, so "ps" puts
+// "photo_small.png" before "lapse.png"
+static int SearchScore(const char *query, const char *lowerName,
+                       const char *name) {
+  int score = 0;
+  int previous = -2;
+  int position = 0;
+
+  for (const char *q = query; *q != '\0'; q++) {
+    while ((lowerName[position] != '\0') && (lowerName[position] != *q))
+      position++;
+    if (lowerName[position] == '\0')
+      return -1;
+
+    score += 1;
+    if (position == previous + 1)
+      score += 4;
+    if (position == 0)
+      score += 8;
+    else if ((strchr(" _-.", name[position - 1]) != NULL) ||
+             ((name[position] >= 'A') && (name[position] <= 'Z') &&
+              (name[position - 1] >= 'a') && (name[position - 1] <= 'z')))
+      score += 4;
+
+    previous = position++;
+  }
+  return score;
+}
+
+// Best score first, the listing order (directories first, by name) after
+static int FileMatchCompare(const void *a, const void *b) {
+  const FileMatch *m1 = (const FileMatch *)a;
+  const FileMatch *m2 = (const FileMatch *)b;
+
+  if (m1->score != m2->score)
+    return (m1->score > m2->score) ? -1 : 1;
+
+  return m1->index - m2->index;
+}
+
+// Match the search text against the current listing, if anything changed.
+// When the text just got longer only the last matches can still match, and
+// only those are looked at again
+static void UpdateFileSearch(GuiWindowFileDialogState *state) {
+  FileSearch *search = &state->search;
+  DirectoryListing *listing = state->dirFiles;
+
+  char query[sizeof(search->query)];
+  int length = 0;
+  for (; state->searchText[length] != '\0'; length++)
+    query[length] = LowerChar(state->searchText[length]);
+  query[length] = '\0';
+
+  bool sameListing = (search->listingSerial == listing->serial);
+  if (sameListing && (strcmp(search->query, query) == 0))
+    return;
+
+  // The list changes under the selection
+  state->filesListActive = -1;
+  state->prevFilesListActive = -1;
+  state->filesListScrollIndex = 0;
+  state->itemFocused = -1;
+
+  bool refine = sameListing && (search->query[0] != '\0') &&
+                (strncmp(query, search->query, strlen(search->query)) == 0);
+  strcpy(search->query, query);
+  search->listingSerial = listing->serial;
+  if (query[0] == '\0') {
+    search->count = 0;
+    return;
+  }
+
+  BuildSearchIndex(listing);
+  if (search->capacity < listing->count) {
+    search->capacity = listing->count;
+    search->matches =
+        RL_REALLOC(search->matches, search->capacity * sizeof(FileMatch));
+    search->files =
+        RL_REALLOC(search->files, search->capacity * sizeof(FileInfo));
+  }
+
+  unsigned long long queryMask = CharacterMask(query);
+  int candidates = refine ? search->count : listing->count;
+  int count = 0;
+  for (int i = 0; i < candidates; i++) {
+    int index = refine ? search->matches[i].index : i;
+    if ((queryMask & ~listing->charMasks[index]) != 0)
+      continue;
+
+    const FileInfo *file = &listing->files[index];
+    int score = SearchScore(query, listing->lowerNames + file->nameOffset,
+                            file->name);
+    if (score >= 0)
+      search->matches[count++] = (FileMatch){index, score};
+  }
+
+  qsort(search->matches, count, sizeof(FileMatch), FileMatchCompare);
+  for (int i = 0; i < count; i++)
+    search->files[i] = listing->files[search->matches[i].index];
+  search->count = count;
+}
+
+// Files the list shows, the search results while there is a search
+static FileInfo *GetShownFiles(GuiWindowFileDialogState *state, int *count) {
+  if (state->search.query[0] == '\0') {
+    *count = state->dirFiles->count;
+    return state->dirFiles->files;
+  }
+  *count = state->search.count;
+  return state->search.files;
+}
+
+// List View control for files info, only the visible rows are looked at so
+// it costs the same for ten files or a hundred thousand
+static int GuiListViewFiles(Rectangle bounds, const char *dirPath,
+                            FileInfo *files, int count, int *focus,
+                            int *scrollIndex, int *active) {
   int result = 0;
   GuiState state = guiState;
   int itemFocused = (focus == NULL) ? -1 : *focus;
   int itemSelected = *active;
+  const int itemStep = GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT) +
+                       GuiGetStyle(LISTVIEW, LIST_ITEMS_SPACING);
 
   // Check if we need a scroll bar
   bool useScrollBar = false;
-  if ((GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT) +
-       GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING)) *
-          count >
-      bounds.height)
+  if ((float)itemStep * count > bounds.height)
     useScrollBar = true;
 
   // Define base item rectangle [0]
   Rectangle itemBounds = {0};
-  itemBounds.x = bounds.x + GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING);
-  itemBounds.y = bounds.y + GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING) +
+  itemBounds.x = bounds.x + GuiGetStyle(LISTVIEW, LIST_ITEMS_SPACING);
+  itemBounds.y = bounds.y + GuiGetStyle(LISTVIEW, LIST_ITEMS_SPACING) +
                  GuiGetStyle(DEFAULT, BORDER_WIDTH);
   itemBounds.width = bounds.width -
-                     2 * GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING) -
+                     2 * GuiGetStyle(LISTVIEW, LIST_ITEMS_SPACING) -
                      GuiGetStyle(DEFAULT, BORDER_WIDTH);
   itemBounds.height = GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT);
   if (useScrollBar)
     itemBounds.width -= GuiGetStyle(LISTVIEW, SCROLLBAR_WIDTH);
 
   // Get items on the list
-  int visibleItems =
-      bounds.height / (GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT) +
-                       GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING));
+  int visibleItems = bounds.height / itemStep;
   if (visibleItems > count)
     visibleItems = count;
 
   int startIndex = (scrollIndex == NULL) ? 0 : *scrollIndex;
-  if ((startIndex < 0) || (startIndex > (count - visibleItems)))
+  if (startIndex > (count - visibleItems))
+    startIndex = count - visibleItems;
+  if (startIndex < 0)
     startIndex = 0;
-  int endIndex = startIndex + visibleItems;
 
   // Update control
   //--------------------------------------------------------------------
-  if ((state != GUI_STATE_DISABLED) && !guiLocked) {
+  if ((state != STATE_DISABLED) && !guiLocked && !guiSliderDragging) {
     Vector2 mousePoint = GetMousePosition();
 
     // Check mouse inside list view
     if (CheckCollisionPointRec(mousePoint, bounds)) {
-      state = GUI_STATE_FOCUSED;
-
-      // Check focused and selected item
-      for (int i = 0; i < visibleItems; i++) {
-        if (CheckCollisionPointRec(mousePoint, itemBounds)) {
-          itemFocused = startIndex + i;
-          if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
-            itemSelected = startIndex + i;
-          break;
-        }
-
-        // Update item rectangle y position for next item
-        itemBounds.y += (GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT) +
-                         GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING));
+      state = STATE_FOCUSED;
+
+      // Check focused and selected item, straight from the mouse position
+      int row = (mousePoint.y - itemBounds.y) / itemStep;
+      if ((mousePoint.y >= itemBounds.y) && (row < visibleItems) &&
+          (mousePoint.x >= itemBounds.x) &&
+          (mousePoint.x < itemBounds.x + itemBounds.width)) {
+        itemFocused = startIndex + row;
+        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
+          itemSelected = startIndex + row;
       }
 
       if (useScrollBar) {
+        // A few rows per wheel step, one at a time is too slow for big
+        // directories
         int wheelMove = GetMouseWheelMove();
-        startIndex -= wheelMove;
+        startIndex -= wheelMove * 3;
 
         if (startIndex < 0)
           startIndex = 0;
         else if (startIndex > (count - visibleItems))
           startIndex = count - visibleItems;
-
-        endIndex = startIndex + visibleItems;
-        if (endIndex > count)
-          endIndex = count;
       }
     } else
       itemFocused = -1;
-
-    // Reset item rectangle y to [0]
-    itemBounds.y = bounds.y + GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING) +
-                   GuiGetStyle(DEFAULT, BORDER_WIDTH);
   }
   //--------------------------------------------------------------------
 
   // Draw control
   //--------------------------------------------------------------------
-  DrawRectangleRec(bounds, GetColor(GuiGetStyle(
-                               DEFAULT, BACKGROUND_COLOR))); // Draw background
-  DrawRectangleLinesEx(
-      bounds, GuiGetStyle(DEFAULT, BORDER_WIDTH),
-      Fade(GetColor(GuiGetStyle(LISTVIEW, BORDER + state * 3)), guiAlpha));
-
-  // TODO: Draw list view header with file sections: icon+name | size | type |
-  // modTime
+  GuiDrawRectangle(bounds, GuiGetStyle(DEFAULT, BORDER_WIDTH),
+                   GetColor(GuiGetStyle(LISTVIEW, BORDER + state * 3)),
+                   GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
 
-  // Draw visible items
+  // Draw visible items, their icon and label are worked out only now
   for (int i = 0; i < visibleItems; i++) {
-    if (state == GUI_STATE_DISABLED) {
-      if ((startIndex + i) == itemSelected) {
-        DrawRectangleRec(
-            itemBounds,
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_DISABLED)),
-                 guiAlpha));
-        DrawRectangleLinesEx(
+    FileInfo *file = &files[startIndex + i];
+    RefreshFileInfo(dirPath, file);
+    if (file->icon == 0)
+      file->icon = GetFileIcon(file->name, file->type);
+    const char *label = TextFormat("#%i#%s", file->icon, file->name);
+    Rectangle textBounds = GetTextBounds(DEFAULT, itemBounds);
+    int alignment = GuiGetStyle(LISTVIEW, TEXT_ALIGNMENT);
+
+    if (state == STATE_DISABLED) {
+      if ((startIndex + i) == itemSelected)
+        GuiDrawRectangle(
             itemBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_DISABLED)),
-                 guiAlpha));
-      }
-
-      // TODO: Draw full file info line: icon+name | size | type | modTime
-
-      GuiDrawText(
-          files[startIndex + i].name, GetTextBounds(DEFAULT, itemBounds),
-          GuiGetStyle(LISTVIEW, TEXT_ALIGNMENT),
-          Fade(GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_DISABLED)), guiAlpha));
+            GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_DISABLED)),
+            GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_DISABLED)));
+
+      GuiDrawText(label, textBounds, alignment,
+                  GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_DISABLED)));
+    } else if ((startIndex + i) == itemSelected) {
+      // Draw item selected
+      GuiDrawRectangle(itemBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
+                       GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_PRESSED)),
+                       GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_PRESSED)));
+      GuiDrawText(label, textBounds, alignment,
+                  GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_PRESSED)));
+    } else if ((startIndex + i) == itemFocused) {
+      // Draw item focused
+      GuiDrawRectangle(itemBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
+                       GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_FOCUSED)),
+                       GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_FOCUSED)));
+      GuiDrawText(label, textBounds, alignment,
+                  GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_FOCUSED)));
     } else {
-      if ((startIndex + i) == itemSelected) {
-        // Draw item selected
-        DrawRectangleRec(
-            itemBounds,
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_PRESSED)),
-                 guiAlpha));
-        DrawRectangleLinesEx(
-            itemBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_PRESSED)),
-                 guiAlpha));
-
-        GuiDrawText(files[startIndex + i].name,
-                    GetTextBounds(DEFAULT, itemBounds),
-                    GuiGetStyle(LISTVIEW, TEXT_ALIGNMENT),
-                    Fade(GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_PRESSED)),
-                         guiAlpha));
-      } else if ((startIndex + i) == itemFocused) {
-        // Draw item focused
-        DrawRectangleRec(
-            itemBounds,
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_FOCUSED)),
-                 guiAlpha));
-        DrawRectangleLinesEx(
-            itemBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
-            Fade(GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_FOCUSED)),
-                 guiAlpha));
-
-        GuiDrawText(files[startIndex + i].name,
-                    GetTextBounds(DEFAULT, itemBounds),
-                    GuiGetStyle(LISTVIEW, TEXT_ALIGNMENT),
-                    Fade(GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_FOCUSED)),
-                         guiAlpha));
-      } else {
-        // Draw item normal
-        GuiDrawText(
-            files[startIndex + i].name, GetTextBounds(DEFAULT, itemBounds),
-            GuiGetStyle(LISTVIEW, TEXT_ALIGNMENT),
-            Fade(GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_NORMAL)), guiAlpha));
-      }
+      // Draw item normal
+      GuiDrawText(label, textBounds, alignment,
+                  GetColor(GuiGetStyle(LISTVIEW, TEXT_COLOR_NORMAL)));
     }
 
     // Update item rectangle y position for next item
-    itemBounds.y += (GuiGetStyle(LISTVIEW, LIST_ITEMS_HEIGHT) +
-                     GuiGetStyle(LISTVIEW, LIST_ITEMS_PADDING));
+    itemBounds.y += itemStep;
   }
 
   if (useScrollBar) {
@@ -703,24 +1063,27 @@ static int GuiListViewFiles(Rectangle bounds, FileInfo *files, int count,
         bounds.height - 2 * GuiGetStyle(DEFAULT, BORDER_WIDTH)};
 
     // Calculate percentage of visible items and apply same percentage to
-    // scrollbar
-    float percentVisible = (float)(endIndex - startIndex) / count;
+    // scrollbar, but keep the slider big enough to grab
+    float percentVisible = (float)visibleItems / count;
     float sliderSize = bounds.height * percentVisible;
+    if (sliderSize < 16)
+      sliderSize = 16;
 
     int prevSliderSize =
-        GuiGetStyle(SCROLLBAR, SLIDER_WIDTH); // Save default slider size
+        GuiGetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE); // Save default slider size
     int prevScrollSpeed =
         GuiGetStyle(SCROLLBAR, SCROLL_SPEED); // Save default scroll speed
-    GuiSetStyle(SCROLLBAR, SLIDER_WIDTH, sliderSize); // Change slider size
+    GuiSetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE,
+                sliderSize); // Change slider size
     GuiSetStyle(SCROLLBAR, SCROLL_SPEED,
-                count - visibleItems); // Change scroll speed
+                count - visibleItems); // One item per arrow click
 
     startIndex =
         GuiScrollBar(scrollBarBounds, startIndex, 0, count - visibleItems);
 
     GuiSetStyle(SCROLLBAR, SCROLL_SPEED,
                 prevScrollSpeed); // Reset scroll speed to default
-    GuiSetStyle(SCROLLBAR, SLIDER_WIDTH,
+    GuiSetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE,
                 prevSliderSize); // Reset slider size to default
   }
   //--------------------------------------------------------------------
@@ -733,6 +1096,210 @@ static int GuiListViewFiles(Rectangle bounds, FileInfo *files, int count,
   *active = itemSelected;
   return result;
 }
-#endif // USE_CUSTOM_LISTVIEW_FILEINFO
+
+// Grid View control for files info, images show their thumbnail and the rest
+// their icon. Like the list only the visible cells are looked at
+static int GuiGridViewFiles(Rectangle bounds, const char *dirPath,
+                            FileInfo *files, int count, int *focus,
+                            int *scrollIndex, int *active,
+                            ThumbnailCache *thumbnails) {
+  int result = 0;
+  GuiState state = guiState;
+  int itemFocused = (focus == NULL) ? -1 : *focus;
+  int itemSelected = *active;
+  const int borderWidth = GuiGetStyle(DEFAULT, BORDER_WIDTH);
+  const int spacing = GuiGetStyle(LISTVIEW, LIST_ITEMS_SPACING);
+
+  // Cells are a thumbnail with the name below, as many as fit side by side
+  Rectangle area = {bounds.x + borderWidth + spacing,
+                    bounds.y + borderWidth + spacing,
+                    bounds.width - 2 * (borderWidth + spacing),
+                    bounds.height - 2 * (borderWidth + spacing)};
+  const int cellHeight =
+      GRID_THUMBNAIL_SIZE + 8 + GuiGetStyle(DEFAULT, TEXT_SIZE) + 8;
+  int visibleRows = area.height / cellHeight;
+  if (visibleRows < 1)
+    visibleRows = 1;
+
+  // Check if we need a scroll bar
+  int columns = area.width / (GRID_THUMBNAIL_SIZE + 8);
+  if (columns < 1)
+    columns = 1;
+  bool useScrollBar = false;
+  if ((count + columns - 1) / columns > visibleRows) {
+    useScrollBar = true;
+    area.width -= GuiGetStyle(LISTVIEW, SCROLLBAR_WIDTH);
+    columns = area.width / (GRID_THUMBNAIL_SIZE + 8);
+    if (columns < 1)
+      columns = 1;
+  }
+  const float cellWidth = area.width / columns;
+  const int rows = (count + columns - 1) / columns;
+
+  // The scroll index is a file, the grid starts at the row it's in
+  int startRow = (scrollIndex == NULL) ? 0 : *scrollIndex / columns;
+  if (startRow > (rows - visibleRows))
+    startRow = rows - visibleRows;
+  if (startRow < 0)
+    startRow = 0;
+
+  // Update control
+  //--------------------------------------------------------------------
+  if ((state != STATE_DISABLED) && !guiLocked && !guiSliderDragging) {
+    Vector2 mousePoint = GetMousePosition();
+
+    // Check mouse inside grid view
+    if (CheckCollisionPointRec(mousePoint, bounds)) {
+      state = STATE_FOCUSED;
+
+      // Check focused and selected item, straight from the mouse position
+      if (CheckCollisionPointRec(mousePoint, area)) {
+        int column = (mousePoint.x - area.x) / cellWidth;
+        int index = (startRow + (int)((mousePoint.y - area.y) / cellHeight)) *
+                        columns +
+                    column;
+        if ((column < columns) && (index < count)) {
+          itemFocused = index;
+          if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
+            itemSelected = index;
+        }
+      }
+
+      if (useScrollBar) {
+        startRow -= (int)GetMouseWheelMove();
+
+        if (startRow < 0)
+          startRow = 0;
+        else if (startRow > (rows - visibleRows))
+          startRow = rows - visibleRows;
+      }
+    } else
+      itemFocused = -1;
+  }
+  //--------------------------------------------------------------------
+
+  // Draw control
+  //--------------------------------------------------------------------
+  GuiDrawRectangle(bounds, borderWidth,
+                   GetColor(GuiGetStyle(LISTVIEW, BORDER + state * 3)),
+                   GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
+
+  // Draw visible cells, a row that is cut off at the bottom too
+  BeginScissorMode(area.x, area.y, area.width, area.height);
+  for (int i = startRow * columns;
+       (i < count) && (i < (startRow + visibleRows + 1) * columns); i++) {
+    FileInfo *file = &files[i];
+    // The thumbnail is looked up by size and modification time
+    RefreshFileInfo(dirPath, file);
+    Rectangle cellBounds = {
+        area.x + (i % columns) * cellWidth,
+        area.y + (i / columns - startRow) * cellHeight, cellWidth - spacing,
+        cellHeight - spacing};
+
+    int textProperty = TEXT_COLOR_NORMAL;
+    if (state == STATE_DISABLED)
+      textProperty = TEXT_COLOR_DISABLED;
+    else if (i == itemSelected) {
+      // Draw item selected
+      GuiDrawRectangle(cellBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
+                       GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_PRESSED)),
+                       GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_PRESSED)));
+      textProperty = TEXT_COLOR_PRESSED;
+    } else if (i == itemFocused) {
+      // Draw item focused
+      GuiDrawRectangle(cellBounds, GuiGetStyle(LISTVIEW, BORDER_WIDTH),
+                       GetColor(GuiGetStyle(LISTVIEW, BORDER_COLOR_FOCUSED)),
+                       GetColor(GuiGetStyle(LISTVIEW, BASE_COLOR_FOCUSED)));
+      textProperty = TEXT_COLOR_FOCUSED;
+    }
+    Color textColor = GetColor(GuiGetStyle(LISTVIEW, textProperty));
+
+    // Thumbnails are asked for every frame a cell is drawn, that keeps the
+    // ones on screen in the cache and decoded first
+    Texture2D texture = {0};
+    if ((thumbnails != NULL) && (file->type == FILE_TYPE_FILE) &&
+        thumbnail_cache_supports(file->name))
+      texture = thumbnail_cache_get(
+          thumbnails,
+          TextFormat("%s/%s", (strcmp(dirPath, "/") == 0) ? "" : dirPath,
+                     file->name),
+          file->modTime, file->size);
+
+    Vector2 center = {cellBounds.x + cellBounds.width / 2,
+                      cellBounds.y + 4 + GRID_THUMBNAIL_SIZE / 2};
+    if (texture.id != 0) {
+      // Small images aren't blown up
+      float scale = (float)GRID_THUMBNAIL_SIZE /
+                    ((texture.width > texture.height) ? texture.width
+                                                      : texture.height);
+      if (scale > 1)
+        scale = 1;
+      DrawTexturePro(texture,
+                     (Rectangle){0, 0, texture.width, texture.height},
+                     (Rectangle){center.x - texture.width * scale / 2,
+                                 center.y - texture.height * scale / 2,
+                                 texture.width * scale, texture.height * scale},
+                     (Vector2){0, 0}, 0, Fade(WHITE, guiAlpha));
+    } else {
+      // Still decoding, or not an image
+      if (file->icon == 0)
+        file->icon = GetFileIcon(file->name, file->type);
+      GuiDrawIcon(file->icon, center.x - RAYGUI_ICON_SIZE * 3 / 2,
+                  center.y - RAYGUI_ICON_SIZE * 3 / 2, 3,
+                  Fade(textColor, guiAlpha));
+    }
+
+    // Names that don't fit are cut at the right
+    Rectangle textBounds = {cellBounds.x + 4,
+                            cellBounds.y + 8 + GRID_THUMBNAIL_SIZE,
+                            cellBounds.width - 8,
+                            GuiGetStyle(DEFAULT, TEXT_SIZE) + 8};
+    GuiDrawText(file->name, textBounds,
+                (GetTextWidth(file->name) <= textBounds.width)
+                    ? TEXT_ALIGN_CENTER
+                    : TEXT_ALIGN_LEFT,
+                textColor);
+  }
+  EndScissorMode();
+
+  if (useScrollBar) {
+    Rectangle scrollBarBounds = {
+        bounds.x + bounds.width - GuiGetStyle(LISTVIEW, BORDER_WIDTH) -
+            GuiGetStyle(LISTVIEW, SCROLLBAR_WIDTH),
+        bounds.y + GuiGetStyle(LISTVIEW, BORDER_WIDTH),
+        (float)GuiGetStyle(LISTVIEW, SCROLLBAR_WIDTH),
+        bounds.height - 2 * GuiGetStyle(DEFAULT, BORDER_WIDTH)};
+
+    // Same as the list, with rows instead of items
+    float sliderSize = bounds.height * visibleRows / rows;
+    if (sliderSize < 16)
+      sliderSize = 16;
+
+    int prevSliderSize =
+        GuiGetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE); // Save default slider size
+    int prevScrollSpeed =
+        GuiGetStyle(SCROLLBAR, SCROLL_SPEED); // Save default scroll speed
+    GuiSetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE,
+                sliderSize); // Change slider size
+    GuiSetStyle(SCROLLBAR, SCROLL_SPEED,
+                rows - visibleRows); // One row per arrow click
+
+    startRow = GuiScrollBar(scrollBarBounds, startRow, 0, rows - visibleRows);
+
+    GuiSetStyle(SCROLLBAR, SCROLL_SPEED,
+                prevScrollSpeed); // Reset scroll speed to default
+    GuiSetStyle(SCROLLBAR, SCROLL_SLIDER_SIZE,
+                prevSliderSize); // Reset slider size to default
+  }
+  //--------------------------------------------------------------------
+
+  if (focus != NULL)
+    *focus = itemFocused;
+  if (scrollIndex != NULL)
+    *scrollIndex = startRow * columns;
+
+  *active = itemSelected;
+  return result;
+}
 
 #endif // GUI_FILE_DIALOG_IMPLEMENTATION
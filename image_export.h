@@ -0,0 +1,224 @@
+/*
+ * image_export.h - saves the edited image on a background thread
+ *
+ * usage:
+ *   #define IMAGE_EXPORT_IMPLEMENTATION
+ *   #include "image_export.h"
+ *
+ *   ImageExport *job = image_export_start(&source, params, "out.png");
+ *   ...
+ *   if (image_export_done(job))
+ *     bool ok = image_export_finish(job);
+ *
+ * the edits are run on the full resolution source a strip of rows at a time
+ * (pipeline_render_rows()) and every strip goes straight into a streaming
+ * encoder, png_writer.h or jpeg_writer.h depending on the extension. so only
+ * a strip and the encoder's batch are ever in memory, never a second copy of
+ * the whole image, and both the render and the encoder use every core.
+ *
+ * the file is written next to the target as <path>.tmp and only renamed over
+ * it once the encoder closed cleanly, so a failed export leaves an earlier
+ * one alone instead of a truncated file in its place.
+ *
+ * the export keeps its own reference to the source tiles and its own copy of
+ * the texts, the editor can go on changing both while it runs.
+ * image_export_write() does the same work on the calling thread, for callers
+ * that already have threads of their own (batch mode).
+ */
+
+#include "raylib.h"
+
+#ifndef IMAGE_EXPORT_H
+#define IMAGE_EXPORT_H
+
+#include "image_pipeline.h"
+#include "tiled_image.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+typedef struct ImageExport ImageExport;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// .jpg and .jpeg are saved as jpeg, everything else as png. never NULL, a
+// file that can't be written shows up in image_export_finish()
+ImageExport *image_export_start(const TiledImage *source, EditParams params,
+                                const char *path);
+// 0 to 1
+float image_export_progress(ImageExport *job);
+bool image_export_done(ImageExport *job);
+// waits for the export to end and frees it, true if the file got written
+bool image_export_finish(ImageExport *job);
+// renders and saves on the calling thread. progress, in thousandths, may be
+// NULL
+bool image_export_write(const TiledImage *source, EditParams params,
+                        const char *path, atomic_int *progress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGE_EXPORT_H
+
+/*
+ * IMAGE_EXPORT IMPLEMENTATION
+ */
+#if defined(IMAGE_EXPORT_IMPLEMENTATION)
+
+#include "jpeg_writer.h"
+#include "png_writer.h"
+#include "profiler.h"
+
+#include <ctype.h> // Required for: tolower()
+#include <pthread.h>
+#include <stdio.h>  // Required for: rename(), remove()
+#include <stdlib.h> // Required for: malloc(), calloc(), free()
+#include <string.h> // Required for: strdup(), strrchr(), strlen(), memcpy()
+
+// pixels rendered per strip, tall enough that the rows the blur reads above
+// and below every strip are a small part of it
+#define EXPORT_STRIP_PIXELS (4 << 20)
+#define EXPORT_JPEG_QUALITY 90
+
+struct ImageExport {
+  pthread_t thread;
+  TiledImage source;
+  EditParams params;
+  TextObject *texts;
+  char *path;
+
+  // progress in thousandths
+  atomic_int progress;
+  atomic_bool done;
+  bool started;
+  bool ok;
+};
+
+// IsFileExtension() lowercases into a static buffer, not something to call
+// from several threads at once
+static bool is_jpeg_path(const char *path) {
+  const char *dot = strrchr(path, '.');
+  if (dot == NULL)
+    return false;
+  char extension[6] = {0};
+  for (int i = 0; i < 5 && dot[i]; i++)
+    extension[i] = tolower((unsigned char)dot[i]);
+  return strcmp(extension, ".jpg") == 0 || strcmp(extension, ".jpeg") == 0;
+}
+
+bool image_export_write(const TiledImage *source, EditParams params,
+                        const char *path, atomic_int *progress) {
+  int width = source->width, height = source->height;
+  size_t length = strlen(path);
+  char *temporary = malloc(length + 5);
+  memcpy(temporary, path, length);
+  memcpy(temporary + length, ".tmp", 5);
+
+  PngWriter *png = NULL;
+  JpegWriter *jpeg = NULL;
+  if (is_jpeg_path(path))
+    jpeg = jpeg_writer_open(temporary, width, height, EXPORT_JPEG_QUALITY);
+  else
+    png = png_writer_open(temporary, width, height);
+  if (png == NULL && jpeg == NULL) {
+    free(temporary);
+    return false;
+  }
+
+  int strip_height = EXPORT_STRIP_PIXELS / width;
+  if (strip_height < 16)
+    strip_height = 16;
+  Color *strip = malloc((size_t)strip_height * width * sizeof(Color));
+
+  bool ok = true;
+  for (int y = 0; y < height && ok; y += strip_height) {
+    int rows = height - y < strip_height ? height - y : strip_height;
+    PROFILE_SCOPE(PROFILE_EXPORT_RENDER) {
+      pipeline_render_rows(source, params, y, y + rows, strip);
+    }
+    PROFILE_SCOPE(PROFILE_EXPORT_ENCODE) {
+      ok = jpeg ? jpeg_writer_write_rows(jpeg, strip, rows)
+                : png_writer_write_rows(png, strip, rows);
+    }
+    if (progress)
+      atomic_store(progress, (int)(1000LL * (y + rows) / height));
+  }
+  free(strip);
+
+  // closing also writes out the encoder's last batch, and fails on its own
+  // if some rows never arrived
+  bool closed;
+  PROFILE_SCOPE(PROFILE_EXPORT_ENCODE) {
+    closed = jpeg ? jpeg_writer_close(jpeg) : png_writer_close(png);
+  }
+  ok = ok && closed;
+#if defined(_WIN32)
+  // windows won't rename over an existing file
+  if (ok)
+    remove(path);
+#endif
+  ok = ok && rename(temporary, path) == 0;
+  if (!ok)
+    remove(temporary);
+  free(temporary);
+  return ok;
+}
+
+static void *image_export_main(void *arg) {
+  ImageExport *job = arg;
+  job->ok =
+      image_export_write(&job->source, job->params, job->path, &job->progress);
+  atomic_store(&job->done, true);
+  return NULL;
+}
+
+ImageExport *image_export_start(const TiledImage *source, EditParams params,
+                                const char *path) {
+  ImageExport *job = calloc(1, sizeof(ImageExport));
+  job->source = tiled_image_copy(source);
+  job->path = strdup(path);
+
+  if (params.text_count > 0) {
+    job->texts = malloc(params.text_count * sizeof(TextObject));
+    for (int i = 0; i < params.text_count; i++)
+      job->texts[i] = (TextObject){strdup(params.texts[i].text),
+                                   params.texts[i].position};
+  }
+  params.texts = job->texts;
+  job->params = params;
+
+  atomic_init(&job->progress, 0);
+  atomic_init(&job->done, false);
+  job->started =
+      pthread_create(&job->thread, NULL, image_export_main, job) == 0;
+  // without a thread there's nothing to wait for, finish() reports it failed
+  if (!job->started)
+    atomic_store(&job->done, true);
+  return job;
+}
+
+float image_export_progress(ImageExport *job) {
+  return atomic_load(&job->progress) / 1000.0f;
+}
+
+bool image_export_done(ImageExport *job) {
+  return atomic_load(&job->done);
+}
+
+bool image_export_finish(ImageExport *job) {
+  if (job->started)
+    pthread_join(job->thread, NULL);
+  bool ok = job->ok;
+  for (int i = 0; i < job->params.text_count; i++)
+    free(job->texts[i].text);
+  free(job->texts);
+  free(job->path);
+  tiled_image_free(&job->source);
+  free(job);
+  return ok;
+}
+
+#endif // IMAGE_EXPORT_IMPLEMENTATION
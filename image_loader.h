@@ -0,0 +1,518 @@
+/*
+ * image_loader.h - loads images on a background thread
+ *
+ * usage:
+ *   #define IMAGE_LOADER_IMPLEMENTATION
+ *   #include "image_loader.h"
+ *
+ * decoding a big jpeg takes long enough to freeze the window, so the loader
+ * does it on its own thread: the file is read in chunks (that part reports
+ * real progress), then decoded and cut into tiles. jpegs usually carry a
+ * small exif thumbnail, which is decoded and handed out first so there is
+ * something to look at right away. when that's smaller than the preview, the
+ * jpeg is also decoded at 1/2, 1/4 or 1/8 scale (see jpeg_scaled.h), which
+ * takes a fraction of the full decode and is handed out next.
+ *
+ * baseline jpegs are then decoded a few rows at a time straight into the
+ * tiles, so the full size image is never in memory in one piece, and one
+ * over the memory cap goes to a mapped cache file as it's decoded. anything
+ * else goes through raylib, which decodes the whole image into one buffer
+ * first. those are refused when they're over the cap, before the decode.
+ *
+ * starting a new load while one is running replaces it. the old one stops
+ * at the next chunk, or is thrown away once its decode is done.
+ */
+
+#include "raylib.h"
+
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include "jpeg_scaled.h"
+#include "tiled_image.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ImageLoader ImageLoader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ImageLoader *image_loader_create(void);
+void image_loader_destroy(ImageLoader *loader);
+
+// baseline jpegs over memory_cap bytes decoded end up in a mapped cache file,
+// see tiled_image_writer_open(), other images that big fail to load.
+// preview_size is how big the stand-ins shown during the load need to be
+void image_loader_start(ImageLoader *loader, const char *path,
+                        size_t memory_cap, Vector2 preview_size);
+// 0 to 1, only meaningful while busy
+float image_loader_progress(ImageLoader *loader);
+bool image_loader_busy(ImageLoader *loader);
+// the newest stand-in for the image being loaded, its embedded thumbnail or a
+// reduced scale decode. the caller owns it
+bool image_loader_take_thumbnail(ImageLoader *loader, Image *thumbnail);
+// the finished image, the caller owns it. if loading failed this still
+// returns true, with an image that has no tiles
+bool image_loader_take_result(ImageLoader *loader, TiledImage *image);
+
+// the decode image_loader_start() does, for a png or jpeg file already in
+// memory, without the progress or the stand-ins. file_type is the extension
+// with its dot. the image has no tiles if it failed or was too big
+TiledImage image_loader_decode(const unsigned char *data, int size,
+                               const char *file_type, size_t memory_cap);
+
+// offset and length of the exif thumbnail inside a jpeg file, if it has one
+bool jpeg_exif_thumbnail(const unsigned char *data, int size, int *offset,
+                         int *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGE_LOADER_H
+
+/*
+ * IMAGE_LOADER IMPLEMENTATION
+ */
+#if defined(IMAGE_LOADER_IMPLEMENTATION)
+
+#include "profiler.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>  // Required for: fopen(), fread(), fseek(), ftell()
+#include <stdlib.h> // Required for: calloc(), free()
+#include <string.h> // Required for: strdup(), memcmp()
+
+#define LOADER_CHUNK_SIZE (1 << 20)
+
+// how much of the progress bar each step gets
+#define LOADER_READ_SHARE 0.3f
+#define LOADER_DECODE_SHARE 0.5f
+
+struct ImageLoader {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool quit;
+
+  // newest request
+  char *pending_path;
+  size_t pending_cap;
+  Vector2 pending_preview_size;
+  bool loading;
+  // set when the load in flight got replaced
+  atomic_bool cancel;
+  // progress in thousandths
+  atomic_int progress;
+
+  Image thumbnail;
+  bool has_thumbnail;
+  TiledImage result;
+  bool has_result;
+};
+
+//------------------------------------------------------------------------------
+// exif thumbnail lookup
+//------------------------------------------------------------------------------
+static unsigned read_u16(const unsigned char *p, bool little) {
+  return little ? p[0] | p[1] << 8 : p[0] << 8 | p[1];
+}
+
+static unsigned read_u32(const unsigned char *p, bool little) {
+  return little ? read_u16(p, true) | read_u16(p + 2, true) << 16
+                : read_u16(p, false) << 16 | read_u16(p + 2, false);
+}
+
+// the thumbnail is a jpeg of its own, pointed to by ifd1 of the exif tiff
+// block in the app1 segment. everything is bounds checked, a broken exif
+// block just means no thumbnail
+static bool exif_thumbnail_in_tiff(const unsigned char *tiff, unsigned size,
+                                   int *offset, int *length) {
+  if (size < 8)
+    return false;
+  bool little = memcmp(tiff, "II", 2) == 0;
+  if (!little && memcmp(tiff, "MM", 2) != 0)
+    return false;
+
+  // skip ifd0 to get to ifd1
+  unsigned ifd = read_u32(tiff + 4, little);
+  if (ifd > size - 2)
+    return false;
+  unsigned entries = read_u16(tiff + ifd, little);
+  unsigned next = ifd + 2 + entries * 12;
+  if (next > size - 4)
+    return false;
+  ifd = read_u32(tiff + next, little);
+  if (ifd == 0 || ifd > size - 2)
+    return false;
+
+  entries = read_u16(tiff + ifd, little);
+  unsigned start = 0, bytes = 0;
+  for (unsigned i = 0; i < entries; i++) {
+    unsigned entry = ifd + 2 + i * 12;
+    if (entry > size - 12)
+      return false;
+    unsigned tag = read_u16(tiff + entry, little);
+    if (tag == 0x0201)
+      start = read_u32(tiff + entry + 8, little);
+    else if (tag == 0x0202)
+      bytes = read_u32(tiff + entry + 8, little);
+  }
+  if (bytes == 0 || start > size || bytes > size - start)
+    return false;
+  *offset = start;
+  *length = bytes;
+  return true;
+}
+
+bool jpeg_exif_thumbnail(const unsigned char *data, int size, int *offset,
+                         int *length) {
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    return false;
+
+  // walk the segments up to the start of the image data
+  int pos = 2;
+  while (pos + 4 <= size && data[pos] == 0xFF) {
+    int marker = data[pos + 1];
+    if (marker == 0xDA || marker == 0xD9)
+      break;
+    int segment = read_u16(data + pos + 2, false);
+    if (segment < 2 || pos + 2 + segment > size)
+      break;
+
+    const unsigned char *body = data + pos + 4;
+    if (marker == 0xE1 && segment >= 8 && memcmp(body, "Exif\0\0", 6) == 0) {
+      const unsigned char *tiff = body + 6;
+      if (exif_thumbnail_in_tiff(tiff, segment - 8, offset, length)) {
+        *offset += tiff - data;
+        return true;
+      }
+    }
+    pos += 2 + segment;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// loader thread
+//------------------------------------------------------------------------------
+static void set_progress(ImageLoader *loader, float progress) {
+  atomic_store(&loader->progress, (int)(progress * 1000));
+}
+
+static unsigned char *read_file_in_chunks(ImageLoader *loader,
+                                          const char *path, int *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (length <= 0) {
+    fclose(file);
+    return NULL;
+  }
+
+  unsigned char *data = RL_MALLOC(length);
+  long done = 0;
+  while (done < length && !atomic_load(&loader->cancel)) {
+    long chunk = length - done < LOADER_CHUNK_SIZE ? length - done
+                                                   : LOADER_CHUNK_SIZE;
+    if (fread(data + done, 1, chunk, file) != (size_t)chunk)
+      break;
+    done += chunk;
+    set_progress(loader, LOADER_READ_SHARE * done / length);
+  }
+  fclose(file);
+
+  if (done < length) {
+    RL_FREE(data);
+    return NULL;
+  }
+  *size = length;
+  return data;
+}
+
+// takes the thumbnail over. image_loader_start() sets cancel under the same
+// lock, so a load that got replaced after its decode can't put its thumbnail
+// over the new request's
+static void publish_thumbnail(ImageLoader *loader, Image thumbnail) {
+  pthread_mutex_lock(&loader->lock);
+  if (atomic_load(&loader->cancel)) {
+    pthread_mutex_unlock(&loader->lock);
+    UnloadImage(thumbnail);
+    return;
+  }
+  if (loader->has_thumbnail)
+    UnloadImage(loader->thumbnail);
+  loader->thumbnail = thumbnail;
+  loader->has_thumbnail = true;
+  pthread_mutex_unlock(&loader->lock);
+}
+
+static bool covers(Image image, Vector2 size) {
+  return image.width >= size.x && image.height >= size.y;
+}
+
+// the smallest jpeg scale that still covers the preview, 0 if that would be
+// full size anyway
+static int preview_scale(const unsigned char *data, int size,
+                         Vector2 preview_size) {
+  int width, height;
+  if (!jpeg_read_size(data, size, &width, &height))
+    return 0;
+  int scale = 8;
+  while (scale > 1 && ((width + scale - 1) / scale < preview_size.x ||
+                       (height + scale - 1) / scale < preview_size.y))
+    scale /= 2;
+  return scale > 1 ? scale : 0;
+}
+
+static bool png_read_size(const unsigned char *data, int size, int *width,
+                          int *height) {
+  if (size < 24 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0 ||
+      memcmp(data + 12, "IHDR", 4) != 0)
+    return false;
+  *width = read_u32(data + 16, false);
+  *height = read_u32(data + 20, false);
+  return true;
+}
+
+static bool over_cap(int width, int height, size_t memory_cap) {
+  if ((size_t)width * height * sizeof(Color) <= memory_cap)
+    return false;
+  TraceLog(LOG_WARNING, "DAISY: %dx%d image is over the memory cap", width,
+           height);
+  return true;
+}
+
+// where jpeg_decode_rows() puts the rows. the writer is only opened with the
+// first of them, a jpeg the decoder doesn't handle fails before that
+typedef struct {
+  TiledImageWriter *writer;
+  int width, height;
+  size_t memory_cap;
+  // NULL when there is nobody to report to
+  ImageLoader *loader;
+} RowTarget;
+
+static bool write_rows(void *user, const Color *rows, int y, int count) {
+  RowTarget *target = user;
+  if (target->loader) {
+    if (atomic_load(&target->loader->cancel))
+      return false;
+    set_progress(target->loader,
+                 LOADER_READ_SHARE +
+                     (1 - LOADER_READ_SHARE) * (y + count) / target->height);
+  }
+  if (target->writer == NULL)
+    target->writer = tiled_image_writer_open(target->width, target->height,
+                                             target->memory_cap);
+  return tiled_image_writer_write_rows(target->writer, rows, count);
+}
+
+static TiledImage decode_tiles(ImageLoader *loader, const unsigned char *data,
+                               int size, const char *file_type,
+                               size_t memory_cap) {
+  TiledImage image = {0};
+  int width = 0, height = 0;
+  bool banded = false;
+  if (jpeg_read_size(data, size, &width, &height)) {
+    PROFILE_SCOPE(PROFILE_DECODE) {
+      RowTarget target = {NULL, width, height, memory_cap, loader};
+      banded = jpeg_decode_rows(data, size, 1, write_rows, &target);
+      if (target.writer)
+        image = tiled_image_writer_close(target.writer);
+    }
+    if (banded || (loader && atomic_load(&loader->cancel)))
+      return image;
+    // not baseline after all, or broken in a way raylib may cope with
+    tiled_image_free(&image);
+  } else if (!png_read_size(data, size, &width, &height)) {
+    width = height = 0;
+  }
+
+  // raylib needs the whole image in one buffer, the cap can't hold for it
+  if (over_cap(width, height, memory_cap))
+    return image;
+  Image decoded = {0};
+  PROFILE_SCOPE(PROFILE_DECODE) {
+    decoded = LoadImageFromMemory(file_type, data, size);
+  }
+  if (decoded.data == NULL)
+    return image;
+  if (loader)
+    set_progress(loader, LOADER_READ_SHARE + LOADER_DECODE_SHARE);
+
+  PROFILE_SCOPE(PROFILE_TILES) {
+    // only over the cap here if the header check couldn't read its size
+    if (!over_cap(decoded.width, decoded.height, memory_cap)) {
+      // every stage works on plain rgba so effects never convert formats
+      ImageFormat(&decoded, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+      image = tiled_image_from_image(decoded);
+    }
+  }
+  UnloadImage(decoded);
+  return image;
+}
+
+static TiledImage load_tiled(ImageLoader *loader, const char *path,
+                             size_t memory_cap, Vector2 preview_size) {
+  int size = 0;
+  unsigned char *data = read_file_in_chunks(loader, path, &size);
+  if (data == NULL)
+    return (TiledImage){0};
+
+  Image thumbnail = {0};
+  int offset, length;
+  if (jpeg_exif_thumbnail(data, size, &offset, &length)) {
+    thumbnail = LoadImageFromMemory(".jpg", data + offset, length);
+    if (thumbnail.data)
+      publish_thumbnail(loader, thumbnail);
+  }
+  // progressive and other unusual jpegs just don't get this step
+  int scale = preview_scale(data, size, preview_size);
+  if (scale && !covers(thumbnail, preview_size) &&
+      !atomic_load(&loader->cancel)) {
+    Image scaled = jpeg_decode_scaled(data, size, scale);
+    if (scaled.data)
+      publish_thumbnail(loader, scaled);
+  }
+
+  TiledImage image = decode_tiles(loader, data, size, GetFileExtension(path),
+                                  memory_cap);
+  RL_FREE(data);
+  set_progress(loader, 1);
+  return image;
+}
+
+static void *image_loader_main(void *arg) {
+  ImageLoader *loader = arg;
+
+  pthread_mutex_lock(&loader->lock);
+  for (;;) {
+    while (!loader->quit && loader->pending_path == NULL)
+      pthread_cond_wait(&loader->wake, &loader->lock);
+    if (loader->quit)
+      break;
+
+    char *path = loader->pending_path;
+    size_t memory_cap = loader->pending_cap;
+    Vector2 preview_size = loader->pending_preview_size;
+    loader->pending_path = NULL;
+    atomic_store(&loader->cancel, false);
+    set_progress(loader, 0);
+    pthread_mutex_unlock(&loader->lock);
+
+    TiledImage image = load_tiled(loader, path, memory_cap, preview_size);
+    free(path);
+
+    pthread_mutex_lock(&loader->lock);
+    if (atomic_load(&loader->cancel)) {
+      tiled_image_free(&image);
+    } else {
+      if (loader->has_result)
+        tiled_image_free(&loader->result);
+      loader->result = image;
+      loader->has_result = true;
+    }
+    loader->loading = loader->pending_path != NULL;
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return NULL;
+}
+
+ImageLoader *image_loader_create(void) {
+  ImageLoader *loader = calloc(1, sizeof(ImageLoader));
+  pthread_mutex_init(&loader->lock, NULL);
+  pthread_cond_init(&loader->wake, NULL);
+  atomic_init(&loader->cancel, false);
+  atomic_init(&loader->progress, 0);
+  pthread_create(&loader->thread, NULL, image_loader_main, loader);
+  return loader;
+}
+
+void image_loader_destroy(ImageLoader *loader) {
+  pthread_mutex_lock(&loader->lock);
+  loader->quit = true;
+  atomic_store(&loader->cancel, true);
+  pthread_cond_signal(&loader->wake);
+  pthread_mutex_unlock(&loader->lock);
+  pthread_join(loader->thread, NULL);
+
+  free(loader->pending_path);
+  if (loader->has_thumbnail)
+    UnloadImage(loader->thumbnail);
+  if (loader->has_result)
+    tiled_image_free(&loader->result);
+  pthread_cond_destroy(&loader->wake);
+  pthread_mutex_destroy(&loader->lock);
+  free(loader);
+}
+
+void image_loader_start(ImageLoader *loader, const char *path,
+                        size_t memory_cap, Vector2 preview_size) {
+  char *copy = strdup(path);
+
+  pthread_mutex_lock(&loader->lock);
+  free(loader->pending_path);
+  loader->pending_path = copy;
+  loader->pending_cap = memory_cap;
+  loader->pending_preview_size = preview_size;
+  loader->loading = true;
+  atomic_store(&loader->cancel, true);
+  // whatever the replaced load left behind is stale now
+  if (loader->has_thumbnail)
+    UnloadImage(loader->thumbnail);
+  loader->has_thumbnail = false;
+  if (loader->has_result)
+    tiled_image_free(&loader->result);
+  loader->has_result = false;
+  pthread_cond_signal(&loader->wake);
+  pthread_mutex_unlock(&loader->lock);
+}
+
+float image_loader_progress(ImageLoader *loader) {
+  return atomic_load(&loader->progress) / 1000.f;
+}
+
+bool image_loader_busy(ImageLoader *loader) {
+  pthread_mutex_lock(&loader->lock);
+  bool busy = loader->loading;
+  pthread_mutex_unlock(&loader->lock);
+  return busy;
+}
+
+bool image_loader_take_thumbnail(ImageLoader *loader, Image *thumbnail) {
+  pthread_mutex_lock(&loader->lock);
+  bool ready = loader->has_thumbnail;
+  if (ready) {
+    *thumbnail = loader->thumbnail;
+    loader->has_thumbnail = false;
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return ready;
+}
+
+TiledImage image_loader_decode(const unsigned char *data, int size,
+                               const char *file_type, size_t memory_cap) {
+  return decode_tiles(NULL, data, size, file_type, memory_cap);
+}
+
+bool image_loader_take_result(ImageLoader *loader, TiledImage *image) {
+  pthread_mutex_lock(&loader->lock);
+  bool ready = loader->has_result;
+  if (ready) {
+    *image = loader->result;
+    loader->result = (TiledImage){0};
+    loader->has_result = false;
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return ready;
+}
+
+#endif // IMAGE_LOADER_IMPLEMENTATION
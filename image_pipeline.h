@@ -0,0 +1,808 @@
+/*
+ * image_pipeline.h - staged edit pipeline for daisy
+ *
+ * usage:
+ *   #define IMAGE_PIPELINE_IMPLEMENTATION
+ *   #include "image_pipeline.h"
+ *
+ * every edit runs through a fixed chain of stages:
+ *
+ *   source -> proxy -> text -> blur -> brightness -> preview
+ *
+ * each stage caches its output together with the parameters it was built
+ * with. pipeline_update() compares the new parameters against the cached ones
+ * and only recomputes the first changed stage and everything after it, so
+ * moving the brightness slider never re-rasterizes text or re-blurs the image.
+ *
+ * blur, brightness and the mip levels are split into tiles and run on every
+ * core through tile_pool.h.
+ *
+ * text, blur and brightness can be limited to a region of the image (the
+ * context box). only the pixels inside it are processed, plus whatever the
+ * blur has to read around them, so small local edits stay cheap on big
+ * images.
+ *
+ * the proxy stage picks the smallest mip level of the source that still
+ * covers the preview size, so interactive edits cost about as much as the
+ * canvas has pixels no matter how big the photo is. pipeline_render_rows()
+ * runs the same edits on the full resolution source a strip of rows at a
+ * time, that is what saving and batch mode stream out.
+ *
+ * the source is a copy-on-write TiledImage. the first mip level is built from
+ * it a band of tiles at a time.
+ */
+
+#include "raylib.h"
+
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include "tile_pool.h"
+#include "tiled_image.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// position is in source image pixels, the pipeline scales it down for the
+// preview proxy
+typedef struct {
+  char *text;
+  Vector2 position;
+} TextObject;
+
+#define PIPELINE_MAX_MIPS 16
+
+typedef enum {
+  STAGE_SOURCE,
+  STAGE_PROXY,
+  STAGE_TEXT,
+  STAGE_BLUR,
+  STAGE_BRIGHTNESS,
+  STAGE_PREVIEW,
+  STAGE_COUNT
+} PipelineStage;
+
+// everything the pipeline needs to know to produce a preview
+typedef struct {
+  const TextObject *texts;
+  int text_count;
+  float blur_intensity;
+  float brightness_intensity;
+  bool snap_pixels;
+  Vector2 preview_size;
+  // part of the image the edits apply to, as fractions of its size so it
+  // means the same thing at every mip level. zero sized means all of it
+  Rectangle region;
+} EditParams;
+
+typedef struct {
+  Image output;
+  // false when the stage is a no-op and just forwards the image of the stage
+  // before it, so nothing has to be copied or freed
+  bool owned;
+  // blur and brightness only change their region, the rest of an owned
+  // output is the text stage's pixels as of base_serial
+  Tile changed;
+  unsigned int base_serial;
+} StageCache;
+
+typedef struct {
+  // our own reference to the source tiles
+  TiledImage source;
+  // the source stage is only filled in, with a flat copy of the source, when
+  // the preview is so big that the proxy is the source itself
+  StageCache stages[STAGE_COUNT];
+  // first stage that has to be recomputed, STAGE_COUNT when everything is
+  // up to date
+  PipelineStage dirty_from;
+
+  // halved copies of the source, mips[0] is unused since level 0 is the
+  // source itself. built lazily up to the deepest level asked for
+  Image mips[PIPELINE_MAX_MIPS];
+  int mip_count;
+
+  // the parameters the cached stages were built with
+  int proxy_level;
+  float proxy_scale;
+  int text_count;
+  int blur;
+  int brightness;
+  bool snap_pixels;
+  int preview_width;
+  int preview_height;
+  // region in pixels of the proxy
+  Tile region;
+  // bumped every time the text stage runs, see StageCache.base_serial
+  unsigned int base_serial;
+
+  // may be NULL. another thread sets it to make pipeline_update() give up
+  // early, the stages it didn't finish stay dirty for the next call
+  atomic_bool *cancel;
+} ImagePipeline;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// shares the source tiles, the caller may free its own copy right away
+void pipeline_set_source(ImagePipeline *pipeline, const TiledImage *source);
+void pipeline_invalidate(ImagePipeline *pipeline, PipelineStage from);
+// returns the preview, or an empty image if the update got cancelled
+Image pipeline_update(ImagePipeline *pipeline, EditParams params);
+Image pipeline_output(ImagePipeline *pipeline, PipelineStage stage);
+// rows [y0, y1) of the edits run on the full resolution source, written into
+// rows one source width apart. only the source rows they depend on are read,
+// so an export can stream the image out a strip at a time. doesn't touch any
+// pipeline, any thread may call it
+void pipeline_render_rows(const TiledImage *source, EditParams params, int y0,
+                          int y1, Color *rows);
+void pipeline_unload(ImagePipeline *pipeline);
+// the slider value is in source pixels. every path that blurs, preview, full
+// render and the gpu, turns it into a radius here so they all agree
+int pipeline_blur_radius(float blur_intensity, float scale);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGE_PIPELINE_H
+
+/*
+ * IMAGE_PIPELINE IMPLEMENTATION
+ */
+#if defined(IMAGE_PIPELINE_IMPLEMENTATION)
+
+#include "blur.h"
+#include "profiler.h"
+#include "tile_pool.h"
+
+#include <math.h>   // Required for: roundf(), floorf(), ceilf()
+#include <string.h> // Required for: memcpy()
+
+// the blur reads along rows and then along columns, cut the image into
+// tiles that are long in the direction each pass reads so the halo read
+// around every tile stays small
+#define BLUR_ROW_TILE_HEIGHT 16
+#define BLUR_COLUMN_TILE_WIDTH 64
+#define BLUR_COLUMN_TILE_HEIGHT 512
+
+static void release_stage(StageCache *stage) {
+  if (stage->owned)
+    UnloadImage(stage->output);
+  stage->output = (Image){0};
+  stage->owned = false;
+}
+
+static void forward_stage(ImagePipeline *pipeline, PipelineStage stage) {
+  release_stage(&pipeline->stages[stage]);
+  pipeline->stages[stage].output = pipeline->stages[stage - 1].output;
+}
+
+static void copy_stage(ImagePipeline *pipeline, PipelineStage stage) {
+  release_stage(&pipeline->stages[stage]);
+  pipeline->stages[stage].output =
+      ImageCopy(pipeline->stages[stage - 1].output);
+  pipeline->stages[stage].owned = true;
+}
+
+static bool is_whole_image(Tile region, Image image) {
+  return region.x0 == 0 && region.y0 == 0 && region.x1 == image.width &&
+         region.y1 == image.height;
+}
+
+// the region in whole pixels of a width x height image, rounded outwards
+static Tile region_pixels(Rectangle region, int width, int height) {
+  if (region.width <= 0 || region.height <= 0)
+    return (Tile){0, 0, width, height};
+
+  Tile tile = {floorf(region.x * width), floorf(region.y * height),
+               ceilf((region.x + region.width) * width),
+               ceilf((region.y + region.height) * height)};
+  tile.x0 = tile.x0 < 0 ? 0 : (tile.x0 > width ? width : tile.x0);
+  tile.y0 = tile.y0 < 0 ? 0 : (tile.y0 > height ? height : tile.y0);
+  tile.x1 = tile.x1 < tile.x0 ? tile.x0 : (tile.x1 > width ? width : tile.x1);
+  tile.y1 =
+      tile.y1 < tile.y0 ? tile.y0 : (tile.y1 > height ? height : tile.y1);
+  return tile;
+}
+
+// texts are clipped to the region: they get drawn into a copy of just that
+// part, which then goes back over the image
+static void draw_texts(Image *dst, const TextObject *texts, int from, int to,
+                       float scale, Tile region) {
+  int font_size = 40 * scale;
+  if (font_size < 1)
+    font_size = 1;
+
+  if (is_whole_image(region, *dst)) {
+    for (int i = from; i < to; i++) {
+      ImageDrawText(dst, texts[i].text, texts[i].position.x * scale,
+                    texts[i].position.y * scale, font_size, BLACK);
+    }
+    return;
+  }
+
+  int width = region.x1 - region.x0, height = region.y1 - region.y0;
+  if (width <= 0 || height <= 0 || from >= to)
+    return;
+  Image part = ImageFromImage(
+      *dst, (Rectangle){region.x0, region.y0, width, height});
+  for (int i = from; i < to; i++) {
+    ImageDrawText(&part, texts[i].text,
+                  texts[i].position.x * scale - region.x0,
+                  texts[i].position.y * scale - region.y0, font_size, BLACK);
+  }
+
+  Color *pixels = dst->data;
+  for (int y = 0; y < height; y++) {
+    memcpy(pixels + (size_t)(region.y0 + y) * dst->width + region.x0,
+           (Color *)part.data + (size_t)y * width, width * sizeof(Color));
+  }
+  UnloadImage(part);
+}
+
+static bool is_cancelled(atomic_bool *cancel) {
+  return cancel && atomic_load_explicit(cancel, memory_order_relaxed);
+}
+
+static Image new_rgba_image(int width, int height) {
+  return (Image){RL_MALLOC((size_t)width * height * sizeof(Color)), width,
+                 height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+}
+
+//------------------------------------------------------------------------------
+// per-pixel effects, split into tiles and run on every core
+//------------------------------------------------------------------------------
+typedef struct {
+  const Color *src;
+  Color *dst;
+  int src_width;
+  int dst_width;
+  atomic_bool *cancel;
+} HalfSizeJob;
+
+// plain 2x2 box filter, every pixel of the smaller level is the average of
+// the four it covers. odd edges just drop their last row/column
+static void half_size_tile(void *user, Tile tile) {
+  HalfSizeJob *job = user;
+  if (is_cancelled(job->cancel))
+    return;
+
+  for (int y = tile.y0; y < tile.y1; y++) {
+    const Color *row0 = job->src + (size_t)(2 * y) * job->src_width;
+    const Color *row1 = row0 + job->src_width;
+    Color *out = job->dst + (size_t)y * job->dst_width;
+    for (int x = tile.x0; x < tile.x1; x++) {
+      const Color a = row0[2 * x], b = row0[2 * x + 1];
+      const Color c = row1[2 * x], d = row1[2 * x + 1];
+      out[x] = (Color){(a.r + b.r + c.r + d.r + 2) / 4,
+                       (a.g + b.g + c.g + d.g + 2) / 4,
+                       (a.b + b.b + c.b + d.b + 2) / 4,
+                       (a.a + b.a + c.a + d.a + 2) / 4};
+    }
+  }
+}
+
+static Image half_size(Image src, atomic_bool *cancel) {
+  Image dst = new_rgba_image(src.width / 2, src.height / 2);
+  HalfSizeJob job = {src.data, dst.data, src.width, dst.width, cancel};
+  tile_pool_run(tile_pool_shared(), 0, 0, dst.width, dst.height,
+                TILE_POOL_TILE_SIZE, TILE_POOL_TILE_SIZE, half_size_tile, &job);
+  return dst;
+}
+
+// first mip level straight from the tiles, one band of tile rows at a time so
+// the source never has to exist as a single flat image
+static Image half_size_tiles(const TiledImage *src, atomic_bool *cancel) {
+  Image dst = new_rgba_image(src->width / 2, src->height / 2);
+  Color *band =
+      RL_MALLOC((size_t)src->width * TILED_IMAGE_TILE_SIZE * sizeof(Color));
+
+  for (int y = 0; y < dst.height * 2 && !is_cancelled(cancel);
+       y += TILED_IMAGE_TILE_SIZE) {
+    int rows = dst.height * 2 - y < TILED_IMAGE_TILE_SIZE
+                   ? dst.height * 2 - y
+                   : TILED_IMAGE_TILE_SIZE;
+    tiled_image_read(src, 0, y, src->width, rows, band, src->width);
+    HalfSizeJob job = {band, (Color *)dst.data + (size_t)(y / 2) * dst.width,
+                       src->width, dst.width, cancel};
+    tile_pool_run(tile_pool_shared(), 0, 0, dst.width, rows / 2,
+                  TILE_POOL_TILE_SIZE, TILE_POOL_TILE_SIZE, half_size_tile,
+                  &job);
+  }
+
+  RL_FREE(band);
+  return dst;
+}
+
+typedef struct {
+  const Color *src;
+  Color *tmp;
+  Color *dst;
+  int width;
+  int height;
+  int radius;
+  atomic_bool *cancel;
+} BlurJob;
+
+static void blur_rows_tile(void *user, Tile tile) {
+  BlurJob *job = user;
+  if (is_cancelled(job->cancel))
+    return;
+  blur_pass_horizontal(job->src, job->tmp, job->width, job->height,
+                       job->radius, tile.x0, tile.y0, tile.x1, tile.y1);
+}
+
+static void blur_columns_tile(void *user, Tile tile) {
+  BlurJob *job = user;
+  if (is_cancelled(job->cancel))
+    return;
+  blur_pass_vertical(job->tmp, job->dst, job->width, job->height, job->radius,
+                     tile.x0, tile.y0, tile.x1, tile.y1);
+}
+
+static int clamp_int(int value, int lo, int hi) {
+  return value < lo ? lo : (value > hi ? hi : value);
+}
+
+// the row pass writes into a scratch image and the column pass reads its
+// halo from there, so no tile ever reads pixels another tile is writing.
+// only the region of dst is written. the scratch buffers cover the region
+// and its halo and nothing more: the row pass also covers the rows above
+// and below the region the column pass reads, and both passes read the real
+// pixels around it. a window as wide as the image is blurred in place, a
+// narrower one is read out first
+static void blur_tiled(Image src, Image dst, int radius, Tile region,
+                       atomic_bool *cancel) {
+  int halo = blur_halo(radius);
+  int sx0 = clamp_int(region.x0 - halo, 0, src.width);
+  int sx1 = clamp_int(region.x1 + halo, 0, src.width);
+  int sy0 = clamp_int(region.y0 - halo, 0, src.height);
+  int sy1 = clamp_int(region.y1 + halo, 0, src.height);
+  int width = sx1 - sx0, height = sy1 - sy0;
+  size_t offset = (size_t)sy0 * src.width + sx0;
+  bool in_place = width == src.width;
+
+  Color *window = (Color *)src.data + offset;
+  Color *out = (Color *)dst.data + offset;
+  Color *tmp = RL_MALLOC((size_t)width * height * sizeof(Color));
+  if (!in_place) {
+    window = RL_MALLOC((size_t)width * height * sizeof(Color));
+    out = RL_MALLOC((size_t)width * height * sizeof(Color));
+    for (int y = 0; y < height; y++)
+      memcpy(window + (size_t)y * width,
+             (Color *)src.data + offset + (size_t)y * src.width,
+             width * sizeof(Color));
+  }
+
+  BlurJob job = {window, tmp, out, width, height, radius, cancel};
+  tile_pool_run(tile_pool_shared(), region.x0 - sx0, 0, region.x1 - sx0,
+                height, region.x1 - region.x0, BLUR_ROW_TILE_HEIGHT,
+                blur_rows_tile, &job);
+  tile_pool_run(tile_pool_shared(), region.x0 - sx0, region.y0 - sy0,
+                region.x1 - sx0, region.y1 - sy0, BLUR_COLUMN_TILE_WIDTH,
+                BLUR_COLUMN_TILE_HEIGHT, blur_columns_tile, &job);
+
+  if (!in_place) {
+    for (int y = region.y0; y < region.y1; y++)
+      memcpy((Color *)dst.data + (size_t)y * dst.width + region.x0,
+             out + (size_t)(y - sy0) * width + (region.x0 - sx0),
+             (region.x1 - region.x0) * sizeof(Color));
+    RL_FREE(window);
+    RL_FREE(out);
+  }
+  RL_FREE(tmp);
+}
+
+typedef struct {
+  const Color *src;
+  Color *dst;
+  int width;
+  unsigned char table[256];
+  atomic_bool *cancel;
+} BrightnessJob;
+
+static void brightness_tile(void *user, Tile tile) {
+  BrightnessJob *job = user;
+  if (is_cancelled(job->cancel))
+    return;
+
+  for (int y = tile.y0; y < tile.y1; y++) {
+    const Color *in = job->src + (size_t)y * job->width;
+    Color *out = job->dst + (size_t)y * job->width;
+    for (int x = tile.x0; x < tile.x1; x++) {
+      out[x] = (Color){job->table[in[x].r], job->table[in[x].g],
+                       job->table[in[x].b], in[x].a};
+    }
+  }
+}
+
+static void fill_brightness_table(unsigned char *table, int brightness) {
+  for (int i = 0; i < 256; i++) {
+    int value = i + brightness;
+    table[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+  }
+}
+
+// same as ImageColorBrightness(), every colour channel is shifted by
+// brightness and clamped, alpha is left alone. only the region of dst is
+// written
+static void brightness_tiled(Image src, Image dst, int brightness,
+                             Tile region, atomic_bool *cancel) {
+  BrightnessJob job = {src.data, dst.data, src.width, {0}, cancel};
+  fill_brightness_table(job.table, brightness);
+
+  tile_pool_run(tile_pool_shared(), region.x0, region.y0, region.x1,
+                region.y1, TILE_POOL_TILE_SIZE, TILE_POOL_TILE_SIZE,
+                brightness_tile, &job);
+}
+
+// deepest level that is still at least as big as the preview, so the
+// preview stage only ever scales down
+static int pick_proxy_level(const TiledImage *source, Vector2 preview_size) {
+  int level = 0;
+  int width = source->width;
+  int height = source->height;
+
+  while (level + 1 < PIPELINE_MAX_MIPS && width / 2 >= preview_size.x &&
+         height / 2 >= preview_size.y) {
+    width /= 2;
+    height /= 2;
+    level++;
+  }
+  return level;
+}
+
+static void run_proxy_stage(ImagePipeline *pipeline, int level) {
+  const TiledImage *source = &pipeline->source;
+
+  if (pipeline->mip_count < 1)
+    pipeline->mip_count = 1;
+  while (pipeline->mip_count <= level) {
+    int next = pipeline->mip_count;
+    Image mip = next == 1
+                    ? half_size_tiles(source, pipeline->cancel)
+                    : half_size(pipeline->mips[next - 1], pipeline->cancel);
+    // a cancelled level is half written, never keep it around
+    if (is_cancelled(pipeline->cancel)) {
+      UnloadImage(mip);
+      return;
+    }
+    pipeline->mips[next] = mip;
+    pipeline->mip_count++;
+  }
+
+  StageCache *stage = &pipeline->stages[STAGE_PROXY];
+  release_stage(stage);
+  if (level == 0) {
+    // small sources are edited as they are, flatten them once
+    StageCache *flat = &pipeline->stages[STAGE_SOURCE];
+    if (flat->output.data == NULL) {
+      flat->output = tiled_image_to_image(source);
+      flat->owned = true;
+    }
+    stage->output = flat->output;
+  } else {
+    stage->output = pipeline->mips[level];
+  }
+  pipeline->proxy_level = level;
+  pipeline->proxy_scale = (float)stage->output.width / source->width;
+}
+
+static bool same_region(Tile a, Tile b) {
+  return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+static void run_text_stage(ImagePipeline *pipeline, EditParams params,
+                           Tile region) {
+  StageCache *stage = &pipeline->stages[STAGE_TEXT];
+  pipeline->base_serial++;
+
+  // text objects are only ever appended, so if the cached layer already holds
+  // a prefix of them and neither the proxy under it nor the region they are
+  // clipped to changed only the new ones have to be drawn
+  if (stage->owned && pipeline->dirty_from == STAGE_TEXT &&
+      same_region(region, pipeline->region) &&
+      params.text_count > pipeline->text_count) {
+    draw_texts(&stage->output, params.texts, pipeline->text_count,
+               params.text_count, pipeline->proxy_scale, region);
+  } else if (params.text_count == 0) {
+    forward_stage(pipeline, STAGE_TEXT);
+  } else {
+    copy_stage(pipeline, STAGE_TEXT);
+    draw_texts(&stage->output, params.texts, 0, params.text_count,
+               pipeline->proxy_scale, region);
+  }
+  pipeline->text_count = params.text_count;
+}
+
+// the output an effect limited to region writes into. outside their regions
+// the blur and brightness outputs are the text stage's pixels, so as long as
+// that didn't run again the last output is reused and only the pixels the
+// last run changed are put back from the input, instead of copying all of it
+// on every slider step
+static Image region_stage_output(ImagePipeline *pipeline, PipelineStage stage,
+                                 Tile region) {
+  StageCache *cache = &pipeline->stages[stage];
+  Image input = pipeline->stages[stage - 1].output;
+  bool whole = is_whole_image(region, input);
+
+  if (cache->owned && cache->base_serial == pipeline->base_serial &&
+      cache->output.width == input.width &&
+      cache->output.height == input.height) {
+    Tile old = cache->changed;
+    for (int y = old.y0; y < old.y1 && !whole; y++)
+      memcpy((Color *)cache->output.data + (size_t)y * input.width + old.x0,
+             (Color *)input.data + (size_t)y * input.width + old.x0,
+             (old.x1 - old.x0) * sizeof(Color));
+  } else {
+    release_stage(cache);
+    cache->output = whole ? new_rgba_image(input.width, input.height)
+                          : ImageCopy(input);
+    cache->owned = true;
+    cache->base_serial = pipeline->base_serial;
+  }
+  // before the effect runs, a cancelled one leaves these pixels half done
+  cache->changed = region;
+  return cache->output;
+}
+
+static void run_blur_stage(ImagePipeline *pipeline, int blur, Tile region) {
+  if (blur <= 0) {
+    forward_stage(pipeline, STAGE_BLUR);
+  } else {
+    Image output = region_stage_output(pipeline, STAGE_BLUR, region);
+    blur_tiled(pipeline->stages[STAGE_TEXT].output, output, blur, region,
+               pipeline->cancel);
+  }
+  pipeline->blur = blur;
+}
+
+static void run_brightness_stage(ImagePipeline *pipeline, int brightness,
+                                 Tile region) {
+  if (brightness == 0) {
+    forward_stage(pipeline, STAGE_BRIGHTNESS);
+  } else {
+    Image output = region_stage_output(pipeline, STAGE_BRIGHTNESS, region);
+    brightness_tiled(pipeline->stages[STAGE_BLUR].output, output, brightness,
+                     region, pipeline->cancel);
+  }
+  pipeline->brightness = brightness;
+}
+
+static void run_preview_stage(ImagePipeline *pipeline, EditParams params) {
+  copy_stage(pipeline, STAGE_PREVIEW);
+  Image *preview = &pipeline->stages[STAGE_PREVIEW].output;
+  if (params.snap_pixels) {
+    ImageResizeNN(preview, params.preview_size.x, params.preview_size.y);
+  } else {
+    ImageResize(preview, params.preview_size.x, params.preview_size.y);
+  }
+  pipeline->snap_pixels = params.snap_pixels;
+  pipeline->preview_width = params.preview_size.x;
+  pipeline->preview_height = params.preview_size.y;
+}
+
+static void mark_dirty(ImagePipeline *pipeline, PipelineStage stage) {
+  if (stage < pipeline->dirty_from)
+    pipeline->dirty_from = stage;
+}
+
+// checked after every stage, a cancelled stage left a half finished image
+// behind so it has to run again next time
+static bool stop_if_cancelled(ImagePipeline *pipeline, PipelineStage stage) {
+  if (!is_cancelled(pipeline->cancel))
+    return false;
+  pipeline->dirty_from = stage;
+  return true;
+}
+
+void pipeline_set_source(ImagePipeline *pipeline, const TiledImage *source) {
+  pipeline_unload(pipeline);
+  pipeline->source = tiled_image_copy(source);
+  pipeline->dirty_from = STAGE_PROXY;
+}
+
+void pipeline_invalidate(ImagePipeline *pipeline, PipelineStage from) {
+  // the source stage is never recomputed, only replaced
+  if (from < STAGE_PROXY)
+    from = STAGE_PROXY;
+
+  // drop the stale outputs so nothing incremental gets drawn on top of them,
+  // back to front because later stages may forward earlier ones
+  for (int i = STAGE_COUNT - 1; i >= (int)from; i--)
+    release_stage(&pipeline->stages[i]);
+  mark_dirty(pipeline, from);
+}
+
+int pipeline_blur_radius(float blur_intensity, float scale) {
+  return roundf(blur_intensity * scale);
+}
+
+Image pipeline_update(ImagePipeline *pipeline, EditParams params) {
+  const TiledImage *source = &pipeline->source;
+  int level = pick_proxy_level(source, params.preview_size);
+  if (level != pipeline->proxy_level)
+    mark_dirty(pipeline, STAGE_PROXY);
+
+  // the blur radius is in source pixels, shrink it along with the proxy so
+  // the preview looks like the full resolution result
+  float scale = (float)(source->width >> level) / source->width;
+  int blur = pipeline_blur_radius(params.blur_intensity, scale);
+  int brightness = params.brightness_intensity;
+  Tile region = region_pixels(params.region, source->width >> level,
+                              source->height >> level);
+
+  // raylib takes whole numbers for both effects, so slider movements that
+  // round to the same value don't need any work
+  if (params.text_count != pipeline->text_count)
+    mark_dirty(pipeline, STAGE_TEXT);
+  // a new region changes where texts get clipped too
+  if (!same_region(region, pipeline->region))
+    mark_dirty(pipeline, params.text_count > 0 ? STAGE_TEXT : STAGE_BLUR);
+  if (blur != pipeline->blur)
+    mark_dirty(pipeline, STAGE_BLUR);
+  if (brightness != pipeline->brightness)
+    mark_dirty(pipeline, STAGE_BRIGHTNESS);
+  if (params.snap_pixels != pipeline->snap_pixels ||
+      (int)params.preview_size.x != pipeline->preview_width ||
+      (int)params.preview_size.y != pipeline->preview_height)
+    mark_dirty(pipeline, STAGE_PREVIEW);
+
+  // fall through on purpose, every stage after the first dirty one reruns
+  switch (pipeline->dirty_from) {
+  case STAGE_SOURCE:
+  case STAGE_PROXY:
+    PROFILE_SCOPE(PROFILE_PROXY) {
+      run_proxy_stage(pipeline, level);
+    }
+    if (stop_if_cancelled(pipeline, STAGE_PROXY))
+      return (Image){0};
+  case STAGE_TEXT:
+    PROFILE_SCOPE(PROFILE_TEXT) {
+      run_text_stage(pipeline, params, region);
+    }
+    if (stop_if_cancelled(pipeline, STAGE_TEXT))
+      return (Image){0};
+  case STAGE_BLUR:
+    PROFILE_SCOPE(PROFILE_BLUR) {
+      run_blur_stage(pipeline, blur, region);
+    }
+    if (stop_if_cancelled(pipeline, STAGE_BLUR))
+      return (Image){0};
+  case STAGE_BRIGHTNESS:
+    PROFILE_SCOPE(PROFILE_BRIGHTNESS) {
+      run_brightness_stage(pipeline, brightness, region);
+    }
+    if (stop_if_cancelled(pipeline, STAGE_BRIGHTNESS))
+      return (Image){0};
+  case STAGE_PREVIEW:
+    PROFILE_SCOPE(PROFILE_RESIZE) {
+      run_preview_stage(pipeline, params);
+    }
+  case STAGE_COUNT:
+    break;
+  }
+  pipeline->dirty_from = STAGE_COUNT;
+  pipeline->region = region;
+
+  return pipeline->stages[STAGE_PREVIEW].output;
+}
+
+Image pipeline_output(ImagePipeline *pipeline, PipelineStage stage) {
+  return pipeline->stages[stage].output;
+}
+
+//------------------------------------------------------------------------------
+// the same effects at full resolution, see pipeline_render_rows()
+//------------------------------------------------------------------------------
+
+#define FULL_RESOLUTION_FONT_SIZE 40
+
+// the pixels a text covers at full resolution, clipped to the region
+static Tile text_box(const TextObject *text, Tile region) {
+  const int font_size = FULL_RESOLUTION_FONT_SIZE;
+  Vector2 size =
+      MeasureTextEx(GetFontDefault(), text->text, font_size, font_size / 10);
+  int x = text->position.x, y = text->position.y;
+  return (Tile){clamp_int(x, region.x0, region.x1),
+                clamp_int(y, region.y0, region.y1),
+                clamp_int(x + ceilf(size.x) + 1, region.x0, region.x1),
+                clamp_int(y + ceilf(size.y) + 1, region.y0, region.y1)};
+}
+
+// every text is drawn into a copy of just the pixels it covers, on a strip of
+// full width rows that starts at source row strip_y
+static void draw_texts_rows(Image *strip, int strip_y, const TextObject *texts,
+                            int count, Tile region) {
+  region.y0 = clamp_int(region.y0, strip_y, strip_y + strip->height);
+  region.y1 = clamp_int(region.y1, strip_y, strip_y + strip->height);
+  for (int i = 0; i < count; i++) {
+    Tile box = text_box(&texts[i], region);
+    if (box.x1 <= box.x0 || box.y1 <= box.y0)
+      continue;
+
+    Rectangle rect = {box.x0, box.y0 - strip_y, box.x1 - box.x0,
+                      box.y1 - box.y0};
+    Image part = ImageFromImage(*strip, rect);
+    ImageDrawText(&part, texts[i].text, (int)texts[i].position.x - box.x0,
+                  (int)texts[i].position.y - box.y0,
+                  FULL_RESOLUTION_FONT_SIZE, BLACK);
+    Color *pixels = strip->data;
+    for (int y = 0; y < part.height; y++)
+      memcpy(pixels + (size_t)(rect.y + y) * strip->width + box.x0,
+             (Color *)part.data + (size_t)y * part.width,
+             part.width * sizeof(Color));
+    UnloadImage(part);
+  }
+}
+
+void pipeline_render_rows(const TiledImage *source, EditParams params, int y0,
+                          int y1, Color *rows) {
+  const int width = source->width;
+  Tile region = region_pixels(params.region, width, source->height);
+  int blur = pipeline_blur_radius(params.blur_intensity, 1);
+  int brightness = params.brightness_intensity;
+
+  // the blur reads up to its halo above and below the strip
+  int halo = blur > 0 ? blur_halo(blur) : 0;
+  int sy0 = clamp_int(y0 - halo, 0, source->height);
+  int sy1 = clamp_int(y1 + halo, 0, source->height);
+  Image strip = new_rgba_image(width, sy1 - sy0);
+  tiled_image_read(source, 0, sy0, width, strip.height, strip.data, width);
+  draw_texts_rows(&strip, sy0, params.texts, params.text_count, region);
+
+  // the part of the region inside the strip, in strip rows
+  Tile inside = {region.x0, clamp_int(region.y0, y0, y1) - sy0, region.x1,
+                 clamp_int(region.y1, y0, y1) - sy0};
+  bool empty = inside.x1 <= inside.x0 || inside.y1 <= inside.y0;
+  Color *result = strip.data;
+
+  if (blur > 0 && !empty) {
+    size_t pixels = (size_t)width * strip.height;
+    Color *tmp = RL_MALLOC(pixels * sizeof(Color));
+    Color *dst = RL_MALLOC(pixels * sizeof(Color));
+    memcpy(dst, strip.data, pixels * sizeof(Color));
+    BlurJob job = {strip.data, tmp, dst, width, strip.height, blur, NULL};
+    // rows the column pass reads, the region's own plus its halo
+    int rows_y0 = clamp_int(region.y0 - halo - sy0, 0, strip.height);
+    int rows_y1 = clamp_int(region.y1 + halo - sy0, 0, strip.height);
+    tile_pool_run(tile_pool_shared(), region.x0, rows_y0, region.x1, rows_y1,
+                  region.x1 - region.x0, BLUR_ROW_TILE_HEIGHT, blur_rows_tile,
+                  &job);
+    tile_pool_run(tile_pool_shared(), inside.x0, inside.y0, inside.x1,
+                  inside.y1, BLUR_COLUMN_TILE_WIDTH, BLUR_COLUMN_TILE_HEIGHT,
+                  blur_columns_tile, &job);
+    RL_FREE(tmp);
+    result = dst;
+  }
+
+  if (brightness != 0 && !empty) {
+    BrightnessJob job = {result, result, width, {0}, NULL};
+    fill_brightness_table(job.table, brightness);
+    tile_pool_run(tile_pool_shared(), inside.x0, inside.y0, inside.x1,
+                  inside.y1, TILE_POOL_TILE_SIZE, TILE_POOL_TILE_SIZE,
+                  brightness_tile, &job);
+  }
+
+  memcpy(rows, result + (size_t)(y0 - sy0) * width,
+         (size_t)width * (y1 - y0) * sizeof(Color));
+  if (result != strip.data)
+    RL_FREE(result);
+  UnloadImage(strip);
+}
+
+void pipeline_unload(ImagePipeline *pipeline) {
+  // later stages may forward earlier ones, release back to front so only
+  // owned images get freed
+  for (int i = STAGE_COUNT - 1; i >= 0; i--)
+    release_stage(&pipeline->stages[i]);
+  for (int i = 1; i < pipeline->mip_count; i++)
+    UnloadImage(pipeline->mips[i]);
+  tiled_image_free(&pipeline->source);
+  atomic_bool *cancel = pipeline->cancel;
+  *pipeline = (ImagePipeline){0};
+  pipeline->cancel = cancel;
+}
+
+#endif // IMAGE_PIPELINE_IMPLEMENTATION
@@ -0,0 +1,717 @@
+/*
+ * jpeg_scaled.h - decodes baseline jpegs straight to 1/2, 1/4 or 1/8 size
+ *
+ * usage:
+ *   #define JPEG_SCALED_IMPLEMENTATION
+ *   #include "jpeg_scaled.h"
+ *
+ * a jpeg is made of 8x8 blocks of dct coefficients, and the low frequency
+ * corner of each block already describes a smaller picture of it. instead of
+ * running the full 8 point idct and shrinking the result afterwards, the
+ * decoder runs a 4, 2 or 1 point idct on just those coefficients (the same
+ * trick libjpeg uses for scaled decoding). at 1/8 only the dc coefficient is
+ * used, so a block becomes one pixel. huffman decoding still has to walk
+ * every coefficient, but idct, upsampling and color conversion shrink with
+ * the output.
+ *
+ * the same decoder can hand its output out a few rows at a time instead,
+ * every time an mcu row is done. only that mcu row and a handful of sample
+ * rows before it are kept, so a photo too big for memory can go straight to
+ * wherever it ends up (see tiled_image_writer_open()).
+ *
+ * only baseline (sequential, huffman coded, 8 bit) grayscale and ycbcr
+ * images are handled. progressive, arithmetic coded, cmyk and multi scan
+ * files give an empty image and the caller decodes them the usual way.
+ */
+
+#include "raylib.h"
+
+#ifndef JPEG_SCALED_H
+#define JPEG_SCALED_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// size from the frame header, works for every kind of jpeg
+bool jpeg_read_size(const unsigned char *data, int size, int *width,
+                    int *height);
+// scale is 1, 2, 4 or 8. the result is ceil(width / scale) by
+// ceil(height / scale) rgba pixels, or (Image){0} if the file isn't one the
+// decoder handles
+Image jpeg_decode_scaled(const unsigned char *data, int size, int scale);
+
+// gets count finished rows starting at row y, packed one after the other.
+// returning false stops the decode
+typedef bool (*JpegRowsCallback)(void *user, const Color *rows, int y,
+                                 int count);
+// same as jpeg_decode_scaled(), but the rows go to the callback top to bottom
+// and the whole image is never held. false if the file isn't one the decoder
+// handles, it turns out broken halfway or the callback stopped it
+bool jpeg_decode_rows(const unsigned char *data, int size, int scale,
+                      JpegRowsCallback rows, void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JPEG_SCALED_H
+
+/*
+ * JPEG_SCALED IMPLEMENTATION
+ */
+#if defined(JPEG_SCALED_IMPLEMENTATION)
+
+#include <math.h>   // Required for: cosf(), sinf(), sqrtf()
+#include <stdint.h> // Required for: uint32_t
+#include <string.h> // Required for: memset(), memcpy(), memmove(), memcmp()
+
+#define JPEG_FAST_BITS 9
+#define JPEG_MAX_COMPONENTS 3
+// sample rows kept from the mcu rows before the one being decoded, for
+// upsampling across the seam. components with different vertical sampling
+// can disagree about which output rows are done by up to three rows
+#define JPEG_CARRY_ROWS 4
+
+typedef struct {
+  // codes of up to JPEG_FAST_BITS bits are looked up directly, a length of
+  // 0 means the code is longer and has to be searched for
+  unsigned char fast_length[1 << JPEG_FAST_BITS];
+  unsigned char fast_symbol[1 << JPEG_FAST_BITS];
+  // largest code of each length, -1 if there are none
+  int max_code[17];
+  // code + value_offset[length] is the index of its symbol
+  int value_offset[17];
+  unsigned char symbols[256];
+  int symbol_count;
+} HuffmanTable;
+
+typedef struct {
+  int id;
+  int h, v;
+  int quant;
+  int dc_table, ac_table;
+  int dc;
+  // decoded samples at the reduced scale, the current mcu row and
+  // JPEG_CARRY_ROWS above it. plane_top is the row of the whole plane the
+  // buffer starts at, plane_height how many rows the whole plane has
+  unsigned char *plane;
+  int plane_width, plane_height;
+  int plane_top;
+} JpegComponent;
+
+typedef struct {
+  const unsigned char *data;
+  int size;
+  int pos;
+
+  // left aligned bits, at least 16 valid after refill_bits()
+  uint32_t buffer;
+  int bits;
+  // reached a marker, the entropy coded data is over (or a restart is due)
+  bool marker;
+
+  unsigned short quant[4][64];
+  HuffmanTable huffman[2][4];
+  JpegComponent components[JPEG_MAX_COMPONENTS];
+  int component_count;
+  int width, height;
+  int h_max, v_max;
+  int restart_interval;
+  // from an adobe app14 segment, 0 means the three channels are plain rgb
+  int adobe_transform;
+  bool has_frame;
+
+  // 8 / scale, how many pixels a block turns into along each side
+  int block_pixels;
+  // block_pixels point idct basis, idct[x][u]
+  float idct[8][8];
+} JpegDecoder;
+
+// coefficient order in the file to position in the 8x8 block
+static const unsigned char jpeg_zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+static int read_be16(const unsigned char *p) { return p[0] << 8 | p[1]; }
+
+//------------------------------------------------------------------------------
+// headers
+//------------------------------------------------------------------------------
+static bool build_huffman(HuffmanTable *table, const unsigned char *counts,
+                          const unsigned char *symbols, int symbol_count) {
+  memset(table, 0, sizeof(HuffmanTable));
+  memcpy(table->symbols, symbols, symbol_count);
+  table->symbol_count = symbol_count;
+
+  int code = 0, index = 0;
+  for (int length = 1; length <= 16; length++) {
+    table->value_offset[length] = index - code;
+    for (int i = 0; i < counts[length - 1]; i++, code++, index++) {
+      // more codes than the length has room for
+      if (code >= 1 << length)
+        return false;
+      if (length > JPEG_FAST_BITS)
+        continue;
+      // every lookup index that starts with this code
+      int shift = JPEG_FAST_BITS - length;
+      for (int j = 0; j < 1 << shift; j++) {
+        table->fast_length[code << shift | j] = length;
+        table->fast_symbol[code << shift | j] = symbols[index];
+      }
+    }
+    table->max_code[length] = counts[length - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  return true;
+}
+
+static bool read_dqt(JpegDecoder *d, const unsigned char *p, int length) {
+  while (length > 0) {
+    int precision = p[0] >> 4, id = p[0] & 15;
+    int bytes = 1 + 64 * (precision ? 2 : 1);
+    if (id > 3 || length < bytes)
+      return false;
+    for (int i = 0; i < 64; i++)
+      d->quant[id][i] = precision ? read_be16(p + 1 + i * 2) : p[1 + i];
+    p += bytes;
+    length -= bytes;
+  }
+  return true;
+}
+
+static bool read_dht(JpegDecoder *d, const unsigned char *p, int length) {
+  while (length > 17) {
+    int type = p[0] >> 4, id = p[0] & 15;
+    int count = 0;
+    for (int i = 0; i < 16; i++)
+      count += p[1 + i];
+    if (type > 1 || id > 3 || count > 256 || length < 17 + count)
+      return false;
+    if (!build_huffman(&d->huffman[type][id], p + 1, p + 17, count))
+      return false;
+    p += 17 + count;
+    length -= 17 + count;
+  }
+  return length == 0;
+}
+
+static bool read_sof(JpegDecoder *d, const unsigned char *p, int length) {
+  if (length < 6 || p[0] != 8)
+    return false;
+  d->height = read_be16(p + 1);
+  d->width = read_be16(p + 3);
+  d->component_count = p[5];
+  if (d->width == 0 || d->height == 0 ||
+      (d->component_count != 1 && d->component_count != 3) ||
+      length < 6 + d->component_count * 3)
+    return false;
+
+  d->h_max = d->v_max = 1;
+  for (int i = 0; i < d->component_count; i++) {
+    JpegComponent *c = &d->components[i];
+    c->id = p[6 + i * 3];
+    c->h = p[7 + i * 3] >> 4;
+    c->v = p[7 + i * 3] & 15;
+    c->quant = p[8 + i * 3];
+    if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->quant > 3)
+      return false;
+    d->h_max = c->h > d->h_max ? c->h : d->h_max;
+    d->v_max = c->v > d->v_max ? c->v : d->v_max;
+  }
+  d->has_frame = true;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// entropy coded data
+//------------------------------------------------------------------------------
+static void refill_bits(JpegDecoder *d) {
+  while (d->bits <= 24) {
+    int byte = 0;
+    if (!d->marker && d->pos < d->size) {
+      byte = d->data[d->pos];
+      if (byte != 0xFF) {
+        d->pos++;
+      } else if (d->pos + 1 < d->size && d->data[d->pos + 1] == 0) {
+        // stuffed zero after a literal 0xFF
+        d->pos += 2;
+      } else {
+        // a marker, leave it for the caller and pad with zeros
+        d->marker = true;
+        byte = 0;
+      }
+    }
+    d->buffer |= (uint32_t)byte << (24 - d->bits);
+    d->bits += 8;
+  }
+}
+
+static int take_bits(JpegDecoder *d, int count) {
+  int value = d->buffer >> (32 - count);
+  d->buffer <<= count;
+  d->bits -= count;
+  return value;
+}
+
+static int decode_huffman(JpegDecoder *d, const HuffmanTable *table) {
+  refill_bits(d);
+  int look = d->buffer >> (32 - JPEG_FAST_BITS);
+  int length = table->fast_length[look];
+  if (length) {
+    take_bits(d, length);
+    return table->fast_symbol[look];
+  }
+  for (length = JPEG_FAST_BITS + 1; length <= 16; length++) {
+    int code = d->buffer >> (32 - length);
+    if (code <= table->max_code[length]) {
+      int index = code + table->value_offset[length];
+      if (index < 0 || index >= table->symbol_count)
+        return -1;
+      take_bits(d, length);
+      return table->symbols[index];
+    }
+  }
+  return -1;
+}
+
+// the next `count` bits as a signed coefficient
+static int receive_extend(JpegDecoder *d, int count) {
+  if (count == 0)
+    return 0;
+  refill_bits(d);
+  int value = take_bits(d, count);
+  if (value < 1 << (count - 1))
+    value -= (1 << count) - 1;
+  return value;
+}
+
+// dequantized coefficients of the block_pixels x block_pixels corner, the
+// rest are decoded and thrown away
+static bool decode_block(JpegDecoder *d, JpegComponent *c, float *block) {
+  const HuffmanTable *dc = &d->huffman[0][c->dc_table];
+  const HuffmanTable *ac = &d->huffman[1][c->ac_table];
+  const unsigned short *quant = d->quant[c->quant];
+  int n = d->block_pixels;
+
+  int size = decode_huffman(d, dc);
+  if (size < 0 || size > 11)
+    return false;
+  // a valid file keeps the dc in 11 bits, a broken one could run it up
+  // until it overflows
+  c->dc += receive_extend(d, size);
+  c->dc = c->dc < -2048 ? -2048 : c->dc > 2047 ? 2047 : c->dc;
+  memset(block, 0, 64 * sizeof(float));
+  block[0] = c->dc * quant[0];
+
+  for (int k = 1; k < 64;) {
+    int symbol = decode_huffman(d, ac);
+    if (symbol < 0)
+      return false;
+    int run = symbol >> 4, bits = symbol & 15;
+    if (bits == 0) {
+      // end of block, or a run of 16 zeros
+      if (run != 15)
+        break;
+      k += 16;
+      continue;
+    }
+    k += run;
+    if (k > 63)
+      return false;
+    int value = receive_extend(d, bits);
+    int position = jpeg_zigzag[k];
+    if (position % 8 < n && position / 8 < n)
+      block[position] = value * quant[k];
+    k++;
+  }
+  return true;
+}
+
+static unsigned char clamp_sample(float value) {
+  return value < 0 ? 0 : value > 255 ? 255 : (unsigned char)(value + 0.5f);
+}
+
+// n point idct of the coefficient corner, written to out
+static void idct_block(JpegDecoder *d, const float *block, unsigned char *out,
+                       int stride) {
+  int n = d->block_pixels;
+  float rows[8][8];
+
+  for (int v = 0; v < n; v++)
+    for (int x = 0; x < n; x++) {
+      float sum = 0;
+      for (int u = 0; u < n; u++)
+        sum += d->idct[x][u] * block[v * 8 + u];
+      rows[v][x] = sum;
+    }
+
+  for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++) {
+      float sum = 0;
+      for (int v = 0; v < n; v++)
+        sum += d->idct[y][v] * rows[v][x];
+      out[y * stride + x] = clamp_sample(sum + 128);
+    }
+}
+
+// skips to the data after the next RSTn marker and starts over from there
+static bool restart(JpegDecoder *d) {
+  int pos = d->pos;
+  while (pos + 1 < d->size &&
+         !(d->data[pos] == 0xFF && d->data[pos + 1] >= 0xD0 &&
+           d->data[pos + 1] <= 0xD7))
+    pos++;
+  if (pos + 1 >= d->size)
+    return false;
+  d->pos = pos + 2;
+  d->buffer = 0;
+  d->bits = 0;
+  d->marker = false;
+  for (int i = 0; i < d->component_count; i++)
+    d->components[i].dc = 0;
+  return true;
+}
+
+static bool read_scan(JpegDecoder *d, const unsigned char *p, int length) {
+  // an empty segment at the very end has p past the data
+  if (length < 1)
+    return false;
+  int count = p[0];
+  if (length < 1 + count * 2 + 3)
+    return false;
+  // everything in one interleaved scan, anything else is multi scan
+  if (count != d->component_count)
+    return false;
+
+  for (int i = 0; i < count; i++) {
+    JpegComponent *c = NULL;
+    for (int j = 0; j < d->component_count; j++)
+      if (d->components[j].id == p[1 + i * 2])
+        c = &d->components[j];
+    if (c == NULL)
+      return false;
+    c->dc_table = p[2 + i * 2] >> 4;
+    c->ac_table = p[2 + i * 2] & 15;
+    if (c->dc_table > 3 || c->ac_table > 3 ||
+        d->huffman[0][c->dc_table].symbol_count == 0 ||
+        d->huffman[1][c->ac_table].symbol_count == 0)
+      return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// output
+//------------------------------------------------------------------------------
+// where output pixel x lands on a component sampled factor / max as densely:
+// the two samples around it and how much the second one counts
+static void sample_position(int x, int factor, int max, int limit, int *first,
+                            int *second, float *weight) {
+  float position = (x + 0.5f) * factor / max - 0.5f;
+  if (position < 0)
+    position = 0;
+  *first = position;
+  *second = *first + 1 < limit ? *first + 1 : *first;
+  *weight = position - *first;
+}
+
+// the two sample rows of a component that output row y is made of, as rows
+// of its plane buffer
+static void sample_rows(JpegDecoder *d, JpegComponent *c, int y,
+                        const unsigned char **top,
+                        const unsigned char **bottom, float *below) {
+  int first, second;
+  sample_position(y, c->v, d->v_max, c->plane_height, &first, &second, below);
+  *top = c->plane + (first - c->plane_top) * c->plane_width;
+  *bottom = c->plane + (second - c->plane_top) * c->plane_width;
+}
+
+static void convert_row(JpegDecoder *d, int y, Color *out, int width) {
+  if (d->component_count == 1) {
+    JpegComponent *c = &d->components[0];
+    const unsigned char *row =
+        c->plane + (y - c->plane_top) * c->plane_width;
+    for (int x = 0; x < width; x++)
+      out[x] = (Color){row[x], row[x], row[x], 255};
+    return;
+  }
+
+  // subsampled components are stretched back bilinearly, like libjpeg's
+  // fancy upsampling. with nearest neighbour the chroma edges show up as
+  // blocks, worse the smaller the output gets
+  bool ycbcr = d->adobe_transform != 0;
+  const unsigned char *top[3], *bottom[3];
+  float below[3];
+  for (int i = 0; i < 3; i++)
+    sample_rows(d, &d->components[i], y, &top[i], &bottom[i], &below[i]);
+
+  for (int x = 0; x < width; x++) {
+    float s[3];
+    for (int i = 0; i < 3; i++) {
+      JpegComponent *c = &d->components[i];
+      if (c->h == d->h_max && c->v == d->v_max) {
+        s[i] = top[i][x];
+        continue;
+      }
+      int left, right;
+      float weight;
+      sample_position(x, c->h, d->h_max, c->plane_width, &left, &right,
+                      &weight);
+      float upper = top[i][left] + (top[i][right] - top[i][left]) * weight;
+      float lower =
+          bottom[i][left] + (bottom[i][right] - bottom[i][left]) * weight;
+      s[i] = upper + (lower - upper) * below[i];
+    }
+    if (ycbcr) {
+      float cb = s[1] - 128, cr = s[2] - 128;
+      out[x] = (Color){clamp_sample(s[0] + 1.402f * cr),
+                       clamp_sample(s[0] - 0.344136f * cb - 0.714136f * cr),
+                       clamp_sample(s[0] + 1.772f * cb), 255};
+    } else {
+      out[x] = (Color){clamp_sample(s[0]), clamp_sample(s[1]),
+                       clamp_sample(s[2]), 255};
+    }
+  }
+}
+
+// whether output row y only needs samples of the first mcu_rows mcu rows
+static bool row_decoded(JpegDecoder *d, int y, int mcu_rows) {
+  int n = d->block_pixels;
+  if (d->component_count == 1)
+    return y < mcu_rows * n;
+  for (int i = 0; i < d->component_count; i++) {
+    JpegComponent *c = &d->components[i];
+    int first, second;
+    float weight;
+    sample_position(y, c->v, d->v_max, c->plane_height, &first, &second,
+                    &weight);
+    if (second >= mcu_rows * c->v * n)
+      return false;
+  }
+  return true;
+}
+
+// decodes one mcu row at a time and hands out the output rows that are done
+// after each
+static bool decode_scan(JpegDecoder *d, int scale, JpegRowsCallback rows,
+                        void *user) {
+  int n = d->block_pixels;
+  int mcu_width = 8 * d->h_max, mcu_height = 8 * d->v_max;
+  int mcus_x = (d->width + mcu_width - 1) / mcu_width;
+  int mcus_y = (d->height + mcu_height - 1) / mcu_height;
+
+  // a single component scan isn't interleaved: its blocks just cover the
+  // image, without being grouped into mcus
+  bool single = d->component_count == 1;
+  if (single) {
+    d->components[0].h = d->components[0].v = 1;
+    mcus_x = (d->width + 7) / 8;
+    mcus_y = (d->height + 7) / 8;
+  }
+
+  for (int i = 0; i < d->component_count; i++) {
+    JpegComponent *c = &d->components[i];
+    c->plane_width = mcus_x * c->h * n;
+    c->plane_height = mcus_y * c->v * n;
+    c->plane_top = -JPEG_CARRY_ROWS;
+    c->plane = RL_MALLOC((size_t)c->plane_width *
+                         (JPEG_CARRY_ROWS + c->v * n));
+  }
+
+  int width = (d->width + scale - 1) / scale;
+  int height = (d->height + scale - 1) / scale;
+  int batch = single ? n : d->v_max * n;
+  Color *pixels = RL_MALLOC((size_t)width * batch * sizeof(Color));
+  int done = 0;
+
+  float block[64];
+  int restarts_left = d->restart_interval;
+  bool ok = true;
+  for (int my = 0; ok && my < mcus_y; my++) {
+    // the last rows of the previous mcu row move up to make room
+    for (int i = 0; my > 0 && i < d->component_count; i++) {
+      JpegComponent *c = &d->components[i];
+      memmove(c->plane, c->plane + c->v * n * c->plane_width,
+              (size_t)JPEG_CARRY_ROWS * c->plane_width);
+      c->plane_top += c->v * n;
+    }
+
+    for (int mx = 0; ok && mx < mcus_x; mx++) {
+      if (d->restart_interval && restarts_left-- == 0) {
+        ok = restart(d);
+        restarts_left = d->restart_interval - 1;
+      }
+      for (int i = 0; ok && i < d->component_count; i++) {
+        JpegComponent *c = &d->components[i];
+        for (int v = 0; ok && v < c->v; v++)
+          for (int h = 0; ok && h < c->h; h++) {
+            ok = decode_block(d, c, block);
+            unsigned char *out = c->plane +
+                                 (JPEG_CARRY_ROWS + v * n) * c->plane_width +
+                                 (mx * c->h + h) * n;
+            if (ok)
+              idct_block(d, block, out, c->plane_width);
+          }
+      }
+    }
+
+    int ready = done;
+    while (ok && ready < height &&
+           (my == mcus_y - 1 || row_decoded(d, ready, my + 1)))
+      ready++;
+    while (ok && done < ready) {
+      int count = ready - done < batch ? ready - done : batch;
+      for (int y = 0; y < count; y++)
+        convert_row(d, done + y, pixels + (size_t)y * width, width);
+      ok = rows(user, pixels, done, count);
+      done += count;
+    }
+  }
+  RL_FREE(pixels);
+  return ok;
+}
+
+static void free_planes(JpegDecoder *d) {
+  for (int i = 0; i < d->component_count; i++)
+    RL_FREE(d->components[i].plane);
+}
+
+// the C(u) / 2 of the idct folded into the cosines, so a 2d transform is
+// just two matrix products. averaging an 8 point cosine over groups of
+// `scale` pixels gives the n point one times sin(scale u pi / 16) /
+// (scale sin(u pi / 16)), with that factor in as well the result matches a
+// box filtered full size decode, like the pipeline's own mip levels
+static void build_idct(JpegDecoder *d) {
+  int n = d->block_pixels, scale = 8 / n;
+  for (int u = 0; u < n; u++) {
+    float average = u == 0 ? 1
+                           : sinf(scale * u * PI / 16) /
+                                 (scale * sinf(u * PI / 16));
+    float weight = (u == 0 ? sqrtf(0.5f) : 1) / 2 * average;
+    for (int x = 0; x < n; x++)
+      d->idct[x][u] = weight * cosf((2 * x + 1) * u * PI / (2 * n));
+  }
+}
+
+// walks the segments up to a frame header, or up to and including the scan
+// header when decoding
+static int walk_segments(JpegDecoder *d, bool decode) {
+  if (d->size < 4 || d->data[0] != 0xFF || d->data[1] != 0xD8)
+    return -1;
+
+  int pos = 2;
+  while (pos + 4 <= d->size) {
+    if (d->data[pos] != 0xFF)
+      return -1;
+    int marker = d->data[pos + 1];
+    if (marker == 0xFF) {
+      // fill byte
+      pos++;
+      continue;
+    }
+    int length = read_be16(d->data + pos + 2) - 2;
+    const unsigned char *p = d->data + pos + 4;
+    if (length < 0 || pos + 4 + length > d->size)
+      return -1;
+
+    bool ok = true;
+    if (marker == 0xC0 || marker == 0xC1) {
+      ok = read_sof(d, p, length);
+      if (!decode)
+        return ok ? 0 : -1;
+    } else if ((marker & 0xF0) == 0xC0 && marker != 0xC4 && marker != 0xC8 &&
+               marker != 0xCC) {
+      // progressive, lossless, arithmetic coded. the size is still useful
+      if (decode || length < 5)
+        return -1;
+      d->height = read_be16(p + 1);
+      d->width = read_be16(p + 3);
+      return 0;
+    } else if (marker == 0xDB) {
+      ok = read_dqt(d, p, length);
+    } else if (marker == 0xC4) {
+      ok = read_dht(d, p, length);
+    } else if (marker == 0xDD) {
+      ok = length >= 2;
+      if (ok)
+        d->restart_interval = read_be16(p);
+    } else if (marker == 0xEE) {
+      if (length >= 12 && memcmp(p, "Adobe", 5) == 0)
+        d->adobe_transform = p[11];
+    } else if (marker == 0xDA) {
+      if (!d->has_frame || !read_scan(d, p, length))
+        return -1;
+      return pos + 4 + length;
+    } else if (marker == 0xD9) {
+      return -1;
+    }
+    if (!ok)
+      return -1;
+    pos += 4 + length;
+  }
+  return -1;
+}
+
+bool jpeg_read_size(const unsigned char *data, int size, int *width,
+                    int *height) {
+  JpegDecoder d = {.data = data, .size = size};
+  if (walk_segments(&d, false) < 0 || d.width == 0 || d.height == 0)
+    return false;
+  *width = d.width;
+  *height = d.height;
+  return true;
+}
+
+bool jpeg_decode_rows(const unsigned char *data, int size, int scale,
+                      JpegRowsCallback rows, void *user) {
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+    return false;
+
+  // too big for the stack with all its tables
+  JpegDecoder *d = RL_CALLOC(1, sizeof(JpegDecoder));
+  d->data = data;
+  d->size = size;
+  d->adobe_transform = 1;
+  d->block_pixels = 8 / scale;
+  build_idct(d);
+
+  bool ok = false;
+  int scan = walk_segments(d, true);
+  if (scan >= 0) {
+    d->pos = scan;
+    ok = decode_scan(d, scale, rows, user);
+    free_planes(d);
+  }
+  RL_FREE(d);
+  return ok;
+}
+
+static bool copy_rows(void *user, const Color *rows, int y, int count) {
+  Image *image = user;
+  memcpy((Color *)image->data + (size_t)y * image->width, rows,
+         (size_t)count * image->width * sizeof(Color));
+  return true;
+}
+
+Image jpeg_decode_scaled(const unsigned char *data, int size, int scale) {
+  int width, height;
+  if ((scale != 1 && scale != 2 && scale != 4 && scale != 8) ||
+      !jpeg_read_size(data, size, &width, &height))
+    return (Image){0};
+  width = (width + scale - 1) / scale;
+  height = (height + scale - 1) / scale;
+  Image image = {RL_MALLOC((size_t)width * height * sizeof(Color)), width,
+                 height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  if (!jpeg_decode_rows(data, size, scale, copy_rows, &image)) {
+    RL_FREE(image.data);
+    return (Image){0};
+  }
+  return image;
+}
+
+#endif // JPEG_SCALED_IMPLEMENTATION
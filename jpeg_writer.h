@@ -0,0 +1,474 @@
+/*
+ * jpeg_writer.h - streaming baseline jpeg encoder
+ *
+ * usage:
+ *   #define JPEG_WRITER_IMPLEMENTATION
+ *   #include "jpeg_writer.h"
+ *
+ *   JpegWriter *jpeg = jpeg_writer_open("out.jpg", width, height, 90);
+ *   while (...)
+ *     jpeg_writer_write_rows(jpeg, rows, count);
+ *   bool ok = jpeg_writer_close(jpeg);
+ *
+ * rows are collected into rows of 16x16 mcus (4:2:0, the standard tables
+ * from annex k scaled by quality the way libjpeg does it). every mcu row is
+ * its own restart interval, so the dc predictions start over with each one
+ * and a batch of mcu rows can be encoded on every core at once. they're
+ * written out in order with an rst marker between them. alpha is dropped.
+ */
+
+#include "raylib.h"
+
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include <stdbool.h>
+
+typedef struct JpegWriter JpegWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// quality is 1 to 100, NULL if the file can't be created
+JpegWriter *jpeg_writer_open(const char *path, int width, int height,
+                             int quality);
+// count rows of width pixels each, packed one after the other
+bool jpeg_writer_write_rows(JpegWriter *jpeg, const Color *rows, int count);
+// writes whatever is left, frees the writer. false if anything failed along
+// the way, including rows missing
+bool jpeg_writer_close(JpegWriter *jpeg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JPEG_WRITER_H
+
+/*
+ * JPEG_WRITER IMPLEMENTATION
+ */
+#if defined(JPEG_WRITER_IMPLEMENTATION)
+
+#include "tile_pool.h"
+
+#include <math.h>   // Required for: cosf(), sqrtf(), lrintf()
+#include <stdio.h>  // Required for: fopen(), fwrite(), fclose()
+#include <stdlib.h> // Required for: malloc(), calloc(), realloc(), free()
+#include <string.h> // Required for: memcpy()
+
+#define JPEG_MCU_SIZE 16
+#define JPEG_MCU_ROWS_PER_THREAD 4
+
+typedef struct {
+  unsigned short code[256];
+  unsigned char size[256];
+} EncoderTable;
+
+// one mcu row worth of entropy coded data
+typedef struct {
+  unsigned char *data;
+  int size, capacity;
+  unsigned int bits;
+  int bit_count;
+} JpegBits;
+
+struct JpegWriter {
+  FILE *file;
+  int width, height;
+  int rows_written;
+  bool failed;
+
+  int mcus_per_row;
+  int mcu_rows_written;
+  int batch_mcu_rows;
+  Color *rows;
+  int pending_rows;
+
+  // natural order, divisors are 1 / quantizer
+  float divisors[2][64];
+  unsigned char quant[2][64];
+  float dct[8][8];
+  EncoderTable dc[2], ac[2];
+};
+
+//------------------------------------------------------------------------------
+// tables
+//------------------------------------------------------------------------------
+static const unsigned char encoder_zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+static const unsigned char base_quant[2][64] = {
+    {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+     14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+     18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+     49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99},
+    {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+     24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+     99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+     99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99}};
+
+static const unsigned char dc_counts[2][16] = {
+    {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+    {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0}};
+static const unsigned char dc_symbols[12] = {0, 1, 2, 3, 4,  5,
+                                             6, 7, 8, 9, 10, 11};
+
+static const unsigned char ac_counts[2][16] = {
+    {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D},
+    {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77}};
+static const unsigned char ac_symbols[2][162] = {
+    {0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+     0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+     0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72,
+     0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+     0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45,
+     0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+     0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75,
+     0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+     0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3,
+     0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+     0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9,
+     0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+     0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4,
+     0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA},
+    {0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+     0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+     0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0, 0x15, 0x62, 0x72, 0xD1,
+     0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+     0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44,
+     0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+     0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74,
+     0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+     0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A,
+     0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+     0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7,
+     0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+     0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4,
+     0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA}};
+
+// canonical codes from the counts per length, like the decoder builds them
+static void build_encoder_table(EncoderTable *table,
+                                const unsigned char *counts,
+                                const unsigned char *symbols) {
+  int code = 0, k = 0;
+  for (int length = 1; length <= 16; length++) {
+    for (int i = 0; i < counts[length - 1]; i++, k++) {
+      table->code[symbols[k]] = code++;
+      table->size[symbols[k]] = length;
+    }
+    code <<= 1;
+  }
+}
+
+//------------------------------------------------------------------------------
+// entropy coding
+//------------------------------------------------------------------------------
+static void emit_byte(JpegBits *b, unsigned char byte) {
+  // room for the byte and its stuffing
+  if (b->size + 2 > b->capacity) {
+    b->capacity = b->capacity ? b->capacity * 2 : 4096;
+    b->data = realloc(b->data, b->capacity);
+  }
+  b->data[b->size++] = byte;
+  if (byte == 0xFF)
+    b->data[b->size++] = 0;
+}
+
+static void emit_bits(JpegBits *b, unsigned int value, int count) {
+  b->bits = b->bits << count | (value & ((1u << count) - 1));
+  b->bit_count += count;
+  while (b->bit_count >= 8) {
+    b->bit_count -= 8;
+    emit_byte(b, b->bits >> b->bit_count);
+  }
+}
+
+// the end of a restart interval is padded with ones
+static void pad_bits(JpegBits *b) {
+  if (b->bit_count > 0)
+    emit_bits(b, 0x7F, 8 - b->bit_count);
+}
+
+static int magnitude_bits(int value) {
+  int magnitude = value < 0 ? -value : value, count = 0;
+  while (magnitude) {
+    count++;
+    magnitude >>= 1;
+  }
+  return count;
+}
+
+// negative values go out as their ones' complement in count bits
+static void emit_value(JpegBits *b, int value, int count) {
+  emit_bits(b, value < 0 ? value - 1 : value, count);
+}
+
+static void encode_block(const JpegWriter *jpeg, JpegBits *b,
+                         const float *samples, int table, int *dc) {
+  // separable float dct, dct[u][x] already holds the 1/2 c(u) factor
+  float rows[64], coefficients[64];
+  for (int y = 0; y < 8; y++)
+    for (int u = 0; u < 8; u++) {
+      float sum = 0;
+      for (int x = 0; x < 8; x++)
+        sum += jpeg->dct[u][x] * samples[y * 8 + x];
+      rows[y * 8 + u] = sum;
+    }
+  for (int v = 0; v < 8; v++)
+    for (int u = 0; u < 8; u++) {
+      float sum = 0;
+      for (int y = 0; y < 8; y++)
+        sum += jpeg->dct[v][y] * rows[y * 8 + u];
+      coefficients[v * 8 + u] = sum;
+    }
+
+  int quantized[64];
+  for (int k = 0; k < 64; k++) {
+    int position = encoder_zigzag[k];
+    quantized[k] =
+        (int)lrintf(coefficients[position] * jpeg->divisors[table][position]);
+  }
+
+  int difference = quantized[0] - *dc;
+  *dc = quantized[0];
+  int count = magnitude_bits(difference);
+  emit_bits(b, jpeg->dc[table].code[count], jpeg->dc[table].size[count]);
+  emit_value(b, difference, count);
+
+  const EncoderTable *ac = &jpeg->ac[table];
+  int run = 0;
+  for (int k = 1; k < 64; k++) {
+    if (quantized[k] == 0) {
+      run++;
+      continue;
+    }
+    for (; run >= 16; run -= 16)
+      emit_bits(b, ac->code[0xF0], ac->size[0xF0]);
+    count = magnitude_bits(quantized[k]);
+    int symbol = run << 4 | count;
+    emit_bits(b, ac->code[symbol], ac->size[symbol]);
+    emit_value(b, quantized[k], count);
+    run = 0;
+  }
+  if (run > 0)
+    emit_bits(b, ac->code[0], ac->size[0]);
+}
+
+//------------------------------------------------------------------------------
+// mcu rows
+//------------------------------------------------------------------------------
+typedef struct {
+  JpegWriter *jpeg;
+  JpegBits *rows;
+} EncodeJob;
+
+// one 16 row strip of the batch. the image's right and bottom edges are
+// repeated to fill the last mcus
+static void encode_mcu_row(void *user, Tile tile) {
+  EncodeJob *job = user;
+  JpegWriter *jpeg = job->jpeg;
+  JpegBits *b = &job->rows[tile.y0];
+  int first_row = tile.y0 * JPEG_MCU_SIZE;
+  int last_row = jpeg->pending_rows - 1;
+
+  int dc[3] = {0, 0, 0};
+  for (int mcu = 0; mcu < jpeg->mcus_per_row; mcu++) {
+    float y_plane[JPEG_MCU_SIZE * JPEG_MCU_SIZE];
+    float cb[64] = {0}, cr[64] = {0};
+    for (int y = 0; y < JPEG_MCU_SIZE; y++) {
+      int row = first_row + y < last_row ? first_row + y : last_row;
+      const Color *line = jpeg->rows + (size_t)row * jpeg->width;
+      for (int x = 0; x < JPEG_MCU_SIZE; x++) {
+        int column = mcu * JPEG_MCU_SIZE + x;
+        Color c = line[column < jpeg->width ? column : jpeg->width - 1];
+        y_plane[y * JPEG_MCU_SIZE + x] =
+            0.299f * c.r + 0.587f * c.g + 0.114f * c.b - 128;
+        // chroma is the average of each 2x2
+        int half = (y / 2) * 8 + x / 2;
+        cb[half] += 0.25f * (-0.168736f * c.r - 0.331264f * c.g + 0.5f * c.b);
+        cr[half] += 0.25f * (0.5f * c.r - 0.418688f * c.g - 0.081312f * c.b);
+      }
+    }
+
+    for (int block = 0; block < 4; block++) {
+      float samples[64];
+      int bx = (block & 1) * 8, by = (block >> 1) * 8;
+      for (int y = 0; y < 8; y++)
+        memcpy(samples + y * 8, y_plane + (by + y) * JPEG_MCU_SIZE + bx,
+               8 * sizeof(float));
+      encode_block(jpeg, b, samples, 0, &dc[0]);
+    }
+    encode_block(jpeg, b, cb, 1, &dc[1]);
+    encode_block(jpeg, b, cr, 1, &dc[2]);
+  }
+  pad_bits(b);
+}
+
+static void write_bytes(JpegWriter *jpeg, const void *data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, jpeg->file) != size)
+    jpeg->failed = true;
+}
+
+static void flush_mcu_rows(JpegWriter *jpeg) {
+  int count = (jpeg->pending_rows + JPEG_MCU_SIZE - 1) / JPEG_MCU_SIZE;
+  JpegBits *rows = calloc(count ? count : 1, sizeof(JpegBits));
+  EncodeJob job = {jpeg, rows};
+  tile_pool_run(tile_pool_shared(), 0, 0, 1, count, 1, 1, encode_mcu_row,
+                &job);
+
+  for (int i = 0; i < count; i++) {
+    if (jpeg->mcu_rows_written > 0) {
+      unsigned char marker[2] = {0xFF, 0xD0 + (jpeg->mcu_rows_written - 1) % 8};
+      write_bytes(jpeg, marker, 2);
+    }
+    write_bytes(jpeg, rows[i].data, rows[i].size);
+    jpeg->mcu_rows_written++;
+    free(rows[i].data);
+  }
+  free(rows);
+  jpeg->pending_rows = 0;
+}
+
+//------------------------------------------------------------------------------
+// headers
+//------------------------------------------------------------------------------
+static void write_segment(JpegWriter *jpeg, int marker,
+                          const unsigned char *data, int size) {
+  unsigned char header[4] = {0xFF, marker, (size + 2) >> 8, (size + 2) & 0xFF};
+  write_bytes(jpeg, header, 4);
+  write_bytes(jpeg, data, size);
+}
+
+static void write_headers(JpegWriter *jpeg) {
+  static const unsigned char soi[2] = {0xFF, 0xD8};
+  write_bytes(jpeg, soi, 2);
+
+  static const unsigned char jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1,
+                                         0,   0,   1,   0,   1, 0, 0};
+  write_segment(jpeg, 0xE0, jfif, sizeof(jfif));
+
+  unsigned char dqt[2 * 65];
+  for (int t = 0; t < 2; t++) {
+    dqt[t * 65] = t;
+    for (int k = 0; k < 64; k++)
+      dqt[t * 65 + 1 + k] = jpeg->quant[t][encoder_zigzag[k]];
+  }
+  write_segment(jpeg, 0xDB, dqt, sizeof(dqt));
+
+  // y is sampled 2x2, cb and cr once per mcu
+  unsigned char sof[15] = {8,
+                           jpeg->height >> 8,
+                           jpeg->height & 0xFF,
+                           jpeg->width >> 8,
+                           jpeg->width & 0xFF,
+                           3,
+                           1, 0x22, 0,
+                           2, 0x11, 1,
+                           3, 0x11, 1};
+  write_segment(jpeg, 0xC0, sof, sizeof(sof));
+
+  unsigned char dht[4 * 17 + 2 * 12 + 2 * 162];
+  int size = 0;
+  for (int t = 0; t < 2; t++) {
+    dht[size++] = t;
+    memcpy(dht + size, dc_counts[t], 16);
+    memcpy(dht + size + 16, dc_symbols, 12);
+    size += 16 + 12;
+    dht[size++] = 0x10 | t;
+    memcpy(dht + size, ac_counts[t], 16);
+    memcpy(dht + size + 16, ac_symbols[t], 162);
+    size += 16 + 162;
+  }
+  write_segment(jpeg, 0xC4, dht, size);
+
+  unsigned char dri[2] = {jpeg->mcus_per_row >> 8, jpeg->mcus_per_row & 0xFF};
+  write_segment(jpeg, 0xDD, dri, 2);
+
+  static const unsigned char sos[10] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+  write_segment(jpeg, 0xDA, sos, sizeof(sos));
+}
+
+//------------------------------------------------------------------------------
+// api
+//------------------------------------------------------------------------------
+JpegWriter *jpeg_writer_open(const char *path, int width, int height,
+                             int quality) {
+  // the frame header only has 16 bits for each, as does the restart interval
+  if (width <= 0 || height <= 0 || width > 65535 || height > 65535)
+    return NULL;
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return NULL;
+
+  JpegWriter *jpeg = calloc(1, sizeof(JpegWriter));
+  jpeg->file = file;
+  jpeg->width = width;
+  jpeg->height = height;
+  jpeg->mcus_per_row = (width + JPEG_MCU_SIZE - 1) / JPEG_MCU_SIZE;
+  jpeg->batch_mcu_rows = JPEG_MCU_ROWS_PER_THREAD *
+                         tile_pool_thread_count(tile_pool_shared());
+  jpeg->rows = malloc((size_t)jpeg->batch_mcu_rows * JPEG_MCU_SIZE * width *
+                      sizeof(Color));
+
+  quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+  int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+  for (int u = 0; u < 8; u++)
+    for (int x = 0; x < 8; x++)
+      jpeg->dct[u][x] = (u == 0 ? sqrtf(0.5f) : 1) * 0.5f *
+                        cosf((2 * x + 1) * u * PI / 16);
+  for (int t = 0; t < 2; t++) {
+    for (int i = 0; i < 64; i++) {
+      int value = (base_quant[t][i] * scale + 50) / 100;
+      value = value < 1 ? 1 : value > 255 ? 255 : value;
+      jpeg->quant[t][i] = value;
+      jpeg->divisors[t][i] = 1.0f / value;
+    }
+    build_encoder_table(&jpeg->dc[t], dc_counts[t], dc_symbols);
+    build_encoder_table(&jpeg->ac[t], ac_counts[t], ac_symbols[t]);
+  }
+
+  write_headers(jpeg);
+  return jpeg;
+}
+
+bool jpeg_writer_write_rows(JpegWriter *jpeg, const Color *rows, int count) {
+  if (jpeg->rows_written + count > jpeg->height)
+    jpeg->failed = true;
+  int batch_rows = jpeg->batch_mcu_rows * JPEG_MCU_SIZE;
+  while (count > 0 && !jpeg->failed) {
+    int room = batch_rows - jpeg->pending_rows;
+    int take = count < room ? count : room;
+    memcpy(jpeg->rows + (size_t)jpeg->pending_rows * jpeg->width, rows,
+           (size_t)take * jpeg->width * sizeof(Color));
+    jpeg->pending_rows += take;
+    jpeg->rows_written += take;
+    rows += (size_t)take * jpeg->width;
+    count -= take;
+    if (jpeg->pending_rows == batch_rows)
+      flush_mcu_rows(jpeg);
+  }
+  return !jpeg->failed;
+}
+
+bool jpeg_writer_close(JpegWriter *jpeg) {
+  if (jpeg->rows_written != jpeg->height)
+    jpeg->failed = true;
+  if (!jpeg->failed) {
+    if (jpeg->pending_rows > 0)
+      flush_mcu_rows(jpeg);
+    static const unsigned char eoi[2] = {0xFF, 0xD9};
+    write_bytes(jpeg, eoi, 2);
+  }
+  bool ok = !jpeg->failed;
+  if (fclose(jpeg->file) != 0)
+    ok = false;
+  free(jpeg->rows);
+  free(jpeg);
+  return ok;
+}
+
+#endif // JPEG_WRITER_IMPLEMENTATION
@@ -1,7 +1,15 @@
+// the tile cache, the file dialog and the workers use posix and gnu calls
+// (mmap, madvise, mkstemp, pwrite, fstatat, strdup) that a strict -std=c11
+// hides. it has to come before the first system header
+#define _GNU_SOURCE
+
+#include <errno.h>
 #include <math.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,10 +20,76 @@
 #define GUI_WINDOW_FILE_DIALOG_IMPLEMENTATION
 #include "gui_window_file_dialog.h"
 
-typedef struct {
-  char *text;
-  Vector2 position;
-} TextObject;
+#define BLUR_IMPLEMENTATION
+#include "blur.h"
+#undef BLUR_IMPLEMENTATION
+
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
+#undef PROFILER_IMPLEMENTATION
+
+#define TILE_POOL_IMPLEMENTATION
+#include "tile_pool.h"
+#undef TILE_POOL_IMPLEMENTATION
+
+#define TILED_IMAGE_IMPLEMENTATION
+#include "tiled_image.h"
+#undef TILED_IMAGE_IMPLEMENTATION
+
+#define IMAGE_PIPELINE_IMPLEMENTATION
+#include "image_pipeline.h"
+#undef IMAGE_PIPELINE_IMPLEMENTATION
+
+#define RENDER_WORKER_IMPLEMENTATION
+#include "render_worker.h"
+#undef RENDER_WORKER_IMPLEMENTATION
+
+#define JPEG_SCALED_IMPLEMENTATION
+#include "jpeg_scaled.h"
+#undef JPEG_SCALED_IMPLEMENTATION
+
+#define IMAGE_LOADER_IMPLEMENTATION
+#include "image_loader.h"
+#undef IMAGE_LOADER_IMPLEMENTATION
+
+#define THUMBNAIL_CACHE_IMPLEMENTATION
+#include "thumbnail_cache.h"
+#undef THUMBNAIL_CACHE_IMPLEMENTATION
+
+#define DEFLATE_IMPLEMENTATION
+#include "deflate.h"
+#undef DEFLATE_IMPLEMENTATION
+
+#define PNG_WRITER_IMPLEMENTATION
+#include "png_writer.h"
+#undef PNG_WRITER_IMPLEMENTATION
+
+#define JPEG_WRITER_IMPLEMENTATION
+#include "jpeg_writer.h"
+#undef JPEG_WRITER_IMPLEMENTATION
+
+#define IMAGE_EXPORT_IMPLEMENTATION
+#include "image_export.h"
+#undef IMAGE_EXPORT_IMPLEMENTATION
+
+#define BATCH_IMPLEMENTATION
+#include "batch.h"
+#undef BATCH_IMPLEMENTATION
+
+#define EDIT_JOURNAL_IMPLEMENTATION
+#include "edit_journal.h"
+#undef EDIT_JOURNAL_IMPLEMENTATION
+
+#define RECIPE_IMPLEMENTATION
+#include "recipe.h"
+#undef RECIPE_IMPLEMENTATION
+
+#define TEXTURE_SYNC_IMPLEMENTATION
+#include "texture_sync.h"
+#undef TEXTURE_SYNC_IMPLEMENTATION
+
+#define GPU_EFFECTS_IMPLEMENTATION
+#include "gpu_effects.h"
 
 typedef struct {
   TextObject *buffer;
@@ -26,9 +100,18 @@ typedef struct {
 
 // intermediate image object type declaration
 typedef struct {
-  Image image;
-  Image img_copy;
+  // the original, in copy-on-write tiles
+  TiledImage image;
+  // last preview handed back by the worker, what canvas.texture shows
+  Image preview;
+  RenderWorker *worker;
+  // decodes newly opened files off the main thread
+  ImageLoader *loader;
+  // file the image came from, and the one the loader is busy with
   char *path;
+  char *loading_path;
+  // the save running in the background, NULL when there is none
+  ImageExport *export_job;
   char *extension;
   bool isLoaded;
   bool snap_pixels;
@@ -36,6 +119,10 @@ typedef struct {
   float blur_intensity;
   float brightness_intensity;
   TextAllocator text_allocator;
+  // undo history, decides which texts and values are current
+  EditJournal journal;
+  // the journal changed since the image was opened or its sidecar written
+  bool edited;
 } ImageObject;
 
 typedef struct {
@@ -62,13 +149,25 @@ void info_dialog(bool *draw);
 void error_dialog(bool *draw,
                   char *message); // issue with error dialog. TODO: fix later
 void load_new_image(ImageObject *image, char *filename);
-
-void load_texture(ImageObject *image);
+void finish_loading_image(ImageObject *image, TiledImage loaded);
+void save_image(ImageObject *image);
+void save_sidecar(ImageObject *image);
+void restore_sidecar(ImageObject *image);
+int run_batch(int argc, char **argv);
+void batch_usage(const char *program);
+bool parse_memory_cap(const char *text, size_t *cap);
+
+void load_texture(ImageObject *image, Image previous);
+void apply_gpu_effects(ImageObject *image);
 void handle_dynamic_canvas_resizing(ImageObject *image);
 PosSize set_dynamic_position(float x, float y, float width, float height);
 Rectangle set_dynamic_position_rect(float x, float y, float width,
                                     float height);
 void update_and_reflect_image_changes(ImageObject *image);
+Rectangle context_region(void);
+Rectangle region_to_context(Rectangle region);
+void record_edit(ImageObject *image, EditKind kind, float value, bool merge);
+void restore_edit_state(ImageObject *image, EditState before);
 TextAllocator new_text_allocator(int capacity);
 void append_to_text_allocator(TextAllocator *alloc, TextObject tobject);
 void handle_context_state(ImageObject *image);
@@ -76,10 +175,24 @@ void handle_context_state(ImageObject *image);
 
 // there should be only one instance of the canvas, this canvas.
 CustomCanvas canvas = {{0}};
+// rows of partial texture uploads get gathered here
+TextureStaging canvas_staging = {0};
+// blur and brightness as shaders, only used when started with --gpu
+GpuEffects gpu = {0};
+// baseline jpegs bigger than this are edited out of a mapped cache file, and
+// only this much of that file stays in memory. other images that big aren't
+// opened. --memory-cap <megabytes>
+size_t memory_cap = (size_t)1024 << 20;
+
+int main(int argc, char **argv) {
+  // headless, no window and no editor state
+  if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+    return run_batch(argc, argv);
 
-int main() {
   ImageObject image = {0};
   image.text_allocator = new_text_allocator(2);
+  image.worker = render_worker_create();
+  image.loader = image_loader_create();
   bool close_window = false;
   bool draw_window_close_confirm_dialog = false;
   bool draw_info_dialog = false;
@@ -89,13 +202,31 @@ int main() {
   char error_message[1024] = {0};
   float last_blur_change = 0.f;
   float last_brightness_change = 0.f;
+  // set while a drag of that slider goes on, its changes merge into one step
+  bool blur_dragging = false;
+  bool brightness_dragging = false;
   bool last_pixel_snap_change = false;
+  Rectangle last_context = {0};
+  float average_frame_time = 1 / 60.f;
+  // what the loader has to show of the file it's loading so far, a
+  // thumbnail or a quick small decode. stands in until it's done
+  Texture2D thumbnail_texture = {0};
 
   InitWindow(700, 500, "Daisy v0.1");
   SetTargetFPS(60);
 
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--gpu") == 0)
+      gpu_effects_init(&gpu);
+    else if (strcmp(argv[i], "--memory-cap") == 0 && i + 1 < argc &&
+             !parse_memory_cap(argv[++i], &memory_cap))
+      fprintf(stderr, "ignoring --memory-cap %s, it takes megabytes\n",
+              argv[i]);
+  }
+
   GuiWindowFileDialogState file_dialog_state =
       InitGuiWindowFileDialog(GetWorkingDirectory());
+  file_dialog_state.thumbnailMemoryCap = memory_cap;
 
   while (!close_window) {
     canvas.size = (Vector2){GetScreenWidth() / 2.f, GetScreenHeight() / 2.f};
@@ -107,40 +238,141 @@ int main() {
     canvas.position.x = (GetScreenWidth() / 2.f) / 2.f;
     canvas.position.y = (GetScreenHeight() / 2.f) / 2.f;
 
+    // pick up whatever the loader got done since the last frame
+    Image thumbnail;
+    if (image_loader_take_thumbnail(image.loader, &thumbnail)) {
+      UnloadTexture(thumbnail_texture);
+      thumbnail_texture = LoadTextureFromImage(thumbnail);
+      UnloadImage(thumbnail);
+    }
+    TiledImage loaded;
+    if (image_loader_take_result(image.loader, &loaded)) {
+      UnloadTexture(thumbnail_texture);
+      thumbnail_texture = (Texture2D){0};
+      if (loaded.tiles) {
+        finish_loading_image(&image, loaded);
+        // the sliders now show the new image's edits, those aren't changes
+        last_blur_change = image.blur_intensity;
+        last_brightness_change = image.brightness_intensity;
+        last_pixel_snap_change = image.snap_pixels;
+        last_context = canvas.context;
+        blur_dragging = brightness_dragging = false;
+      } else {
+        strcpy(error_message, "couldn't load that image");
+        draw_error_dialog = true;
+      }
+    }
+    if (image.export_job && image_export_done(image.export_job)) {
+      if (!image_export_finish(image.export_job)) {
+        strcpy(error_message, "couldn't save the image");
+        draw_error_dialog = true;
+      }
+      image.export_job = NULL;
+    }
+
     // handling texture drawing and resizing
     if (image.isLoaded) {
-      DrawTexture(canvas.texture, canvas.position.x, canvas.position.y, WHITE);
+      // swap in whatever the render worker finished since the last frame
+      Image finished;
+      if (render_worker_poll(image.worker, &finished)) {
+        Image previous = image.preview;
+        image.preview = finished;
+        PROFILE_SCOPE(PROFILE_UPLOAD) { load_texture(&image, previous); }
+        UnloadImage(previous);
+      }
+
+      // drafts come back smaller than the canvas, stretch whatever we have
+      Rectangle canvas_rect = {canvas.position.x, canvas.position.y,
+                               canvas.size.x, canvas.size.y};
+      if (gpu.ready)
+        gpu_effects_draw(&gpu, canvas_rect);
+      else
+        DrawTexturePro(canvas.texture,
+                       (Rectangle){0, 0, canvas.texture.width,
+                                   canvas.texture.height},
+                       canvas_rect, (Vector2){0, 0}, 0, WHITE);
       if (IsWindowResized()) {
         handle_dynamic_canvas_resizing(&image);
       }
 
-      static float blur_timer = 0.f;
-      blur_timer += GetFrameTime();
-      if (image.blur_intensity != last_blur_change && blur_timer > 1.f) {
-        handle_dynamic_canvas_resizing(&image);
+      // the worker decides between a draft and a full preview based on how
+      // long we can wait for one, which is however long our frames take
+      average_frame_time = average_frame_time * 0.9f + GetFrameTime() * 0.1f;
+      render_worker_set_frame_budget(image.worker, average_frame_time);
+
+      // post as soon as a slider moves, the worker only ever renders the
+      // newest values so there is no need to hold changes back. with shaders
+      // the sliders never reach the worker, redrawing on the gpu is enough.
+      // a whole drag ends up as one step in the undo history. the sliders
+      // are drawn after this, so a change shows up a frame late and the
+      // press that started it can't be seen here: the drag starts with the
+      // first change made with the button down instead
+      if (image.blur_intensity != last_blur_change) {
+        record_edit(&image, EDIT_BLUR, image.blur_intensity, blur_dragging);
+        blur_dragging = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+        if (gpu.ready)
+          apply_gpu_effects(&image);
+        else
+          handle_dynamic_canvas_resizing(&image);
         last_blur_change = image.blur_intensity;
-        blur_timer = 0.f;
       }
 
-      static float brightness_timer = 0.f;
-      brightness_timer += GetFrameTime();
-      if (image.brightness_intensity != last_brightness_change &&
-          brightness_timer > 1.f) {
-        handle_dynamic_canvas_resizing(&image);
+      if (image.brightness_intensity != last_brightness_change) {
+        record_edit(&image, EDIT_BRIGHTNESS, image.brightness_intensity,
+                    brightness_dragging);
+        brightness_dragging = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+        if (gpu.ready)
+          apply_gpu_effects(&image);
+        else
+          handle_dynamic_canvas_resizing(&image);
         last_brightness_change = image.brightness_intensity;
-        brightness_timer = 0.f;
       }
+      if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT))
+        blur_dragging = brightness_dragging = false;
 
       if (image.snap_pixels != last_pixel_snap_change) {
+        record_edit(&image, EDIT_SNAP_PIXELS, image.snap_pixels, false);
         handle_dynamic_canvas_resizing(&image);
         last_pixel_snap_change = image.snap_pixels;
       }
+
+      // dragging the context box moves where the effects apply
+      if (memcmp(&canvas.context, &last_context, sizeof(Rectangle)) != 0) {
+        if (gpu.ready)
+          apply_gpu_effects(&image);
+        handle_dynamic_canvas_resizing(&image);
+        last_context = canvas.context;
+      }
     } else {
       GuiGrid((Rectangle){canvas.position.x, canvas.position.y, canvas.size.x,
                           canvas.size.y},
               "No Image", 10, 1, &canvas.mouseCell);
     }
 
+    // while a file loads, show its thumbnail over the canvas and how far
+    // along it is below it
+    if (image_loader_busy(image.loader)) {
+      if (thumbnail_texture.id > 0)
+        DrawTexturePro(thumbnail_texture,
+                       (Rectangle){0, 0, thumbnail_texture.width,
+                                   thumbnail_texture.height},
+                       (Rectangle){canvas.position.x, canvas.position.y,
+                                   canvas.size.x, canvas.size.y},
+                       (Vector2){0, 0}, 0, WHITE);
+      float progress = image_loader_progress(image.loader);
+      GuiProgressBar((Rectangle){canvas.position.x,
+                                 canvas.position.y + canvas.size.y + 8,
+                                 canvas.size.x, 12},
+                     NULL, "Loading", &progress, 0, 1);
+    }
+    if (image.export_job) {
+      float progress = image_export_progress(image.export_job);
+      GuiProgressBar((Rectangle){canvas.position.x,
+                                 canvas.position.y + canvas.size.y + 24,
+                                 canvas.size.x, 12},
+                     NULL, "Saving", &progress, 0, 1);
+    }
+
     if (GuiButton(set_dynamic_position_rect(1, 1, 20, 5), "#12#Open Image")) {
       file_dialog_state.windowActive = true;
     }
@@ -174,11 +406,16 @@ int main() {
       case 2:
         draw_add_text_dialog = false;
         if (image.isLoaded) {
+          // texts past the visible ones only belonged to undone edits
+          TextAllocator *texts = &image.text_allocator;
+          while (texts->index > image.journal.state.text_end)
+            free(texts->buffer[--texts->index].text);
           append_to_text_allocator(
               &image.text_allocator,
               (TextObject){strdup(add_text_dialog_text),
                            (Vector2){GetRandomValue(0, canvas.size.x),
                                      GetRandomValue(0, canvas.size.y)}});
+          record_edit(&image, EDIT_ADD_TEXT, 0, false);
 
           handle_dynamic_canvas_resizing(&image);
           strcpy(add_text_dialog_text, "");
@@ -186,30 +423,63 @@ int main() {
         break;
       }
     }
-    // undo changes button
-    if (GuiButton((Rectangle){GetScreenWidth() - 128, 1, 30, 30}, "#211#")) {
-      image.brightness_intensity = 0;
-      image.blur_intensity = 0;
-      image.snap_pixels = false;
-      free(image.text_allocator.buffer);
-      image.text_allocator = new_text_allocator(2);
-
-      if (image.isLoaded) {
-        handle_dynamic_canvas_resizing(&image);
-      }
+    // undo and redo buttons, ctrl+z and ctrl+y / ctrl+shift+z
+    EditState before = image.journal.state;
+    bool ctrl = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+    bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+    bool shortcuts = ctrl && !draw_add_text_dialog;
+    bool undo = shortcuts && !shift && IsKeyPressed(KEY_Z);
+    bool redo = shortcuts && (IsKeyPressed(KEY_Y) ||
+                              (shift && IsKeyPressed(KEY_Z)));
+
+    if (!journal_can_undo(&image.journal))
+      GuiDisable();
+    undo |= GuiButton((Rectangle){GetScreenWidth() - 192, 1, 30, 30}, "#56#");
+    GuiEnable();
+    if (!journal_can_redo(&image.journal))
+      GuiDisable();
+    redo |= GuiButton((Rectangle){GetScreenWidth() - 160, 1, 30, 30}, "#57#");
+    GuiEnable();
+
+    // undo changes button, undoable itself
+    bool reset = GuiButton((Rectangle){GetScreenWidth() - 128, 1, 30, 30},
+                           "#211#");
+    if (reset)
+      record_edit(&image, EDIT_RESET, 0, false);
+
+    if ((undo && journal_undo(&image.journal)) ||
+        (redo && journal_redo(&image.journal)) || reset) {
+      image.edited = true;
+      restore_edit_state(&image, before);
+      // already posted, don't let the change checks record these again
+      last_blur_change = image.blur_intensity;
+      last_brightness_change = image.brightness_intensity;
+      last_pixel_snap_change = image.snap_pixels;
+      last_context = canvas.context;
+      // a drag that goes on after this is a new step
+      blur_dragging = brightness_dragging = false;
     }
 
     handle_context_state(&image);
     if (IsWindowResized()) {
       canvas.context = (Rectangle){0, 0, 0, 0};
     }
-    // save button
+    // save button, one save at a time
+    if (!image.isLoaded || image.export_job)
+      GuiDisable();
     if (GuiButton((Rectangle){GetScreenWidth() - 97, 1, 30, 30}, "#2#")) {
+      save_image(&image);
+      save_sidecar(&image);
     }
+    GuiEnable();
 
-    // settings button
+    // settings button, shows what the stages and frames cost
     if (GuiButton((Rectangle){GetScreenWidth() - 65, 1, 30, 30}, "#142#")) {
+      profile_set_enabled(!profile_enabled());
     }
+    profile_frame(GetFrameTime());
+    if (profile_enabled())
+      profile_draw_overlay((Rectangle){GetScreenWidth() - 242, 34, 240, 250});
 
     // help button
     if (GuiButton((Rectangle){GetScreenWidth() - 32, 1, 30, 30}, "#193#")) {
@@ -230,12 +500,13 @@ int main() {
     // blur slider
     GuiLabel(set_dynamic_position_rect(1, 17, 15, 3), "Blur");
     GuiSlider(set_dynamic_position_rect(1, 20, 20, 5), "", "",
-              &image.blur_intensity, 0, 20);
+              &image.blur_intensity, 0, EDIT_BLUR_MAX);
 
     // brightness slider
     GuiLabel(set_dynamic_position_rect(1, 27, 15, 3), "Brightness");
     GuiSlider(set_dynamic_position_rect(1, 30, 20, 5), "", "",
-              &image.brightness_intensity, -100, 100);
+              &image.brightness_intensity, EDIT_BRIGHTNESS_MIN,
+              EDIT_BRIGHTNESS_MAX);
 
     // handling closing of application (dialog and state)
     // triggered by the WindowShouldClose() event
@@ -248,13 +519,26 @@ int main() {
     EndDrawing();
   }
 
+  // let a save in progress finish writing the file
+  if (image.export_job)
+    image_export_finish(image.export_job);
+  save_sidecar(&image);
+  image_loader_destroy(image.loader);
+  UnloadTexture(thumbnail_texture);
+  render_worker_destroy(image.worker);
   if (image.isLoaded) {
-    UnloadImage(image.image);
-    UnloadImage(image.img_copy);
+    tiled_image_free(&image.image);
+    UnloadImage(image.preview);
   }
   UnloadTexture(canvas.texture);
+  texture_staging_free(&canvas_staging);
+  gpu_effects_unload(&gpu);
+  UnloadGuiWindowFileDialog(&file_dialog_state);
   CloseWindow();
   free(image.text_allocator.buffer);
+  free(image.path);
+  free(image.loading_path);
+  journal_free(&image.journal);
   return 0;
 }
 
@@ -302,41 +586,231 @@ void handle_context_state(ImageObject *image) {
   }
 }
 
-void load_texture(ImageObject *image) {
-  UnloadTexture(canvas.texture);
-  canvas.texture = LoadTextureFromImage(image->img_copy);
+// previous is the preview the texture shows right now, only the part that
+// differs from it gets uploaded
+void load_texture(ImageObject *image, Image previous) {
+  if (gpu.ready) {
+    gpu_effects_set_layer(&gpu, image->preview, previous);
+    apply_gpu_effects(image);
+    return;
+  }
+  texture_sync(&canvas.texture, image->preview, previous, &canvas_staging);
+}
+
+// the slider radius is in source pixels, the layer is preview sized
+void apply_gpu_effects(ImageObject *image) {
+  if (image->preview.data == NULL)
+    return;
+  float scale = (float)image->preview.width / image->image.width;
+  int blur = pipeline_blur_radius(image->blur_intensity, scale);
+  gpu_effects_render(&gpu, blur, image->brightness_intensity,
+                     context_region());
 }
 
+// the new preview shows up in a later frame, once the worker is done
 void handle_dynamic_canvas_resizing(ImageObject *image) {
   update_and_reflect_image_changes(image);
-  if (image->snap_pixels) {
-    ImageResizeNN(&(image->img_copy), canvas.size.x, canvas.size.y);
-  } else {
-    ImageResize(&(image->img_copy), canvas.size.x, canvas.size.y);
-  }
-
-  load_texture(image);
 }
 
 void load_new_image(ImageObject *image, char *filename) {
   if (IsFileExtension(filename, ".png") || IsFileExtension(filename, ".jpeg") ||
       IsFileExtension(filename, ".jpg")) {
 
-    if (image->isLoaded) {
-      UnloadImage(image->image);
-      UnloadImage(image->img_copy);
-    }
-    image->image = LoadImage(filename);
-    image->img_copy = ImageCopy(image->image);
-    image->path = filename;
-    image->isLoaded = true;
-    image->initial_size = (Vector2){image->image.width, image->image.height};
-    handle_dynamic_canvas_resizing(image);
+    // decoding happens on the loader thread, the current image stays up
+    // until finish_loading_image() swaps the new one in
+    image_loader_start(image->loader, filename, memory_cap, canvas.size);
+    free(image->loading_path);
+    image->loading_path = strdup(filename);
   } else {
     // error message was causing segmentation fault so i removed it for now
   }
 }
 
+void finish_loading_image(ImageObject *image, TiledImage loaded) {
+  save_sidecar(image);
+  tiled_image_free(&image->image);
+  image->image = loaded;
+  free(image->path);
+  image->path = image->loading_path;
+  image->loading_path = NULL;
+  render_worker_set_source(image->worker, &image->image);
+  image->isLoaded = true;
+  image->initial_size = (Vector2){image->image.width, image->image.height};
+
+  // nothing of the previous image's edits carries over, whether or not the
+  // new one has a sidecar of its own
+  EditState before = image->journal.state;
+  TextAllocator *texts = &image->text_allocator;
+  while (texts->index > 0)
+    free(texts->buffer[--texts->index].text);
+  journal_free(&image->journal);
+  image->edited = false;
+  restore_sidecar(image);
+
+  // same text indices can now mean different texts
+  render_worker_invalidate(image->worker, STAGE_TEXT);
+  restore_edit_state(image, before);
+}
+
+// the edits of an image are kept next to it in <image>.daisy, so they come
+// back the next time it's opened. only opening a file never writes one
+void save_sidecar(ImageObject *image) {
+  if (!image->isLoaded || !image->edited)
+    return;
+  EditRecipe recipe = recipe_from_journal(
+      &image->journal, image->text_allocator.buffer,
+      image->text_allocator.index, image->image.width, image->image.height);
+  if (recipe_save(TextFormat("%s.daisy", image->path), &recipe))
+    image->edited = false;
+}
+
+// loads the sidecar into the empty journal and text list, the caller
+// re-renders. a sidecar made on a differently sized file doesn't belong to
+// this one
+void restore_sidecar(ImageObject *image) {
+  EditRecipe recipe;
+  if (!recipe_load(TextFormat("%s.daisy", image->path), &recipe))
+    return;
+  if ((recipe.image_width && recipe.image_width != image->image.width) ||
+      (recipe.image_height && recipe.image_height != image->image.height)) {
+    recipe_free(&recipe);
+    return;
+  }
+
+  TextAllocator *texts = &image->text_allocator;
+  for (int i = 0; i < recipe.text_count; i++)
+    append_to_text_allocator(texts,
+                             (TextObject){strdup(recipe.texts[i].text),
+                                          recipe.texts[i].position});
+  recipe_to_journal(&recipe, &image->journal);
+  recipe_free(&recipe);
+}
+
+// saves next to the original as <name>_edited with the same extension. the
+// edits are redone at full resolution on the export thread, always on the
+// cpu since the shaders only ever see the preview
+void save_image(ImageObject *image) {
+  EditState *state = &image->journal.state;
+  EditParams params = {image->text_allocator.buffer + state->text_first,
+                       state->text_end - state->text_first,
+                       image->blur_intensity,
+                       image->brightness_intensity,
+                       image->snap_pixels,
+                       canvas.size,
+                       context_region()};
+  const char *path = TextFormat(
+      "%s" PATH_SEPERATOR "%s_edited%s", GetDirectoryPath(image->path),
+      GetFileNameWithoutExt(image->path), GetFileExtension(image->path));
+  image->export_job = image_export_start(&image->image, params, path);
+}
+
+void batch_usage(const char *program) {
+  fprintf(stderr, "usage: %s --batch <input dir> <output dir> [--recipe "
+                  "<file>] [--blur <radius>] [--brightness <amount>] "
+                  "[--text <x> <y> <text>]... [--jobs <decoders>] "
+                  "[--memory-cap <megabytes>] [--overwrite]\n",
+          program);
+}
+
+// a whole number of megabytes above 0, anything else leaves cap alone
+bool parse_memory_cap(const char *text, size_t *cap) {
+  char *end;
+  errno = 0;
+  long megabytes = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno == ERANGE || megabytes <= 0 ||
+      (unsigned long)megabytes > SIZE_MAX >> 20)
+    return false;
+  *cap = (size_t)megabytes << 20;
+  return true;
+}
+
+// ./app --batch <input dir> <output dir> [--recipe <file>] [--blur <radius>]
+//   [--brightness <amount>] [--text <x> <y> <text>]... [--jobs <decoders>]
+//   [--memory-cap <megabytes>] [--overwrite]
+// the flags apply in order, so they can change a recipe's values
+int run_batch(int argc, char **argv) {
+  if (argc < 4) {
+    batch_usage(argv[0]);
+    return 1;
+  }
+
+  BatchRecipe recipe = {0};
+  TextAllocator texts = new_text_allocator(2);
+  // the loaded recipe's texts point into it, it has to outlive the batch
+  EditRecipe loaded = {0};
+  int jobs = 0;
+  bool overwrite = false;
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--recipe") == 0 && i + 1 < argc) {
+      recipe_free(&loaded);
+      if (!recipe_load(argv[++i], &loaded)) {
+        fprintf(stderr, "can't read the recipe %s\n", argv[i]);
+        free(texts.buffer);
+        return 1;
+      }
+      // what the editor showed when it was saved
+      EditJournal journal = {0};
+      recipe_to_journal(&loaded, &journal);
+      EditState state = journal.state;
+      journal_free(&journal);
+      recipe.blur_intensity = state.blur;
+      recipe.brightness_intensity = state.brightness;
+      recipe.region = state.region;
+      texts.index = 0;
+      for (int t = state.text_first; t < state.text_end; t++)
+        append_to_text_allocator(&texts, loaded.texts[t]);
+    } else if (strcmp(argv[i], "--blur") == 0 && i + 1 < argc)
+      recipe.blur_intensity = atof(argv[++i]);
+    else if (strcmp(argv[i], "--brightness") == 0 && i + 1 < argc)
+      recipe.brightness_intensity = atof(argv[++i]);
+    else if (strcmp(argv[i], "--text") == 0 && i + 3 < argc) {
+      Vector2 position = {atof(argv[i + 1]), atof(argv[i + 2])};
+      append_to_text_allocator(&texts, (TextObject){argv[i + 3], position});
+      i += 3;
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--memory-cap") == 0 && i + 1 < argc) {
+      if (!parse_memory_cap(argv[++i], &memory_cap)) {
+        fprintf(stderr, "--memory-cap takes a number of megabytes\n");
+        batch_usage(argv[0]);
+        free(texts.buffer);
+        recipe_free(&loaded);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--overwrite") == 0)
+      overwrite = true;
+    else
+      fprintf(stderr, "ignoring %s\n", argv[i]);
+  }
+  recipe.texts = texts.buffer;
+  recipe.text_count = texts.index;
+
+  // raylib's default font is only built along with a window, so texts get a
+  // hidden one. without a display nothing is written, every output would be
+  // missing its text
+  if (recipe.text_count > 0) {
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(1, 1, "Daisy");
+    if (!IsWindowReady()) {
+      fprintf(stderr, "texts need a display, nothing was written\n");
+      free(texts.buffer);
+      recipe_free(&loaded);
+      return 1;
+    }
+  }
+
+  int failed =
+      batch_run(argv[2], argv[3], recipe, jobs, memory_cap, overwrite);
+  if (failed < 0)
+    fprintf(stderr, "can't use %s or %s\n", argv[2], argv[3]);
+
+  if (IsWindowReady())
+    CloseWindow();
+  free(texts.buffer);
+  recipe_free(&loaded);
+  return failed == 0 ? 0 : 1;
+}
+
 void error_dialog(bool *draw, char *message) {
   Rectangle rect = {(GetScreenWidth() / 2.f) - 120,
                     (GetScreenHeight() / 2.f) - 50, 270, 150};
@@ -416,17 +890,68 @@ Rectangle set_dynamic_position_rect(float x, float y, float width,
   return (Rectangle){e.x, e.y, e.width, e.height};
 }
 
+// hands the current edits to the render worker, which only redoes the
+// stages affected by what changed since its last render. on the gpu path
+// the worker only draws the texts and scales, the shaders do the rest
 void update_and_reflect_image_changes(ImageObject *image) {
-  UnloadImage(image->img_copy);
-  image->img_copy = ImageCopy(image->image);
-  for (int i = 0; i < image->text_allocator.index; i++) {
-    TextObject current = image->text_allocator.buffer[i];
-    ImageDrawText(&image->img_copy, current.text, current.position.x,
-                  current.position.y, 40, BLACK);
-  }
+  EditState *state = &image->journal.state;
+  EditParams params = {image->text_allocator.buffer + state->text_first,
+                       state->text_end - state->text_first,
+                       gpu.ready ? 0 : image->blur_intensity,
+                       gpu.ready ? 0 : image->brightness_intensity,
+                       image->snap_pixels,
+                       canvas.size,
+                       context_region()};
+  render_worker_post(image->worker, params);
+}
 
-  ImageBlurGaussian(&image->img_copy, image->blur_intensity);
-  ImageColorBrightness(&image->img_copy, image->brightness_intensity);
+// the context box as a fraction of the canvas, which is also the fraction
+// of the image since the image is stretched over the whole canvas
+Rectangle context_region(void) {
+  if (canvas.context.width <= 0 || canvas.context.height <= 0 ||
+      canvas.size.x <= 0 || canvas.size.y <= 0)
+    return (Rectangle){0};
+  return (Rectangle){(canvas.context.x - canvas.position.x) / canvas.size.x,
+                     (canvas.context.y - canvas.position.y) / canvas.size.y,
+                     canvas.context.width / canvas.size.x,
+                     canvas.context.height / canvas.size.y};
+}
+
+// inverse of context_region(), back to screen coordinates
+Rectangle region_to_context(Rectangle region) {
+  if (region.width <= 0 || region.height <= 0)
+    return (Rectangle){0};
+  return (Rectangle){canvas.position.x + region.x * canvas.size.x,
+                     canvas.position.y + region.y * canvas.size.y,
+                     region.width * canvas.size.x,
+                     region.height * canvas.size.y};
+}
+
+void record_edit(ImageObject *image, EditKind kind, float value, bool merge) {
+  journal_record(&image->journal, (EditOp){kind, value, context_region()},
+                 merge);
+  image->edited = true;
+}
+
+// puts the sliders, checkbox and context box back to what the journal says
+// and re-renders. before is the state they showed until now
+void restore_edit_state(ImageObject *image, EditState before) {
+  EditState state = image->journal.state;
+  image->blur_intensity = state.blur;
+  image->brightness_intensity = state.brightness;
+  image->snap_pixels = state.snap_pixels;
+  canvas.context = region_to_context(state.region);
+
+  if (!image->isLoaded)
+    return;
+  // texts can disappear or come back in any order, the cached text layer
+  // can't be drawn on incrementally
+  if (state.text_first != before.text_first ||
+      state.text_end != before.text_end)
+    render_worker_invalidate(image->worker, STAGE_TEXT);
+  if (gpu.ready)
+    apply_gpu_effects(image);
+  handle_dynamic_canvas_resizing(image);
 }
 
 TextAllocator new_text_allocator(int capacity) {
@@ -0,0 +1,353 @@
+/*
+ * png_writer.h - streaming png encoder
+ *
+ * usage:
+ *   #define PNG_WRITER_IMPLEMENTATION
+ *   #include "png_writer.h"
+ *
+ *   PngWriter *png = png_writer_open("out.png", width, height);
+ *   while (...)
+ *     png_writer_write_rows(png, rows, count);
+ *   bool ok = png_writer_close(png);
+ *
+ * rows can come in a few at a time, the writer only ever holds one batch of
+ * them. a full batch is filtered and compressed on every core through the
+ * tile pool: each row gets whichever png filter leaves the smallest values,
+ * then the batch is cut into chunks that deflate.h compresses at the same
+ * time, each one primed with the 32kb before it. the chunks go out as idat
+ * chunks in order, so the file is written as the image is produced.
+ */
+
+#include "raylib.h"
+
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <stdbool.h>
+
+typedef struct PngWriter PngWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// rgba8, NULL if the file can't be created
+PngWriter *png_writer_open(const char *path, int width, int height);
+// count rows of width pixels each, packed one after the other
+bool png_writer_write_rows(PngWriter *png, const Color *rows, int count);
+// writes whatever is left, frees the writer. false if anything failed along
+// the way, including rows missing
+bool png_writer_close(PngWriter *png);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PNG_WRITER_H
+
+/*
+ * PNG_WRITER IMPLEMENTATION
+ */
+#if defined(PNG_WRITER_IMPLEMENTATION)
+
+#include "deflate.h"
+#include "tile_pool.h"
+
+#include <stdio.h>  // Required for: fopen(), fwrite(), fclose()
+#include <stdlib.h> // Required for: malloc(), calloc(), free()
+#include <string.h> // Required for: memcpy(), memset()
+
+// filtered bytes per deflate chunk, big enough that the dictionary and block
+// headers don't matter, small enough to give every core a few
+#define PNG_CHUNK_BYTES (256 << 10)
+#define PNG_CHUNKS_PER_THREAD 2
+
+struct PngWriter {
+  FILE *file;
+  int width, height;
+  int rows_written;
+  bool failed;
+
+  // bytes per raw row, and per filtered row with its filter type in front
+  int row_bytes;
+  int filtered_bytes;
+
+  // the batch being collected, raw
+  unsigned char *raw;
+  int batch_rows;
+  int pending_rows;
+  // last raw row of the batch before, the filters' row above. zeros at first
+  unsigned char *above;
+
+  // the dictionary followed by the filtered batch
+  unsigned char *filtered;
+  int dictionary_size;
+  int chunk_rows;
+
+  unsigned int adler;
+  bool idat_started;
+  unsigned int crc_table[256];
+};
+
+//------------------------------------------------------------------------------
+// chunks
+//------------------------------------------------------------------------------
+static unsigned int png_crc(const PngWriter *png, unsigned int crc,
+                           const unsigned char *data, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    crc = png->crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+static void put_be32(unsigned char *p, unsigned int value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+// a chunk whose data comes in up to three parts, so the zlib header and
+// checksum don't have to be copied in front of or behind the deflate output
+static void write_chunk(PngWriter *png, const char *type,
+                        const unsigned char *parts[3], const int sizes[3]) {
+  unsigned char header[8];
+  put_be32(header, sizes[0] + sizes[1] + sizes[2]);
+  memcpy(header + 4, type, 4);
+  unsigned int crc = png_crc(png, 0xFFFFFFFF, header + 4, 4);
+  bool ok = fwrite(header, 1, 8, png->file) == 8;
+  for (int i = 0; i < 3; i++) {
+    if (sizes[i] == 0)
+      continue;
+    crc = png_crc(png, crc, parts[i], sizes[i]);
+    ok = ok && fwrite(parts[i], 1, sizes[i], png->file) == (size_t)sizes[i];
+  }
+  unsigned char footer[4];
+  put_be32(footer, crc ^ 0xFFFFFFFF);
+  ok = ok && fwrite(footer, 1, 4, png->file) == 4;
+  if (!ok)
+    png->failed = true;
+}
+
+//------------------------------------------------------------------------------
+// filtering
+//------------------------------------------------------------------------------
+static unsigned char paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
+
+typedef struct {
+  PngWriter *png;
+} FilterJob;
+
+// every row is tried with all five filters, the one with the smallest sum
+// of (signed) output bytes usually compresses best
+static void filter_rows(void *user, Tile tile) {
+  FilterJob *job = user;
+  PngWriter *png = job->png;
+  const int n = png->row_bytes;
+  unsigned char *candidates = malloc((size_t)5 * n);
+
+  for (int y = tile.y0; y < tile.y1; y++) {
+    const unsigned char *row = png->raw + (size_t)y * n;
+    const unsigned char *up = y > 0 ? row - n : png->above;
+    unsigned long sums[5] = {0};
+    for (int i = 0; i < n; i++) {
+      int left = i >= 4 ? row[i - 4] : 0;
+      int corner = i >= 4 ? up[i - 4] : 0;
+      unsigned char values[5] = {
+          row[i], row[i] - left, row[i] - up[i],
+          row[i] - ((left + up[i]) >> 1), row[i] - paeth(left, up[i], corner)};
+      for (int f = 0; f < 5; f++) {
+        candidates[(size_t)f * n + i] = values[f];
+        sums[f] += values[f] < 128 ? values[f] : 256 - values[f];
+      }
+    }
+    int best = 0;
+    for (int f = 1; f < 5; f++)
+      if (sums[f] < sums[best])
+        best = f;
+
+    unsigned char *out = png->filtered + png->dictionary_size +
+                         (size_t)y * png->filtered_bytes;
+    out[0] = best;
+    memcpy(out + 1, candidates + (size_t)best * n, n);
+  }
+  free(candidates);
+}
+
+//------------------------------------------------------------------------------
+// compression
+//------------------------------------------------------------------------------
+typedef struct {
+  unsigned char *data;
+  int size;
+  unsigned int adler;
+} CompressedChunk;
+
+typedef struct {
+  PngWriter *png;
+  CompressedChunk *chunks;
+  int chunk_count;
+  int total;
+  bool last;
+} DeflateJob;
+
+static void deflate_png_chunk(void *user, Tile cell) {
+  DeflateJob *job = user;
+  PngWriter *png = job->png;
+  int index = cell.x0;
+  int chunk_bytes = png->chunk_rows * png->filtered_bytes;
+  int start = png->dictionary_size + index * chunk_bytes;
+  int end = start + chunk_bytes;
+  if (end > png->dictionary_size + job->total)
+    end = png->dictionary_size + job->total;
+  int dictionary = start < DEFLATE_WINDOW_SIZE ? start : DEFLATE_WINDOW_SIZE;
+
+  CompressedChunk *chunk = &job->chunks[index];
+  const unsigned char *data = png->filtered + start;
+  chunk->data = deflate_chunk(data - dictionary, dictionary, end - start,
+                              job->last && index == job->chunk_count - 1,
+                              &chunk->size);
+  chunk->adler = deflate_adler32(1, data, end - start);
+}
+
+// filters, compresses and writes out the rows collected so far
+static void flush_batch(PngWriter *png, bool last) {
+  int rows = png->pending_rows;
+  int total = rows * png->filtered_bytes;
+  FilterJob filter = {png};
+  tile_pool_run(tile_pool_shared(), 0, 0, 1, rows, 1, png->chunk_rows,
+                filter_rows, &filter);
+
+  int chunk_count = (rows + png->chunk_rows - 1) / png->chunk_rows;
+  // the very end of the stream still needs its final block
+  if (chunk_count == 0 && last)
+    chunk_count = 1;
+  CompressedChunk *chunks = calloc(chunk_count ? chunk_count : 1,
+                                   sizeof(CompressedChunk));
+  DeflateJob job = {png, chunks, chunk_count, total, last};
+  tile_pool_run(tile_pool_shared(), 0, 0, chunk_count, 1, 1, 1,
+                deflate_png_chunk, &job);
+
+  int chunk_bytes = png->chunk_rows * png->filtered_bytes;
+  for (int i = 0; i < chunk_count; i++) {
+    int size = total - i * chunk_bytes < chunk_bytes ? total - i * chunk_bytes
+                                                     : chunk_bytes;
+    png->adler = deflate_adler32_combine(png->adler, chunks[i].adler,
+                                         size > 0 ? size : 0);
+
+    static const unsigned char zlib_header[2] = {0x78, 0x9C};
+    unsigned char adler[4];
+    put_be32(adler, png->adler);
+    bool first = !png->idat_started, end = last && i == chunk_count - 1;
+    const unsigned char *parts[3] = {zlib_header, chunks[i].data, adler};
+    int sizes[3] = {first ? 2 : 0, chunks[i].size, end ? 4 : 0};
+    write_chunk(png, "IDAT", parts, sizes);
+    png->idat_started = true;
+    free(chunks[i].data);
+  }
+  free(chunks);
+
+  // the end of this batch is the dictionary of the next one
+  int keep = png->dictionary_size + total < DEFLATE_WINDOW_SIZE
+                 ? png->dictionary_size + total
+                 : DEFLATE_WINDOW_SIZE;
+  memmove(png->filtered, png->filtered + png->dictionary_size + total - keep,
+          keep);
+  png->dictionary_size = keep;
+  if (rows > 0)
+    memcpy(png->above, png->raw + (size_t)(rows - 1) * png->row_bytes,
+           png->row_bytes);
+  png->pending_rows = 0;
+}
+
+//------------------------------------------------------------------------------
+// api
+//------------------------------------------------------------------------------
+PngWriter *png_writer_open(const char *path, int width, int height) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return NULL;
+
+  PngWriter *png = calloc(1, sizeof(PngWriter));
+  png->file = file;
+  png->width = width;
+  png->height = height;
+  png->row_bytes = width * 4;
+  png->filtered_bytes = png->row_bytes + 1;
+  png->adler = 1;
+  for (unsigned int n = 0; n < 256; n++) {
+    unsigned int c = n;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    png->crc_table[n] = c;
+  }
+
+  png->chunk_rows = PNG_CHUNK_BYTES / png->filtered_bytes;
+  if (png->chunk_rows < 1)
+    png->chunk_rows = 1;
+  png->batch_rows = png->chunk_rows * PNG_CHUNKS_PER_THREAD *
+                    tile_pool_thread_count(tile_pool_shared());
+  png->raw = malloc((size_t)png->batch_rows * png->row_bytes);
+  png->above = calloc(1, png->row_bytes);
+  png->filtered = malloc(DEFLATE_WINDOW_SIZE +
+                         (size_t)png->batch_rows * png->filtered_bytes);
+
+  static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  if (fwrite(signature, 1, 8, file) != 8)
+    png->failed = true;
+  // 8 bit rgba, no interlacing
+  unsigned char header[13] = {0};
+  put_be32(header, width);
+  put_be32(header + 4, height);
+  header[8] = 8;
+  header[9] = 6;
+  const unsigned char *parts[3] = {header, NULL, NULL};
+  write_chunk(png, "IHDR", parts, (const int[3]){13, 0, 0});
+  return png;
+}
+
+bool png_writer_write_rows(PngWriter *png, const Color *rows, int count) {
+  if (png->rows_written + count > png->height)
+    png->failed = true;
+  while (count > 0 && !png->failed) {
+    int room = png->batch_rows - png->pending_rows;
+    int take = count < room ? count : room;
+    memcpy(png->raw + (size_t)png->pending_rows * png->row_bytes, rows,
+           (size_t)take * png->row_bytes);
+    png->pending_rows += take;
+    png->rows_written += take;
+    rows += (size_t)take * png->width;
+    count -= take;
+    // the last rows wait for close, which has to mark the final block
+    if (png->pending_rows == png->batch_rows &&
+        png->rows_written < png->height)
+      flush_batch(png, false);
+  }
+  return !png->failed;
+}
+
+bool png_writer_close(PngWriter *png) {
+  if (png->rows_written != png->height)
+    png->failed = true;
+  if (!png->failed) {
+    flush_batch(png, true);
+    const unsigned char *parts[3] = {NULL, NULL, NULL};
+    write_chunk(png, "IEND", parts, (const int[3]){0, 0, 0});
+  }
+  bool ok = !png->failed;
+  if (fclose(png->file) != 0)
+    ok = false;
+  free(png->raw);
+  free(png->above);
+  free(png->filtered);
+  free(png);
+  return ok;
+}
+
+#endif // PNG_WRITER_IMPLEMENTATION
@@ -0,0 +1,273 @@
+/*
+ * profiler.h - stage timers and the overlay that shows them
+ *
+ * usage:
+ *   #define PROFILER_IMPLEMENTATION
+ *   #include "profiler.h"
+ *
+ *   PROFILE_SCOPE(PROFILE_BLUR) {
+ *     ...
+ *   }
+ *
+ * every expensive step of daisy (decoding, the pipeline stages, texture
+ * uploads, exporting) runs inside a PROFILE_SCOPE. the timers are atomics,
+ * so stages can be timed on any thread, and they cost one check of a flag
+ * while the profiler is off. don't return or break out of a scope, its time
+ * would never be added.
+ *
+ * profile_draw_overlay() shows, for the last second, how often each stage
+ * ran and how long it took, a histogram of recent frame times and how much
+ * memory the process and the image tiles take.
+ */
+
+#include "raylib.h"
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+
+typedef enum {
+  PROFILE_DECODE,
+  PROFILE_TILES,
+  PROFILE_PROXY,
+  PROFILE_TEXT,
+  PROFILE_BLUR,
+  PROFILE_BRIGHTNESS,
+  PROFILE_RESIZE,
+  PROFILE_COPY,
+  PROFILE_UPLOAD,
+  PROFILE_EXPORT_RENDER,
+  PROFILE_EXPORT_ENCODE,
+  PROFILE_STAGE_COUNT
+} ProfileStage;
+
+typedef struct {
+  ProfileStage stage;
+  double start;
+  bool running;
+} ProfileScope;
+
+// runs the statement after it once, timed
+#define PROFILE_SCOPE(stage)                                                   \
+  for (ProfileScope profile_scope_ = profile_begin(stage);                     \
+       profile_scope_.running; profile_end(&profile_scope_))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// call from the ui thread, turning it on starts a fresh histogram
+void profile_set_enabled(bool enabled);
+bool profile_enabled(void);
+ProfileScope profile_begin(ProfileStage stage);
+void profile_end(ProfileScope *scope);
+// once per frame from the ui thread
+void profile_frame(float seconds);
+void profile_draw_overlay(Rectangle bounds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_H
+
+/*
+ * PROFILER IMPLEMENTATION
+ */
+#if defined(PROFILER_IMPLEMENTATION)
+
+#include "tiled_image.h"
+
+#include <stdatomic.h>
+#include <stdio.h> // Required for: fopen(), fscanf()
+#include <time.h>  // Required for: timespec_get()
+
+#if !defined(_WIN32)
+#include <unistd.h> // Required for: sysconf()
+#endif
+
+#define PROFILE_FRAME_HISTORY 240
+#define PROFILE_HISTOGRAM_BUCKETS 20
+// width of a bucket, the last one takes everything slower
+#define PROFILE_BUCKET_MS 2.5f
+
+static const char *const stage_names[PROFILE_STAGE_COUNT] = {
+    "decode",     "tiles",  "proxy",  "text",          "blur",
+    "brightness", "resize", "copy",   "upload",        "export render",
+    "export encode"};
+
+typedef struct {
+  // nanoseconds and calls since the start
+  atomic_llong total;
+  atomic_int calls;
+  atomic_llong last;
+} StageTimer;
+
+// only the ui thread reads these
+typedef struct {
+  long long total;
+  int calls;
+} StageSnapshot;
+
+static atomic_bool enabled;
+static StageTimer timers[PROFILE_STAGE_COUNT];
+
+static float frame_times[PROFILE_FRAME_HISTORY];
+static int frame_index;
+static int frame_count;
+
+// averages over the last full second, refreshed once a second
+static double window_start;
+static StageSnapshot window_base[PROFILE_STAGE_COUNT];
+static float window_ms[PROFILE_STAGE_COUNT];
+static int window_calls[PROFILE_STAGE_COUNT];
+static size_t resident;
+
+static double profile_now(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool profile_enabled(void) { return atomic_load(&enabled); }
+
+ProfileScope profile_begin(ProfileStage stage) {
+  ProfileScope scope = {stage, 0, true};
+  if (atomic_load_explicit(&enabled, memory_order_relaxed))
+    scope.start = profile_now();
+  return scope;
+}
+
+void profile_end(ProfileScope *scope) {
+  scope->running = false;
+  if (scope->start == 0)
+    return;
+  long long elapsed = (profile_now() - scope->start) * 1e9;
+  StageTimer *timer = &timers[scope->stage];
+  atomic_fetch_add(&timer->total, elapsed);
+  atomic_fetch_add(&timer->calls, 1);
+  atomic_store(&timer->last, elapsed);
+}
+
+// what the os says the process holds in ram, 0 where we can't tell
+static size_t resident_bytes(void) {
+  size_t pages = 0;
+#if defined(__linux__)
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%*s %zu", &pages) != 1)
+      pages = 0;
+    fclose(statm);
+  }
+  return pages * sysconf(_SC_PAGESIZE);
+#else
+  return pages;
+#endif
+}
+
+static void refresh_window(double now) {
+  double elapsed = now - window_start;
+  for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+    StageSnapshot current = {atomic_load(&timers[i].total),
+                             atomic_load(&timers[i].calls)};
+    window_calls[i] = current.calls - window_base[i].calls;
+    // per second of wall time, so a stage on another thread that ran 10
+    // times shows what it cost in total
+    window_ms[i] = elapsed > 0
+                       ? (current.total - window_base[i].total) * 1e-6 / elapsed
+                       : 0;
+    window_base[i] = current;
+  }
+  window_start = now;
+  resident = resident_bytes();
+}
+
+void profile_set_enabled(bool on) {
+  if (on && !profile_enabled()) {
+    // whatever ran while it was off never got timed, start from now
+    frame_count = 0;
+    frame_index = 0;
+    refresh_window(profile_now());
+  }
+  atomic_store(&enabled, on);
+}
+
+void profile_frame(float seconds) {
+  if (!profile_enabled())
+    return;
+  frame_times[frame_index] = seconds;
+  frame_index = (frame_index + 1) % PROFILE_FRAME_HISTORY;
+  if (frame_count < PROFILE_FRAME_HISTORY)
+    frame_count++;
+
+  double now = profile_now();
+  if (now - window_start >= 1)
+    refresh_window(now);
+}
+
+void profile_draw_overlay(Rectangle bounds) {
+  DrawRectangleRec(bounds, Fade(BLACK, 0.75f));
+  int x = bounds.x + 8, y = bounds.y + 8;
+  const int line = 12, font = 10;
+
+  // stage, calls/s, ms/s, last ms
+  const int columns[] = {x, x + 90, x + 130, x + 180};
+  DrawText("stage", columns[0], y, font, LIGHTGRAY);
+  DrawText("calls", columns[1], y, font, LIGHTGRAY);
+  DrawText("ms/s", columns[2], y, font, LIGHTGRAY);
+  DrawText("last ms", columns[3], y, font, LIGHTGRAY);
+  y += line;
+  for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+    float last = atomic_load(&timers[i].last) * 1e-6f;
+    Color color = window_calls[i] > 0 ? RAYWHITE : GRAY;
+    DrawText(stage_names[i], columns[0], y, font, color);
+    DrawText(TextFormat("%d", window_calls[i]), columns[1], y, font, color);
+    DrawText(TextFormat("%.1f", window_ms[i]), columns[2], y, font, color);
+    DrawText(TextFormat("%.2f", last), columns[3], y, font, color);
+    y += line;
+  }
+
+  // frame time histogram, the line marks 60 fps
+  y += line / 2;
+  float average = 0, worst = 0;
+  int buckets[PROFILE_HISTOGRAM_BUCKETS] = {0};
+  for (int i = 0; i < frame_count; i++) {
+    float ms = frame_times[i] * 1000;
+    average += ms / frame_count;
+    worst = ms > worst ? ms : worst;
+    int bucket = ms / PROFILE_BUCKET_MS;
+    if (bucket >= PROFILE_HISTOGRAM_BUCKETS)
+      bucket = PROFILE_HISTOGRAM_BUCKETS - 1;
+    buckets[bucket]++;
+  }
+  DrawText(TextFormat("frame %.1f ms avg, %.1f ms worst", average, worst), x,
+           y, font, RAYWHITE);
+  y += line;
+
+  int height = 40, width = bounds.width - 16;
+  int bar = width / PROFILE_HISTOGRAM_BUCKETS;
+  int most = 1;
+  for (int i = 0; i < PROFILE_HISTOGRAM_BUCKETS; i++)
+    most = buckets[i] > most ? buckets[i] : most;
+  for (int i = 0; i < PROFILE_HISTOGRAM_BUCKETS; i++) {
+    int h = buckets[i] * height / most;
+    Color color = (i + 1) * PROFILE_BUCKET_MS <= 1000 / 60.f ? GREEN : ORANGE;
+    DrawRectangle(x + i * bar, y + height - h, bar - 1, h, color);
+  }
+  int budget = x + (1000 / 60.f) / PROFILE_BUCKET_MS * bar;
+  DrawLine(budget, y, budget, y + height, RED);
+  y += height + 2;
+  DrawText("0", x, y, font, GRAY);
+  const char *slowest =
+      TextFormat("%.0f+ ms", PROFILE_HISTOGRAM_BUCKETS * PROFILE_BUCKET_MS);
+  DrawText(slowest, x + width - MeasureText(slowest, font), y, font, GRAY);
+  y += line + line / 2;
+
+  DrawText(TextFormat("memory %.1f mb, image tiles %.1f mb",
+                      resident / 1048576.0,
+                      tiled_image_heap_bytes() / 1048576.0),
+           x, y, font, RAYWHITE);
+}
+
+#endif // PROFILER_IMPLEMENTATION
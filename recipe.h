@@ -0,0 +1,681 @@
+/*
+ * recipe.h - saves and loads daisy's edits
+ *
+ * usage:
+ *   #define RECIPE_IMPLEMENTATION
+ *   #include "recipe.h"
+ *
+ *   EditRecipe recipe = recipe_from_journal(&journal, texts, text_count,
+ *                                           width, height);
+ *   recipe_save("photo.jpg.daisy", &recipe);
+ *   ...
+ *   if (recipe_load("photo.jpg.daisy", &recipe)) {
+ *     recipe_to_journal(&recipe, &journal);
+ *     recipe_free(&recipe);
+ *   }
+ *
+ * a recipe is the edit journal (every op, and how many of them are applied)
+ * plus the texts the ops refer to. the pixels are never stored, reopening a
+ * recipe just hands the parameters back to the pipeline.
+ *
+ * the binary format is a versioned header followed by fixed size records
+ * (little endian):
+ *
+ *   header   "DSYR", u16 version, u16 header size, u32 image width, u32
+ *            image height, u32 op count, u32 cursor, u32 text count, u32
+ *            string bytes
+ *   ops      u32 kind, f32 value, f32 region x, y, width, height
+ *   texts    f32 x, f32 y, u32 string offset, u32 string length
+ *   strings  nul terminated, back to back
+ *
+ * the file is read with a single read: on little endian machines the op
+ * records are EditOps as they are and the texts point at their strings inside
+ * the file's buffer. recipe_to_journal() still replays the ops into a journal,
+ * with their values clamped to what the editor allows, and whoever keeps the
+ * texts past recipe_free() has to copy them.
+ *
+ * paths ending in .json are written as json instead, for reading and
+ * editing by hand. loading tells the two apart by the contents.
+ */
+
+#include "raylib.h"
+
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include "edit_journal.h"
+#include "image_pipeline.h"
+
+#include <stdbool.h>
+
+#define RECIPE_VERSION 1
+
+typedef struct {
+  // size of the image the edits were made on, 0 if unknown
+  int image_width;
+  int image_height;
+  // the whole journal, the first cursor ops are applied
+  const EditOp *ops;
+  int op_count;
+  int cursor;
+  // every text the ops add, in order
+  const TextObject *texts;
+  int text_count;
+
+  // what a loaded recipe owns, the pointers above point into these
+  void *storage;
+  EditOp *op_storage;
+  TextObject *text_storage;
+} EditRecipe;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// borrows everything, nothing is copied and there's nothing to free
+EditRecipe recipe_from_journal(const EditJournal *journal,
+                               const TextObject *texts, int text_count,
+                               int image_width, int image_height);
+// json if the path ends in .json, binary otherwise
+bool recipe_save(const char *path, const EditRecipe *recipe);
+// false if the file is missing, broken or from a newer version
+bool recipe_load(const char *path, EditRecipe *recipe);
+// replaces the journal with the recipe's, values out of the sliders' range
+// are clamped. the texts stay in the recipe, the journal only counts them
+void recipe_to_journal(const EditRecipe *recipe, EditJournal *journal);
+void recipe_free(EditRecipe *recipe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECIPE_H
+
+/*
+ * RECIPE IMPLEMENTATION
+ */
+#if defined(RECIPE_IMPLEMENTATION)
+
+#include <stdint.h> // Required for: uint32_t
+#include <stdio.h>  // Required for: fopen(), fread(), fwrite(), rename()
+#include <stdlib.h> // Required for: malloc(), realloc(), free(), strtod()
+#include <string.h> // Required for: memcpy(), memcmp(), strlen()
+
+#define RECIPE_HEADER_SIZE 32
+#define RECIPE_OP_SIZE 24
+#define RECIPE_TEXT_SIZE 16
+
+static const char *const op_names[] = {"add_text", "blur", "brightness",
+                                       "snap_pixels", "reset"};
+#define OP_KIND_COUNT (int)(sizeof(op_names) / sizeof(op_names[0]))
+
+EditRecipe recipe_from_journal(const EditJournal *journal,
+                               const TextObject *texts, int text_count,
+                               int image_width, int image_height) {
+  return (EditRecipe){.image_width = image_width,
+                      .image_height = image_height,
+                      .ops = journal->ops,
+                      .op_count = journal->count,
+                      .cursor = journal->cursor,
+                      .texts = texts,
+                      .text_count = text_count};
+}
+
+// nan ends up at lo
+static float clamp_value(float value, float lo, float hi) {
+  return value > lo ? (value < hi ? value : hi) : lo;
+}
+
+// a recipe can come from anywhere, its values are held to what the sliders
+// and the context box could have made
+static EditOp clamp_op(EditOp op) {
+  if (op.kind == EDIT_BLUR)
+    op.value = clamp_value(op.value, 0, EDIT_BLUR_MAX);
+  else if (op.kind == EDIT_BRIGHTNESS)
+    op.value =
+        clamp_value(op.value, EDIT_BRIGHTNESS_MIN, EDIT_BRIGHTNESS_MAX);
+  op.region.x = clamp_value(op.region.x, 0, 1);
+  op.region.y = clamp_value(op.region.y, 0, 1);
+  op.region.width = clamp_value(op.region.width, 0, 1 - op.region.x);
+  op.region.height = clamp_value(op.region.height, 0, 1 - op.region.y);
+  return op;
+}
+
+void recipe_to_journal(const EditRecipe *recipe, EditJournal *journal) {
+  journal_free(journal);
+  for (int i = 0; i < recipe->op_count; i++)
+    journal_record(journal, clamp_op(recipe->ops[i]), false);
+  while (journal->cursor > recipe->cursor)
+    journal_undo(journal);
+}
+
+void recipe_free(EditRecipe *recipe) {
+  free(recipe->storage);
+  free(recipe->op_storage);
+  free(recipe->text_storage);
+  *recipe = (EditRecipe){0};
+}
+
+// the ops have to refer to texts the recipe has, and the cursor to ops
+static bool recipe_is_consistent(const EditRecipe *recipe) {
+  if (recipe->cursor < 0 || recipe->cursor > recipe->op_count)
+    return false;
+  int texts = 0;
+  for (int i = 0; i < recipe->op_count; i++) {
+    if ((int)recipe->ops[i].kind < 0 ||
+        (int)recipe->ops[i].kind >= OP_KIND_COUNT)
+      return false;
+    texts += recipe->ops[i].kind == EDIT_ADD_TEXT;
+  }
+  return texts <= recipe->text_count;
+}
+
+static unsigned char *read_whole_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+  unsigned char *data = NULL;
+  long length = -1;
+  if (fseek(file, 0, SEEK_END) == 0)
+    length = ftell(file);
+  // one spare byte, the json reader wants its text terminated
+  if (length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+    data = malloc(length + 1);
+    if (fread(data, 1, length, file) != (size_t)length) {
+      free(data);
+      data = NULL;
+    } else {
+      data[length] = 0;
+      *size = length;
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+//------------------------------------------------------------------------------
+// binary
+//------------------------------------------------------------------------------
+static bool host_is_little_endian(void) {
+  const uint32_t one = 1;
+  return *(const unsigned char *)&one == 1;
+}
+
+static void put_le32(unsigned char *p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_f32(unsigned char *p, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+  put_le32(p, bits);
+}
+
+static float get_f32(const unsigned char *p) {
+  uint32_t bits = get_le32(p);
+  float value;
+  memcpy(&value, &bits, 4);
+  return value;
+}
+
+static bool save_binary(FILE *file, const EditRecipe *recipe) {
+  size_t string_bytes = 0;
+  for (int i = 0; i < recipe->text_count; i++)
+    string_bytes += strlen(recipe->texts[i].text) + 1;
+  size_t size = RECIPE_HEADER_SIZE + (size_t)recipe->op_count * RECIPE_OP_SIZE +
+                (size_t)recipe->text_count * RECIPE_TEXT_SIZE + string_bytes;
+  unsigned char *data = calloc(1, size);
+
+  memcpy(data, "DSYR", 4);
+  data[4] = RECIPE_VERSION;
+  data[6] = RECIPE_HEADER_SIZE;
+  put_le32(data + 8, recipe->image_width);
+  put_le32(data + 12, recipe->image_height);
+  put_le32(data + 16, recipe->op_count);
+  put_le32(data + 20, recipe->cursor);
+  put_le32(data + 24, recipe->text_count);
+  put_le32(data + 28, string_bytes);
+
+  unsigned char *p = data + RECIPE_HEADER_SIZE;
+  for (int i = 0; i < recipe->op_count; i++, p += RECIPE_OP_SIZE) {
+    const EditOp *op = &recipe->ops[i];
+    put_le32(p, op->kind);
+    put_f32(p + 4, op->value);
+    put_f32(p + 8, op->region.x);
+    put_f32(p + 12, op->region.y);
+    put_f32(p + 16, op->region.width);
+    put_f32(p + 20, op->region.height);
+  }
+  unsigned char *strings = p + (size_t)recipe->text_count * RECIPE_TEXT_SIZE;
+  uint32_t offset = 0;
+  for (int i = 0; i < recipe->text_count; i++, p += RECIPE_TEXT_SIZE) {
+    const TextObject *text = &recipe->texts[i];
+    uint32_t length = strlen(text->text);
+    put_f32(p, text->position.x);
+    put_f32(p + 4, text->position.y);
+    put_le32(p + 8, offset);
+    put_le32(p + 12, length);
+    memcpy(strings + offset, text->text, length + 1);
+    offset += length + 1;
+  }
+
+  bool ok = fwrite(data, 1, size, file) == size;
+  free(data);
+  return ok;
+}
+
+// takes over data, which stays alive as the recipe's storage
+static bool load_binary(unsigned char *data, size_t size,
+                        EditRecipe *recipe) {
+  *recipe = (EditRecipe){0};
+  recipe->storage = data;
+  if (size < RECIPE_HEADER_SIZE || memcmp(data, "DSYR", 4) != 0)
+    return false;
+  unsigned version = data[4] | data[5] << 8;
+  size_t header_size = data[6] | data[7] << 8;
+  if (version == 0 || version > RECIPE_VERSION ||
+      header_size < RECIPE_HEADER_SIZE)
+    return false;
+
+  uint32_t op_count = get_le32(data + 16), cursor = get_le32(data + 20);
+  uint32_t text_count = get_le32(data + 24);
+  uint32_t string_bytes = get_le32(data + 28);
+  // counts straight from the file, keep the sums from overflowing
+  if (op_count > (1u << 24) || text_count > (1u << 24))
+    return false;
+  size_t ops_at = header_size;
+  size_t texts_at = ops_at + (size_t)op_count * RECIPE_OP_SIZE;
+  size_t strings_at = texts_at + (size_t)text_count * RECIPE_TEXT_SIZE;
+  if (strings_at > size || size - strings_at < string_bytes)
+    return false;
+
+  recipe->image_width = get_le32(data + 8);
+  recipe->image_height = get_le32(data + 12);
+  recipe->op_count = op_count;
+  recipe->cursor = cursor;
+  recipe->text_count = text_count;
+
+  // the records match EditOp byte for byte when the machine does too
+  const unsigned char *p = data + ops_at;
+  if (host_is_little_endian() && sizeof(EditOp) == RECIPE_OP_SIZE &&
+      sizeof(EditKind) == 4 && ops_at % sizeof(float) == 0) {
+    recipe->ops = (const EditOp *)p;
+  } else {
+    recipe->op_storage = malloc((op_count ? op_count : 1) * sizeof(EditOp));
+    for (uint32_t i = 0; i < op_count; i++, p += RECIPE_OP_SIZE)
+      recipe->op_storage[i] = (EditOp){
+          get_le32(p), get_f32(p + 4),
+          (Rectangle){get_f32(p + 8), get_f32(p + 12), get_f32(p + 16),
+                      get_f32(p + 20)}};
+    recipe->ops = recipe->op_storage;
+  }
+
+  char *strings = (char *)data + strings_at;
+  recipe->text_storage =
+      malloc((text_count ? text_count : 1) * sizeof(TextObject));
+  p = data + texts_at;
+  for (uint32_t i = 0; i < text_count; i++, p += RECIPE_TEXT_SIZE) {
+    uint32_t offset = get_le32(p + 8), length = get_le32(p + 12);
+    if (offset >= string_bytes || string_bytes - offset <= length ||
+        strings[offset + length] != 0)
+      return false;
+    recipe->text_storage[i] = (TextObject){
+        strings + offset, (Vector2){get_f32(p), get_f32(p + 4)}};
+  }
+  recipe->texts = recipe->text_storage;
+  return recipe_is_consistent(recipe);
+}
+
+//------------------------------------------------------------------------------
+// json
+//------------------------------------------------------------------------------
+static void write_json_string(FILE *file, const char *text) {
+  fputc('"', file);
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(file, "\\%c", *c);
+    else if (*c < 0x20)
+      fprintf(file, "\\u%04x", *c);
+    else
+      fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+static bool save_json(FILE *file, const EditRecipe *recipe) {
+  fprintf(file,
+          "{\n  \"daisy_recipe\": %d,\n  \"image\": {\"width\": %d, "
+          "\"height\": %d},\n  \"cursor\": %d,\n  \"ops\": [",
+          RECIPE_VERSION, recipe->image_width, recipe->image_height,
+          recipe->cursor);
+  for (int i = 0; i < recipe->op_count; i++) {
+    const EditOp *op = &recipe->ops[i];
+    fprintf(file,
+            "%s\n    {\"kind\": \"%s\", \"value\": %.9g, \"region\": [%.9g, "
+            "%.9g, %.9g, %.9g]}",
+            i ? "," : "", op_names[op->kind], op->value, op->region.x,
+            op->region.y, op->region.width, op->region.height);
+  }
+  fprintf(file, "%s],\n  \"texts\": [", recipe->op_count ? "\n  " : "");
+  for (int i = 0; i < recipe->text_count; i++) {
+    fprintf(file, "%s\n    {\"text\": ", i ? "," : "");
+    write_json_string(file, recipe->texts[i].text);
+    fprintf(file, ", \"x\": %.9g, \"y\": %.9g}", recipe->texts[i].position.x,
+            recipe->texts[i].position.y);
+  }
+  fprintf(file, "%s]\n}\n", recipe->text_count ? "\n  " : "");
+  return !ferror(file);
+}
+
+// just enough json for recipes: keys it doesn't know are skipped, anything
+// malformed fails the load
+typedef struct {
+  const char *p;
+  bool failed;
+} JsonReader;
+
+static void json_space(JsonReader *r) {
+  while (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')
+    r->p++;
+}
+
+static bool json_accept(JsonReader *r, char c) {
+  json_space(r);
+  if (*r->p != c)
+    return false;
+  r->p++;
+  return true;
+}
+
+static void json_expect(JsonReader *r, char c) {
+  if (!json_accept(r, c))
+    r->failed = true;
+}
+
+// decoded over the text it came from, it's never longer. NULL if broken
+static char *json_string(JsonReader *r) {
+  json_space(r);
+  if (*r->p != '"') {
+    r->failed = true;
+    return NULL;
+  }
+  char *out = (char *)++r->p, *start = out;
+  while (*r->p != '"') {
+    if (*r->p == 0 || (unsigned char)*r->p < 0x20) {
+      r->failed = true;
+      return NULL;
+    }
+    if (*r->p != '\\') {
+      *out++ = *r->p++;
+      continue;
+    }
+    // a backslash right before the end of the file escapes the terminator,
+    // stop on it so nothing after this reads past the buffer
+    char c = r->p[1];
+    if (c == 0) {
+      r->failed = true;
+      return NULL;
+    }
+    r->p += 2;
+    switch (c) {
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'u': {
+      // utf-8 for the basic plane, surrogate pairs aren't worth it here
+      unsigned code = 0;
+      for (int i = 0; i < 4; i++, r->p++) {
+        char h = *r->p;
+        int digit = h >= '0' && h <= '9'   ? h - '0'
+                    : h >= 'a' && h <= 'f' ? h - 'a' + 10
+                    : h >= 'A' && h <= 'F' ? h - 'A' + 10
+                                           : -1;
+        if (digit < 0) {
+          r->failed = true;
+          return NULL;
+        }
+        code = code << 4 | digit;
+      }
+      if (code < 0x80) {
+        *out++ = code;
+      } else if (code < 0x800) {
+        *out++ = 0xC0 | code >> 6;
+        *out++ = 0x80 | (code & 0x3F);
+      } else {
+        *out++ = 0xE0 | code >> 12;
+        *out++ = 0x80 | (code >> 6 & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+      }
+      break;
+    }
+    case '"':
+    case '\\':
+    case '/':
+      *out++ = c;
+      break;
+    default:
+      r->failed = true;
+      return NULL;
+    }
+  }
+  r->p++;
+  *out = 0;
+  return start;
+}
+
+static double json_number(JsonReader *r) {
+  json_space(r);
+  char *end;
+  double value = strtod(r->p, &end);
+  if (end == r->p)
+    r->failed = true;
+  r->p = end;
+  return value;
+}
+
+static void json_skip(JsonReader *r, int depth) {
+  json_space(r);
+  if (depth > 64) {
+    r->failed = true;
+  } else if (*r->p == '"') {
+    json_string(r);
+  } else if (json_accept(r, '{')) {
+    if (json_accept(r, '}'))
+      return;
+    do {
+      json_string(r);
+      json_expect(r, ':');
+      json_skip(r, depth + 1);
+    } while (!r->failed && json_accept(r, ','));
+    json_expect(r, '}');
+  } else if (json_accept(r, '[')) {
+    if (json_accept(r, ']'))
+      return;
+    do
+      json_skip(r, depth + 1);
+    while (!r->failed && json_accept(r, ','));
+    json_expect(r, ']');
+  } else if (strncmp(r->p, "true", 4) == 0 || strncmp(r->p, "null", 4) == 0) {
+    r->p += 4;
+  } else if (strncmp(r->p, "false", 5) == 0) {
+    r->p += 5;
+  } else {
+    json_number(r);
+  }
+}
+
+// runs the loop body once per key of an object, with the reader on its
+// value
+#define JSON_OBJECT(r, key)                                                    \
+  for (bool more_ = (json_expect(r, '{'), !(r)->failed) &&                     \
+                    !json_accept(r, '}');                                      \
+       more_ && !(r)->failed &&                                                \
+       ((key) = json_string(r), json_expect(r, ':'), !(r)->failed);            \
+       more_ = json_accept(r, ',') || (json_expect(r, '}'), false))
+
+// once per element, with the reader on it
+#define JSON_ARRAY(r)                                                          \
+  for (bool more_ = (json_expect(r, '['), !(r)->failed) &&                     \
+                    !json_accept(r, ']');                                      \
+       more_ && !(r)->failed;                                                  \
+       more_ = json_accept(r, ',') || (json_expect(r, ']'), false))
+
+static void json_op(JsonReader *r, EditOp *op) {
+  char *key;
+  *op = (EditOp){0};
+  JSON_OBJECT(r, key) {
+    if (strcmp(key, "kind") == 0) {
+      char *name = json_string(r);
+      int kind = 0;
+      while (name && kind < OP_KIND_COUNT && strcmp(name, op_names[kind]))
+        kind++;
+      if (name == NULL || kind == OP_KIND_COUNT)
+        r->failed = true;
+      op->kind = kind;
+    } else if (strcmp(key, "value") == 0) {
+      op->value = json_number(r);
+    } else if (strcmp(key, "region") == 0) {
+      float values[4] = {0};
+      int count = 0;
+      JSON_ARRAY(r) {
+        float value = json_number(r);
+        if (count < 4)
+          values[count++] = value;
+      }
+      op->region = (Rectangle){values[0], values[1], values[2], values[3]};
+    } else {
+      json_skip(r, 0);
+    }
+  }
+}
+
+static void json_text(JsonReader *r, TextObject *text) {
+  char *key;
+  *text = (TextObject){0};
+  JSON_OBJECT(r, key) {
+    if (strcmp(key, "text") == 0)
+      text->text = json_string(r);
+    else if (strcmp(key, "x") == 0)
+      text->position.x = json_number(r);
+    else if (strcmp(key, "y") == 0)
+      text->position.y = json_number(r);
+    else
+      json_skip(r, 0);
+  }
+  if (text->text == NULL)
+    r->failed = true;
+}
+
+// takes over data, the strings are decoded in place and stay in it
+static bool load_json(unsigned char *data, EditRecipe *recipe) {
+  *recipe = (EditRecipe){0};
+  recipe->storage = data;
+  JsonReader reader = {.p = (const char *)data};
+  JsonReader *r = &reader;
+  int version = 0, op_capacity = 0, text_capacity = 0;
+  char *key;
+  JSON_OBJECT(r, key) {
+    if (strcmp(key, "daisy_recipe") == 0) {
+      version = json_number(r);
+    } else if (strcmp(key, "image") == 0) {
+      char *size_key;
+      JSON_OBJECT(r, size_key) {
+        if (strcmp(size_key, "width") == 0)
+          recipe->image_width = json_number(r);
+        else if (strcmp(size_key, "height") == 0)
+          recipe->image_height = json_number(r);
+        else
+          json_skip(r, 0);
+      }
+    } else if (strcmp(key, "cursor") == 0) {
+      recipe->cursor = json_number(r);
+    } else if (strcmp(key, "ops") == 0) {
+      JSON_ARRAY(r) {
+        if (recipe->op_count == op_capacity) {
+          op_capacity = op_capacity * 2 + 16;
+          recipe->op_storage =
+              realloc(recipe->op_storage, op_capacity * sizeof(EditOp));
+        }
+        json_op(r, &recipe->op_storage[recipe->op_count++]);
+      }
+    } else if (strcmp(key, "texts") == 0) {
+      JSON_ARRAY(r) {
+        if (recipe->text_count == text_capacity) {
+          text_capacity = text_capacity * 2 + 4;
+          recipe->text_storage = realloc(recipe->text_storage,
+                                         text_capacity * sizeof(TextObject));
+        }
+        json_text(r, &recipe->text_storage[recipe->text_count++]);
+      }
+    } else {
+      json_skip(r, 0);
+    }
+  }
+  recipe->ops = recipe->op_storage;
+  recipe->texts = recipe->text_storage;
+  return !r->failed && version >= 1 && version <= RECIPE_VERSION &&
+         recipe_is_consistent(recipe);
+}
+
+//------------------------------------------------------------------------------
+// api
+//------------------------------------------------------------------------------
+bool recipe_save(const char *path, const EditRecipe *recipe) {
+  // written next to the old one first, so a failed save doesn't lose it
+  size_t length = strlen(path);
+  char *temporary = malloc(length + 5);
+  memcpy(temporary, path, length);
+  memcpy(temporary + length, ".tmp", 5);
+
+  FILE *file = fopen(temporary, "wb");
+  bool ok = file != NULL;
+  if (ok) {
+    bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+    ok = json ? save_json(file, recipe) : save_binary(file, recipe);
+    ok = fclose(file) == 0 && ok;
+  }
+#if defined(_WIN32)
+  // windows won't rename over an existing file
+  if (ok)
+    remove(path);
+#endif
+  ok = ok && rename(temporary, path) == 0;
+  if (!ok)
+    remove(temporary);
+  free(temporary);
+  return ok;
+}
+
+bool recipe_load(const char *path, EditRecipe *recipe) {
+  size_t size = 0;
+  unsigned char *data = read_whole_file(path, &size);
+  if (data == NULL)
+    return false;
+  bool ok = size >= 4 && memcmp(data, "DSYR", 4) == 0
+                ? load_binary(data, size, recipe)
+                : load_json(data, recipe);
+  if (!ok)
+    recipe_free(recipe);
+  return ok;
+}
+
+#endif // RECIPE_IMPLEMENTATION
@@ -0,0 +1,323 @@
+/*
+ * render_worker.h - runs the edit pipeline on a background thread
+ *
+ * usage:
+ *   #define RENDER_WORKER_IMPLEMENTATION
+ *   #include "render_worker.h"
+ *
+ * the ui thread never waits on image processing. it posts the latest
+ * EditParams and, once a frame, polls for a finished preview to upload.
+ * there is only ever one pending request: posting again replaces it, so
+ * dragging a slider only ever renders the newest value instead of queueing up
+ * every step in between. as soon as a render finishes the newest request is
+ * picked up, there are no fixed delays.
+ *
+ * the worker keeps track of how long full previews take. when that is more
+ * than a ui frame it renders progressively: first a draft at half the
+ * preview size, which goes out right away, then the full preview. only that
+ * slow full pass gets cancelled by newer requests, fast renders always run to
+ * the end so the screen keeps updating while a slider is being dragged.
+ */
+
+#include "raylib.h"
+
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include "image_pipeline.h"
+
+typedef struct RenderWorker RenderWorker;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+RenderWorker *render_worker_create(void);
+void render_worker_destroy(RenderWorker *worker);
+
+// waits for the in-flight render to stop. the pipelines share the source
+// tiles, the caller may free its own copy whenever it likes
+void render_worker_set_source(RenderWorker *worker, const TiledImage *source);
+// params are copied, texts included
+void render_worker_post(RenderWorker *worker, EditParams params);
+// throws away the cached stages from `from` on before the next render
+void render_worker_invalidate(RenderWorker *worker, PipelineStage from);
+// how long the ui can wait for a preview, usually its measured frame time
+void render_worker_set_frame_budget(RenderWorker *worker, float seconds);
+// hands over the newest finished preview, the caller owns it afterwards
+bool render_worker_poll(RenderWorker *worker, Image *preview);
+// true while a posted request hasn't been turned into a preview yet
+bool render_worker_busy(RenderWorker *worker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RENDER_WORKER_H
+
+/*
+ * RENDER_WORKER IMPLEMENTATION
+ */
+#if defined(RENDER_WORKER_IMPLEMENTATION)
+
+#include "profiler.h"
+
+#include <math.h> // Required for: fmaxf()
+#include <pthread.h>
+#include <stdlib.h> // Required for: calloc(), free()
+#include <string.h> // Required for: strdup()
+#include <time.h>   // Required for: timespec_get()
+
+// weight of the newest measurement in the render time average
+#define RENDER_TIME_SMOOTHING 0.3
+
+struct RenderWorker {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  bool quit;
+
+  // only touched by the worker thread, or by others while it is idle.
+  // the draft pipeline has its own caches so drafts never throw away the
+  // stages of the full preview
+  ImagePipeline pipeline;
+  ImagePipeline draft;
+  atomic_bool cancel;
+  atomic_bool draft_cancel;
+
+  // average seconds a full preview took, and what the ui can afford
+  double render_seconds;
+  double frame_budget;
+  // whether the render in flight may be cancelled by a newer request
+  bool cancellable;
+
+  // newest request, owned copies of the texts
+  EditParams pending;
+  TextObject *pending_texts;
+  bool has_pending;
+  PipelineStage invalidate_from;
+  bool rendering;
+
+  // newest finished preview
+  Image result;
+  bool has_result;
+};
+
+static void free_texts(TextObject *texts, int count) {
+  for (int i = 0; i < count; i++)
+    free(texts[i].text);
+  free(texts);
+}
+
+static TextObject *copy_texts(const TextObject *texts, int count) {
+  if (count == 0)
+    return NULL;
+  TextObject *copy = malloc(count * sizeof(TextObject));
+  for (int i = 0; i < count; i++) {
+    copy[i].text = strdup(texts[i].text);
+    copy[i].position = texts[i].position;
+  }
+  return copy;
+}
+
+static void drop_pending(RenderWorker *worker) {
+  if (worker->has_pending)
+    free_texts(worker->pending_texts, worker->pending.text_count);
+  worker->pending_texts = NULL;
+  worker->has_pending = false;
+}
+
+static void drop_result(RenderWorker *worker) {
+  if (worker->has_result)
+    UnloadImage(worker->result);
+  worker->result = (Image){0};
+  worker->has_result = false;
+}
+
+static double worker_now(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// called with the lock held. the pipeline keeps its own preview, ship a copy
+// the ui can own
+static void publish(RenderWorker *worker, Image preview) {
+  drop_result(worker);
+  PROFILE_SCOPE(PROFILE_COPY) { worker->result = ImageCopy(preview); }
+  worker->has_result = true;
+}
+
+static void *render_worker_main(void *arg) {
+  RenderWorker *worker = arg;
+
+  pthread_mutex_lock(&worker->lock);
+  for (;;) {
+    while (!worker->quit && !worker->has_pending)
+      pthread_cond_wait(&worker->wake, &worker->lock);
+    if (worker->quit)
+      break;
+
+    // take the newest request
+    EditParams params = worker->pending;
+    TextObject *texts = worker->pending_texts;
+    PipelineStage invalidate_from = worker->invalidate_from;
+    bool progressive = worker->render_seconds > worker->frame_budget;
+    worker->pending_texts = NULL;
+    worker->has_pending = false;
+    worker->invalidate_from = STAGE_COUNT;
+    worker->rendering = true;
+    worker->cancellable = false;
+    atomic_store(&worker->cancel, false);
+    atomic_store(&worker->draft_cancel, false);
+    pthread_mutex_unlock(&worker->lock);
+
+    if (invalidate_from != STAGE_COUNT) {
+      pipeline_invalidate(&worker->pipeline, invalidate_from);
+      pipeline_invalidate(&worker->draft, invalidate_from);
+    }
+
+    bool superseded = false;
+    if (progressive) {
+      EditParams draft_params = params;
+      draft_params.preview_size.x = fmaxf(1, params.preview_size.x / 2);
+      draft_params.preview_size.y = fmaxf(1, params.preview_size.y / 2);
+      Image draft = pipeline_update(&worker->draft, draft_params);
+
+      // from here on a newer request may cancel the full preview, the ui
+      // already has something close to show
+      pthread_mutex_lock(&worker->lock);
+      if (draft.data)
+        publish(worker, draft);
+      superseded = worker->has_pending;
+      worker->cancellable = true;
+      pthread_mutex_unlock(&worker->lock);
+    }
+
+    if (!superseded) {
+      double start = worker_now();
+      Image preview = pipeline_update(&worker->pipeline, params);
+      double seconds = worker_now() - start;
+
+      pthread_mutex_lock(&worker->lock);
+      if (preview.data) {
+        publish(worker, preview);
+        worker->render_seconds =
+            worker->render_seconds == 0
+                ? seconds
+                : worker->render_seconds * (1 - RENDER_TIME_SMOOTHING) +
+                      seconds * RENDER_TIME_SMOOTHING;
+      }
+      pthread_mutex_unlock(&worker->lock);
+    }
+    free_texts(texts, params.text_count);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->rendering = false;
+    worker->cancellable = false;
+    pthread_cond_broadcast(&worker->idle);
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return NULL;
+}
+
+RenderWorker *render_worker_create(void) {
+  RenderWorker *worker = calloc(1, sizeof(RenderWorker));
+  pthread_mutex_init(&worker->lock, NULL);
+  pthread_cond_init(&worker->wake, NULL);
+  pthread_cond_init(&worker->idle, NULL);
+  atomic_init(&worker->cancel, false);
+  atomic_init(&worker->draft_cancel, false);
+  worker->pipeline.cancel = &worker->cancel;
+  worker->draft.cancel = &worker->draft_cancel;
+  worker->invalidate_from = STAGE_COUNT;
+  worker->frame_budget = 1 / 60.0;
+  pthread_create(&worker->thread, NULL, render_worker_main, worker);
+  return worker;
+}
+
+void render_worker_destroy(RenderWorker *worker) {
+  pthread_mutex_lock(&worker->lock);
+  worker->quit = true;
+  atomic_store(&worker->cancel, true);
+  atomic_store(&worker->draft_cancel, true);
+  pthread_cond_signal(&worker->wake);
+  pthread_mutex_unlock(&worker->lock);
+  pthread_join(worker->thread, NULL);
+
+  drop_pending(worker);
+  drop_result(worker);
+  pipeline_unload(&worker->pipeline);
+  pipeline_unload(&worker->draft);
+  pthread_cond_destroy(&worker->idle);
+  pthread_cond_destroy(&worker->wake);
+  pthread_mutex_destroy(&worker->lock);
+  free(worker);
+}
+
+void render_worker_set_source(RenderWorker *worker, const TiledImage *source) {
+  pthread_mutex_lock(&worker->lock);
+  drop_pending(worker);
+  drop_result(worker);
+  atomic_store(&worker->cancel, true);
+  atomic_store(&worker->draft_cancel, true);
+  while (worker->rendering)
+    pthread_cond_wait(&worker->idle, &worker->lock);
+
+  // the worker is parked on the wake condition now, the pipelines are ours
+  pipeline_set_source(&worker->pipeline, source);
+  pipeline_set_source(&worker->draft, source);
+  worker->invalidate_from = STAGE_COUNT;
+  worker->render_seconds = 0;
+  pthread_mutex_unlock(&worker->lock);
+}
+
+void render_worker_post(RenderWorker *worker, EditParams params) {
+  TextObject *texts = copy_texts(params.texts, params.text_count);
+
+  pthread_mutex_lock(&worker->lock);
+  drop_pending(worker);
+  worker->pending = params;
+  worker->pending.texts = texts;
+  worker->pending_texts = texts;
+  worker->has_pending = true;
+  if (worker->cancellable)
+    atomic_store(&worker->cancel, true);
+  pthread_cond_signal(&worker->wake);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+void render_worker_invalidate(RenderWorker *worker, PipelineStage from) {
+  pthread_mutex_lock(&worker->lock);
+  if (from < worker->invalidate_from)
+    worker->invalidate_from = from;
+  pthread_mutex_unlock(&worker->lock);
+}
+
+void render_worker_set_frame_budget(RenderWorker *worker, float seconds) {
+  pthread_mutex_lock(&worker->lock);
+  worker->frame_budget = seconds;
+  pthread_mutex_unlock(&worker->lock);
+}
+
+bool render_worker_poll(RenderWorker *worker, Image *preview) {
+  pthread_mutex_lock(&worker->lock);
+  bool ready = worker->has_result;
+  if (ready) {
+    *preview = worker->result;
+    worker->result = (Image){0};
+    worker->has_result = false;
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return ready;
+}
+
+bool render_worker_busy(RenderWorker *worker) {
+  pthread_mutex_lock(&worker->lock);
+  bool busy = worker->has_pending || worker->rendering;
+  pthread_mutex_unlock(&worker->lock);
+  return busy;
+}
+
+#endif // RENDER_WORKER_IMPLEMENTATION
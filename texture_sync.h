@@ -0,0 +1,142 @@
+/*
+ * texture_sync.h - keeps a texture in step with an image that changes a bit
+ * at a time
+ *
+ * usage:
+ *   #define TEXTURE_SYNC_IMPLEMENTATION
+ *   #include "texture_sync.h"
+ *
+ * most edits only touch part of the preview (a text, the context box), yet
+ * unloading and loading the texture reallocates it and uploads every pixel.
+ * texture_sync() keeps the texture as long as the size and format still match
+ * and compares the new image against the one it replaces to upload only the
+ * rectangle that actually changed. reading both images once is a lot cheaper
+ * than pushing the whole thing over the bus again.
+ */
+
+#include "raylib.h"
+
+#ifndef TEXTURE_SYNC_H
+#define TEXTURE_SYNC_H
+
+#include <stdbool.h>
+
+// reusable buffer for dirty rectangles narrower than the image, whose rows
+// aren't contiguous in the image
+typedef struct {
+  unsigned char *data;
+  int size;
+} TextureStaging;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bounding box of the pixels that differ, zero sized if the images match.
+// images of a different size or format are different everywhere
+Rectangle image_dirty_rect(Image before, Image after);
+// previous is what the texture currently shows, pass (Image){0} if unknown.
+// returns true if the texture had to be recreated
+bool texture_sync(Texture2D *texture, Image image, Image previous,
+                  TextureStaging *staging);
+void texture_staging_free(TextureStaging *staging);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEXTURE_SYNC_H
+
+/*
+ * TEXTURE_SYNC IMPLEMENTATION
+ */
+#if defined(TEXTURE_SYNC_IMPLEMENTATION)
+
+#include <stdlib.h> // Required for: realloc(), free()
+#include <string.h> // Required for: memcmp(), memcpy()
+
+Rectangle image_dirty_rect(Image before, Image after) {
+  Rectangle full = {0, 0, after.width, after.height};
+  if (before.data == NULL || after.data == NULL ||
+      before.width != after.width || before.height != after.height ||
+      before.format != after.format ||
+      after.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+    return full;
+
+  const int stride = after.width * 4;
+  const unsigned char *a = before.data;
+  const unsigned char *b = after.data;
+
+  int y0 = 0;
+  while (y0 < after.height && memcmp(a + y0 * stride, b + y0 * stride,
+                                     stride) == 0)
+    y0++;
+  if (y0 == after.height)
+    return (Rectangle){0};
+  int y1 = after.height;
+  while (memcmp(a + (y1 - 1) * stride, b + (y1 - 1) * stride, stride) == 0)
+    y1--;
+
+  // narrow down the columns inside the changed rows, pixel by pixel
+  int x0 = after.width, x1 = 0;
+  for (int y = y0; y < y1; y++) {
+    const unsigned int *row_a = (const unsigned int *)(a + y * stride);
+    const unsigned int *row_b = (const unsigned int *)(b + y * stride);
+    int left = 0;
+    while (left < x0 && row_a[left] == row_b[left])
+      left++;
+    if (left == after.width)
+      continue;
+    x0 = left;
+    int right = after.width;
+    while (right > x1 && row_a[right - 1] == row_b[right - 1])
+      right--;
+    x1 = right > x1 ? right : x1;
+  }
+  return (Rectangle){x0, y0, x1 - x0, y1 - y0};
+}
+
+bool texture_sync(Texture2D *texture, Image image, Image previous,
+                  TextureStaging *staging) {
+  bool reusable = texture->id > 0 && texture->width == image.width &&
+                  texture->height == image.height &&
+                  texture->format == image.format;
+  if (!reusable) {
+    if (texture->id > 0)
+      UnloadTexture(*texture);
+    *texture = LoadTextureFromImage(image);
+    return true;
+  }
+
+  Rectangle dirty = image_dirty_rect(previous, image);
+  if (dirty.width <= 0 || dirty.height <= 0)
+    return false;
+
+  int bytes = GetPixelDataSize(image.width, 1, image.format);
+  const unsigned char *pixels = image.data;
+  if (dirty.width == image.width) {
+    // whole rows are contiguous already, upload straight from the image
+    UpdateTextureRec(*texture, dirty, pixels + (int)dirty.y * bytes);
+    return false;
+  }
+
+  int x0 = dirty.x, y0 = dirty.y, width = dirty.width, height = dirty.height;
+  int pixel = bytes / image.width;
+  int needed = width * height * pixel;
+  if (staging->size < needed) {
+    staging->data = realloc(staging->data, needed);
+    staging->size = needed;
+  }
+  for (int y = 0; y < height; y++)
+    memcpy(staging->data + y * width * pixel,
+           pixels + (y0 + y) * bytes + x0 * pixel, width * pixel);
+  UpdateTextureRec(*texture, dirty, staging->data);
+  return false;
+}
+
+void texture_staging_free(TextureStaging *staging) {
+  free(staging->data);
+  *staging = (TextureStaging){0};
+}
+
+#endif // TEXTURE_SYNC_IMPLEMENTATION
@@ -0,0 +1,580 @@
+/*
+ * thumbnail_cache.h - small previews of image files, made in the background
+ *
+ * usage:
+ *   #define THUMBNAIL_CACHE_IMPLEMENTATION
+ *   #include "thumbnail_cache.h"
+ *
+ * asking for a thumbnail never blocks. the first ask queues the file for a
+ * few decoder threads and returns nothing, later asks return the texture once
+ * it's there. the most recently asked for files are decoded first, so
+ * scrolling through a big folder works on what's on screen instead of what
+ * already scrolled past.
+ *
+ * jpegs are decoded straight at 1/2, 1/4 or 1/8 scale (see jpeg_scaled.h),
+ * everything else is decoded whole and shrunk, unless its header says that
+ * takes more than the memory cap. those keep their icon. the pixels are then
+ * written as they are to the user's cache directory, named after the file's
+ * path, modification time and size, so opening the folder again only reads a
+ * few kilobytes per file back. a file that changed gets a new name and is
+ * decoded again. reading a stored thumbnail marks it as used, and once they
+ * take more than THUMBNAIL_DISK_CAPACITY bytes the ones used longest ago are
+ * deleted.
+ *
+ * the decoders stay away from raylib's file name helpers (IsFileExtension()
+ * and everything built on it, ExportImage() included), they share static
+ * buffers with the ui thread.
+ *
+ * textures are uploaded by thumbnail_cache_update(), a few per frame, and the
+ * least recently asked for are unloaded once there are more than
+ * THUMBNAIL_CACHE_CAPACITY.
+ */
+
+#include "raylib.h"
+
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ThumbnailCache ThumbnailCache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// size is the longest side of a thumbnail in pixels. files that would take
+// more than memory_cap bytes decoded whole get no thumbnail
+ThumbnailCache *thumbnail_cache_create(int size, size_t memory_cap);
+// waits for the decoders and unloads the textures, needs the gl context
+void thumbnail_cache_destroy(ThumbnailCache *cache);
+// the thumbnail of a file, a texture with id 0 while it's being made or when
+// the file can't be decoded. modified and size tell a changed file apart
+Texture2D thumbnail_cache_get(ThumbnailCache *cache, const char *path,
+                              long modified, long long size);
+// uploads finished thumbnails, once a frame from the thread with the gl
+// context. that's also the only thread thumbnail_cache_get() may be called on
+void thumbnail_cache_update(ThumbnailCache *cache);
+// whether a file looks like something the decoders can read, by extension
+bool thumbnail_cache_supports(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THUMBNAIL_CACHE_H
+
+/*
+ * THUMBNAIL_CACHE IMPLEMENTATION
+ */
+#if defined(THUMBNAIL_CACHE_IMPLEMENTATION)
+
+#include "jpeg_scaled.h"
+#include "profiler.h"
+#include "tile_pool.h"
+
+#include <pthread.h>
+#include <stdint.h> // Required for: uint64_t
+#include <stdio.h>  // Required for: fopen(), snprintf(), rename(), remove()
+#include <stdlib.h> // Required for: calloc(), free(), getenv(), qsort()
+#include <string.h> // Required for: strdup(), memcmp(), strlen()
+
+#if defined(_WIN32)
+#include <direct.h>    // Required for: _mkdir()
+#include <io.h>        // Required for: _findfirst64(), _findnext64()
+#include <sys/utime.h> // Required for: _utime()
+#define make_directory(path) _mkdir(path)
+#define touch_file(path) _utime(path, NULL)
+#else
+#include <dirent.h>   // Required for: opendir(), readdir(), closedir()
+#include <sys/stat.h> // Required for: mkdir(), fstatat()
+#include <utime.h>    // Required for: utime()
+#define make_directory(path) mkdir(path, 0755)
+#define touch_file(path) utime(path, NULL)
+#endif
+
+#define THUMBNAIL_CACHE_CAPACITY 512
+#define THUMBNAIL_MAX_DECODERS 4
+// more than this and opening a folder of cached thumbnails stutters
+#define THUMBNAIL_UPLOADS_PER_FRAME 8
+// stored thumbnails start with this, then their width and height
+#define THUMBNAIL_MAGIC "dsy1"
+// what the stored thumbnails may take on disk, trimming goes down to 3/4 of
+// it so it doesn't happen again right after the next few new ones
+#define THUMBNAIL_DISK_CAPACITY (64ll << 20)
+
+typedef enum {
+  THUMBNAIL_EMPTY,
+  THUMBNAIL_QUEUED,
+  THUMBNAIL_DECODING,
+  THUMBNAIL_DECODED,
+  THUMBNAIL_UPLOADING,
+  THUMBNAIL_LOADED,
+  THUMBNAIL_FAILED,
+} ThumbnailState;
+
+typedef struct {
+  uint64_t key;
+  char *path;
+  ThumbnailState state;
+  unsigned int last_used;
+  // set by the decoder, owned by whoever moves the entry to the next state
+  Image image;
+  Texture2D texture;
+} Thumbnail;
+
+struct ThumbnailCache {
+  pthread_t threads[THUMBNAIL_MAX_DECODERS];
+  int thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool quit;
+
+  int size;
+  size_t memory_cap;
+  // empty when there's nowhere to keep thumbnails between runs
+  char directory[4096];
+  // bytes in the directory as of the last trim plus what was stored since,
+  // and whether a decoder should trim it before its next thumbnail. both
+  // under the lock
+  long long stored_bytes;
+  bool trim;
+
+  // a decoder only touches an entry while it's THUMBNAIL_DECODING, the rest
+  // of the time it belongs to the ui thread. states change under the lock
+  Thumbnail entries[THUMBNAIL_CACHE_CAPACITY];
+  unsigned int clock;
+};
+
+// fnv-1a over the path, then the modification time and the size
+static uint64_t thumbnail_key(const char *path, long modified,
+                              long long size) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char *c = path; *c; c++)
+    hash = (hash ^ (unsigned char)*c) * 0x100000001b3ull;
+  for (int i = 0; i < 8; i++)
+    hash = (hash ^ ((uint64_t)modified >> i * 8 & 0xff)) * 0x100000001b3ull;
+  for (int i = 0; i < 8; i++)
+    hash = (hash ^ ((uint64_t)size >> i * 8 & 0xff)) * 0x100000001b3ull;
+  return hash;
+}
+
+// makes every missing directory on the way, like mkdir -p
+static bool make_directories(char *path) {
+  for (char *c = path + 1; *c; c++) {
+    if (*c != '/' && *c != '\\')
+      continue;
+    char separator = *c;
+    *c = '\0';
+    make_directory(path);
+    *c = separator;
+  }
+  make_directory(path);
+  return DirectoryExists(path);
+}
+
+// $XDG_CACHE_HOME/daisy/thumbnails, ~/.cache on unix and %LOCALAPPDATA% on
+// windows when that isn't set
+static void find_cache_directory(char *directory, size_t capacity) {
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = NULL;
+#if defined(_WIN32)
+  if (base == NULL || *base == '\0')
+    base = getenv("LOCALAPPDATA");
+#else
+  if (base == NULL || *base == '\0')
+    home = getenv("HOME");
+#endif
+  directory[0] = '\0';
+  if (base && *base)
+    snprintf(directory, capacity, "%s/daisy/thumbnails", base);
+  else if (home && *home)
+    snprintf(directory, capacity, "%s/.cache/daisy/thumbnails", home);
+  if (directory[0] && !make_directories(directory))
+    directory[0] = '\0';
+}
+
+bool thumbnail_cache_supports(const char *path) {
+  return IsFileExtension(path, ".png;.jpg;.jpeg;.bmp;.tga;.gif;.qoi");
+}
+
+// the biggest jpeg scale that still leaves size pixels on the longest side
+static int thumbnail_jpeg_scale(int width, int height, int size) {
+  int longest = width > height ? width : height;
+  int scale = 8;
+  while (scale > 1 && (longest + scale - 1) / scale < size)
+    scale /= 2;
+  return scale;
+}
+
+static bool thumbnail_png_size(const unsigned char *data, int length,
+                               int *width, int *height) {
+  if (length < 24 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0 ||
+      memcmp(data + 12, "IHDR", 4) != 0)
+    return false;
+  const unsigned char *p = data + 16;
+  *width = (int)((unsigned)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+  *height = (int)((unsigned)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7]);
+  return true;
+}
+
+static bool thumbnail_over_cap(int width, int height, size_t memory_cap) {
+  return (size_t)width * height * sizeof(Color) > memory_cap;
+}
+
+static Image decode_thumbnail(const char *path, int size, size_t memory_cap) {
+  int length = 0;
+  unsigned char *data = LoadFileData(path, &length);
+  if (data == NULL)
+    return (Image){0};
+
+  Image image = {0};
+  int width = 0, height = 0;
+  if (jpeg_read_size(data, length, &width, &height)) {
+    int scale = thumbnail_jpeg_scale(width, height, size);
+    if (scale > 1)
+      image = jpeg_decode_scaled(data, length, scale);
+  } else if (!thumbnail_png_size(data, length, &width, &height)) {
+    width = height = 0;
+  }
+  // progressive jpegs and everything else go through raylib, which holds the
+  // whole image. same check as the image loader, only without the tiles to
+  // fall back on
+  if (image.data == NULL && !thumbnail_over_cap(width, height, memory_cap)) {
+    image = LoadImageFromMemory(GetFileExtension(path), data, length);
+    // only over the cap here if the header check couldn't read its size
+    if (image.data &&
+        thumbnail_over_cap(image.width, image.height, memory_cap)) {
+      UnloadImage(image);
+      image = (Image){0};
+    }
+  }
+  UnloadFileData(data);
+  if (image.data == NULL)
+    return image;
+
+  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  int longest = image.width > image.height ? image.width : image.height;
+  if (longest > size) {
+    width = (long long)image.width * size / longest;
+    height = (long long)image.height * size / longest;
+    ImageResize(&image, width > 0 ? width : 1, height > 0 ? height : 1);
+  }
+  return image;
+}
+
+static Image read_stored_thumbnail(const char *path, int size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return (Image){0};
+  char magic[4];
+  int dimensions[2];
+  Image image = {0};
+  if (fread(magic, 4, 1, file) == 1 && memcmp(magic, THUMBNAIL_MAGIC, 4) == 0 &&
+      fread(dimensions, sizeof(dimensions), 1, file) == 1 &&
+      dimensions[0] > 0 && dimensions[0] <= size && dimensions[1] > 0 &&
+      dimensions[1] <= size) {
+    size_t bytes = (size_t)dimensions[0] * dimensions[1] * sizeof(Color);
+    void *pixels = RL_MALLOC(bytes);
+    if (fread(pixels, bytes, 1, file) == 1)
+      image = (Image){pixels, dimensions[0], dimensions[1], 1,
+                      PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    else
+      RL_FREE(pixels);
+  }
+  fclose(file);
+  return image;
+}
+
+// written under another name first, a half written file is never read
+static bool store_thumbnail(const char *path, Image image) {
+  char temporary[4096 + 64];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *file = fopen(temporary, "wb");
+  if (file == NULL)
+    return false;
+  int dimensions[2] = {image.width, image.height};
+  size_t bytes = (size_t)image.width * image.height * sizeof(Color);
+  bool ok = fwrite(THUMBNAIL_MAGIC, 4, 1, file) == 1 &&
+            fwrite(dimensions, sizeof(dimensions), 1, file) == 1 &&
+            fwrite(image.data, bytes, 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temporary, path) != 0) {
+    remove(temporary);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  char name[32];
+  long long bytes;
+  long modified;
+} StoredThumbnail;
+
+static int compare_stored(const void *a, const void *b) {
+  long x = ((const StoredThumbnail *)a)->modified;
+  long y = ((const StoredThumbnail *)b)->modified;
+  return (x > y) - (x < y);
+}
+
+// only names store_thumbnail() makes, "<16 hex digits>-<size>", never
+// someone's half written .tmp
+static void add_stored(StoredThumbnail **stored, int *count, int *capacity,
+                       const char *name, long long bytes, long modified) {
+  size_t length = strlen(name);
+  if (length < 18 || length >= sizeof((*stored)->name) || name[16] != '-' ||
+      strchr(name, '.') != NULL)
+    return;
+  if (*count == *capacity) {
+    *capacity = *capacity * 2 + 256;
+    *stored = realloc(*stored, *capacity * sizeof(StoredThumbnail));
+  }
+  StoredThumbnail *entry = &(*stored)[(*count)++];
+  memcpy(entry->name, name, length + 1);
+  entry->bytes = bytes;
+  entry->modified = modified;
+}
+
+// deletes the thumbnails used longest ago until they fit the capacity again,
+// returns how many bytes are left. runs on a decoder thread, a thumbnail
+// that disappears under another decoder is just made again
+static long long trim_stored_thumbnails(const char *directory) {
+  StoredThumbnail *stored = NULL;
+  int count = 0, capacity = 0;
+  long long total = 0;
+#if defined(_WIN32)
+  char pattern[4096 + 8];
+  snprintf(pattern, sizeof(pattern), "%s/*", directory);
+  struct __finddata64_t data;
+  intptr_t handle = _findfirst64(pattern, &data);
+  if (handle != -1) {
+    do {
+      if (!(data.attrib & _A_SUBDIR))
+        add_stored(&stored, &count, &capacity, data.name, data.size,
+                   (long)data.time_write);
+    } while (_findnext64(handle, &data) == 0);
+    _findclose(handle);
+  }
+#else
+  DIR *dir = opendir(directory);
+  if (dir != NULL) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      struct stat info;
+      if (fstatat(dirfd(dir), entry->d_name, &info, 0) == 0 &&
+          S_ISREG(info.st_mode))
+        add_stored(&stored, &count, &capacity, entry->d_name, info.st_size,
+                   (long)info.st_mtime);
+    }
+    closedir(dir);
+  }
+#endif
+  for (int i = 0; i < count; i++)
+    total += stored[i].bytes;
+
+  if (total > THUMBNAIL_DISK_CAPACITY) {
+    qsort(stored, count, sizeof(StoredThumbnail), compare_stored);
+    char path[4096 + 32];
+    for (int i = 0; i < count && total > THUMBNAIL_DISK_CAPACITY / 4 * 3;
+         i++) {
+      snprintf(path, sizeof(path), "%s/%s", directory, stored[i].name);
+      if (remove(path) == 0)
+        total -= stored[i].bytes;
+    }
+  }
+  free(stored);
+  return total;
+}
+
+static Image make_thumbnail(ThumbnailCache *cache, const char *path,
+                            uint64_t key) {
+  // the size is part of the name, a build with bigger thumbnails doesn't
+  // pick up the small ones
+  char stored[4096 + 32] = "";
+  if (cache->directory[0]) {
+    snprintf(stored, sizeof(stored), "%s/%016llx-%d", cache->directory,
+             (unsigned long long)key, cache->size);
+    Image image = read_stored_thumbnail(stored, cache->size);
+    if (image.data) {
+      // the trim goes by modification time, this one was just used
+      touch_file(stored);
+      return image;
+    }
+  }
+
+  Image image = decode_thumbnail(path, cache->size, cache->memory_cap);
+  if (image.data && stored[0] && store_thumbnail(stored, image)) {
+    long long bytes = 12 + (long long)image.width * image.height * 4;
+    pthread_mutex_lock(&cache->lock);
+    cache->stored_bytes += bytes;
+    if (cache->stored_bytes > THUMBNAIL_DISK_CAPACITY)
+      cache->trim = true;
+    pthread_mutex_unlock(&cache->lock);
+  }
+  return image;
+}
+
+static void *thumbnail_decoder_main(void *arg) {
+  ThumbnailCache *cache = arg;
+
+  pthread_mutex_lock(&cache->lock);
+  for (;;) {
+    // the newest ask first
+    Thumbnail *next = NULL;
+    for (int i = 0; i < THUMBNAIL_CACHE_CAPACITY; i++) {
+      Thumbnail *entry = &cache->entries[i];
+      if (entry->state == THUMBNAIL_QUEUED &&
+          (next == NULL || entry->last_used > next->last_used))
+        next = entry;
+    }
+    if (cache->quit)
+      break;
+    if (cache->trim) {
+      cache->trim = false;
+      pthread_mutex_unlock(&cache->lock);
+      long long bytes = trim_stored_thumbnails(cache->directory);
+      pthread_mutex_lock(&cache->lock);
+      cache->stored_bytes = bytes;
+      continue;
+    }
+    if (next == NULL) {
+      pthread_cond_wait(&cache->wake, &cache->lock);
+      continue;
+    }
+    next->state = THUMBNAIL_DECODING;
+    pthread_mutex_unlock(&cache->lock);
+
+    Image image = make_thumbnail(cache, next->path, next->key);
+
+    pthread_mutex_lock(&cache->lock);
+    next->image = image;
+    next->state = image.data ? THUMBNAIL_DECODED : THUMBNAIL_FAILED;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return NULL;
+}
+
+// called on the ui thread with the lock held
+static void release_thumbnail(Thumbnail *entry) {
+  if (entry->state == THUMBNAIL_DECODED)
+    UnloadImage(entry->image);
+  if (entry->state == THUMBNAIL_LOADED)
+    UnloadTexture(entry->texture);
+  free(entry->path);
+  *entry = (Thumbnail){0};
+}
+
+ThumbnailCache *thumbnail_cache_create(int size, size_t memory_cap) {
+  ThumbnailCache *cache = calloc(1, sizeof(ThumbnailCache));
+  cache->size = size;
+  cache->memory_cap = memory_cap;
+  find_cache_directory(cache->directory, sizeof(cache->directory));
+  // whatever earlier runs left, counted and trimmed off the ui thread
+  cache->trim = cache->directory[0] != '\0';
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->wake, NULL);
+
+  // decoding competes with the render worker, leave it most of the cores
+  int decoders = tile_pool_thread_count(tile_pool_shared()) / 2;
+  if (decoders > THUMBNAIL_MAX_DECODERS)
+    decoders = THUMBNAIL_MAX_DECODERS;
+  cache->thread_count = decoders < 1 ? 1 : decoders;
+  for (int i = 0; i < cache->thread_count; i++)
+    pthread_create(&cache->threads[i], NULL, thumbnail_decoder_main, cache);
+  return cache;
+}
+
+void thumbnail_cache_destroy(ThumbnailCache *cache) {
+  if (cache == NULL)
+    return;
+  pthread_mutex_lock(&cache->lock);
+  cache->quit = true;
+  pthread_cond_broadcast(&cache->wake);
+  pthread_mutex_unlock(&cache->lock);
+  for (int i = 0; i < cache->thread_count; i++)
+    pthread_join(cache->threads[i], NULL);
+
+  for (int i = 0; i < THUMBNAIL_CACHE_CAPACITY; i++)
+    release_thumbnail(&cache->entries[i]);
+  pthread_cond_destroy(&cache->wake);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+Texture2D thumbnail_cache_get(ThumbnailCache *cache, const char *path,
+                              long modified, long long size) {
+  uint64_t key = thumbnail_key(path, modified, size);
+  Texture2D texture = {0};
+
+  pthread_mutex_lock(&cache->lock);
+  Thumbnail *slot = NULL;
+  for (int i = 0; i < THUMBNAIL_CACHE_CAPACITY; i++) {
+    Thumbnail *entry = &cache->entries[i];
+    if (entry->state != THUMBNAIL_EMPTY && entry->key == key) {
+      entry->last_used = ++cache->clock;
+      if (entry->state == THUMBNAIL_LOADED)
+        texture = entry->texture;
+      pthread_mutex_unlock(&cache->lock);
+      return texture;
+    }
+    // an empty slot, or else the one asked for longest ago that no decoder
+    // is working on
+    if (entry->state == THUMBNAIL_DECODING ||
+        entry->state == THUMBNAIL_UPLOADING)
+      continue;
+    if (slot == NULL || (slot->state != THUMBNAIL_EMPTY &&
+                         (entry->state == THUMBNAIL_EMPTY ||
+                          entry->last_used < slot->last_used)))
+      slot = entry;
+  }
+
+  // every slot busy decoding, ask again next frame
+  if (slot) {
+    release_thumbnail(slot);
+    slot->key = key;
+    slot->path = strdup(path);
+    slot->state = THUMBNAIL_QUEUED;
+    slot->last_used = ++cache->clock;
+    pthread_cond_signal(&cache->wake);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return texture;
+}
+
+void thumbnail_cache_update(ThumbnailCache *cache) {
+  Thumbnail *decoded[THUMBNAIL_UPLOADS_PER_FRAME];
+  int count = 0;
+
+  pthread_mutex_lock(&cache->lock);
+  for (int i = 0; i < THUMBNAIL_CACHE_CAPACITY &&
+                  count < THUMBNAIL_UPLOADS_PER_FRAME;
+       i++) {
+    if (cache->entries[i].state == THUMBNAIL_DECODED) {
+      cache->entries[i].state = THUMBNAIL_UPLOADING;
+      decoded[count++] = &cache->entries[i];
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  if (count == 0)
+    return;
+
+  // uploading entries are skipped by everyone else, no lock needed
+  PROFILE_SCOPE(PROFILE_UPLOAD) {
+    for (int i = 0; i < count; i++) {
+      decoded[i]->texture = LoadTextureFromImage(decoded[i]->image);
+      SetTextureFilter(decoded[i]->texture, TEXTURE_FILTER_BILINEAR);
+      UnloadImage(decoded[i]->image);
+      decoded[i]->image = (Image){0};
+    }
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  for (int i = 0; i < count; i++)
+    decoded[i]->state = decoded[i]->texture.id ? THUMBNAIL_LOADED
+                                               : THUMBNAIL_FAILED;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+#endif // THUMBNAIL_CACHE_IMPLEMENTATION
@@ -0,0 +1,308 @@
+/*
+ * tile_pool.h - tile based job system for daisy's per-pixel effects
+ *
+ * usage:
+ *   #define TILE_POOL_IMPLEMENTATION
+ *   #include "tile_pool.h"
+ *
+ *   tile_pool_run(tile_pool_shared(), 0, 0, width, height, TILE_POOL_TILE_SIZE,
+ *                 TILE_POOL_TILE_SIZE, my_tile_function, &my_data);
+ *
+ * an area is cut into tiles small enough to stay in cache and the tiles are
+ * handed out to one worker per core. every worker starts with its own
+ * contiguous run of tiles and, once that is empty, steals from the back of the
+ * others' runs, so uneven tiles (text, image borders) still keep every core
+ * busy. the calling thread works along and tile_pool_run() only returns once
+ * every tile is done.
+ *
+ * tiles never overlap, a tile function that needs neighbouring pixels (blur)
+ * reads them from an input buffer it doesn't write to. such functions should
+ * use tiles that are long in the direction they read around a pixel, so the
+ * halo they read twice stays small next to the tile.
+ */
+
+#ifndef TILE_POOL_H
+#define TILE_POOL_H
+
+#include <stdbool.h>
+
+// 128x128 rgba8 tile is 64kb, in and out fit in l2 on anything recent
+#define TILE_POOL_TILE_SIZE 128
+
+typedef struct {
+  int x0, y0, x1, y1;
+} Tile;
+
+typedef void (*TileFunction)(void *user, Tile tile);
+
+typedef struct TilePool TilePool;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// threads <= 0 means one per core, the calling thread counts as one of them
+TilePool *tile_pool_create(int threads);
+void tile_pool_destroy(TilePool *pool);
+int tile_pool_thread_count(TilePool *pool);
+
+// pool shared by the whole program, created on first use
+TilePool *tile_pool_shared(void);
+
+// tile sizes <= 0 default to TILE_POOL_TILE_SIZE
+void tile_pool_run(TilePool *pool, int x0, int y0, int x1, int y1,
+                   int tile_width, int tile_height, TileFunction function,
+                   void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TILE_POOL_H
+
+/*
+ * TILE_POOL IMPLEMENTATION
+ */
+#if defined(TILE_POOL_IMPLEMENTATION)
+
+#include <pthread.h>
+#include <stdlib.h> // Required for: calloc(), free(), getenv(), atoi()
+
+#if !defined(_WIN32)
+#include <unistd.h> // Required for: sysconf()
+#endif
+
+#define TILE_POOL_MAX_THREADS 64
+
+// run of tile indices owned by one worker, popped from the front by its
+// owner and stolen from the back by everybody else
+typedef struct {
+  pthread_mutex_t lock;
+  int head;
+  int tail;
+} TileQueue;
+
+typedef struct {
+  TilePool *pool;
+  int index;
+} TileWorker;
+
+struct TilePool {
+  int thread_count;
+  pthread_t threads[TILE_POOL_MAX_THREADS];
+  TileWorker workers[TILE_POOL_MAX_THREADS];
+  TileQueue queues[TILE_POOL_MAX_THREADS];
+
+  // only one run at a time, tile_pool_run() holds this for its whole length
+  pthread_mutex_t run_lock;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;
+  pthread_cond_t work_done;
+  unsigned int generation;
+  int busy;
+  bool quit;
+
+  // the current run
+  int x0, y0, x1, y1;
+  int columns, tile_width, tile_height;
+  TileFunction function;
+  void *user;
+};
+
+// DAISY_THREADS overrides the core count, handy for profiling scaling
+static int tile_pool_core_count(void) {
+  const char *forced = getenv("DAISY_THREADS");
+  if (forced && atoi(forced) > 0)
+    return atoi(forced);
+
+#if defined(_WIN32)
+  const char *count = getenv("NUMBER_OF_PROCESSORS");
+  int cores = count ? atoi(count) : 1;
+#else
+  int cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return cores > 0 ? cores : 1;
+}
+
+static bool pop_tile(TilePool *pool, int self, int *tile) {
+  TileQueue *own = &pool->queues[self];
+  pthread_mutex_lock(&own->lock);
+  bool found = own->head < own->tail;
+  if (found)
+    *tile = own->head++;
+  pthread_mutex_unlock(&own->lock);
+  if (found)
+    return true;
+
+  // own run is empty, steal from the back of the others starting with the
+  // next worker so thieves don't all pile onto the same victim
+  for (int i = 1; i < pool->thread_count; i++) {
+    TileQueue *victim = &pool->queues[(self + i) % pool->thread_count];
+    pthread_mutex_lock(&victim->lock);
+    found = victim->head < victim->tail;
+    if (found)
+      *tile = --victim->tail;
+    pthread_mutex_unlock(&victim->lock);
+    if (found)
+      return true;
+  }
+  return false;
+}
+
+static Tile tile_from_index(TilePool *pool, int index) {
+  Tile tile;
+  tile.x0 = pool->x0 + (index % pool->columns) * pool->tile_width;
+  tile.y0 = pool->y0 + (index / pool->columns) * pool->tile_height;
+  tile.x1 = tile.x0 + pool->tile_width < pool->x1 ? tile.x0 + pool->tile_width
+                                                  : pool->x1;
+  tile.y1 = tile.y0 + pool->tile_height < pool->y1
+                ? tile.y0 + pool->tile_height
+                : pool->y1;
+  return tile;
+}
+
+static void work_on_tiles(TilePool *pool, int self) {
+  int index;
+  while (pop_tile(pool, self, &index))
+    pool->function(pool->user, tile_from_index(pool, index));
+
+  pthread_mutex_lock(&pool->lock);
+  pool->busy--;
+  if (pool->busy == 0)
+    pthread_cond_broadcast(&pool->work_done);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *tile_worker_main(void *arg) {
+  TileWorker *worker = arg;
+  TilePool *pool = worker->pool;
+  unsigned int seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit && pool->generation == seen)
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    if (pool->quit) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    work_on_tiles(pool, worker->index);
+  }
+}
+
+TilePool *tile_pool_create(int threads) {
+  if (threads <= 0)
+    threads = tile_pool_core_count();
+  if (threads > TILE_POOL_MAX_THREADS)
+    threads = TILE_POOL_MAX_THREADS;
+
+  TilePool *pool = calloc(1, sizeof(TilePool));
+  pool->thread_count = threads;
+  pthread_mutex_init(&pool->run_lock, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+  for (int i = 0; i < threads; i++)
+    pthread_mutex_init(&pool->queues[i].lock, NULL);
+
+  // worker 0 is whoever calls tile_pool_run()
+  for (int i = 1; i < threads; i++) {
+    pool->workers[i] = (TileWorker){pool, i};
+    pthread_create(&pool->threads[i], NULL, tile_worker_main,
+                   &pool->workers[i]);
+  }
+  return pool;
+}
+
+void tile_pool_destroy(TilePool *pool) {
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 1; i < pool->thread_count; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  for (int i = 0; i < pool->thread_count; i++)
+    pthread_mutex_destroy(&pool->queues[i].lock);
+  pthread_cond_destroy(&pool->work_done);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->run_lock);
+  free(pool);
+}
+
+int tile_pool_thread_count(TilePool *pool) { return pool->thread_count; }
+
+static TilePool *shared_pool = NULL;
+
+static void create_shared_pool(void) { shared_pool = tile_pool_create(0); }
+
+TilePool *tile_pool_shared(void) {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, create_shared_pool);
+  return shared_pool;
+}
+
+void tile_pool_run(TilePool *pool, int x0, int y0, int x1, int y1,
+                   int tile_width, int tile_height, TileFunction function,
+                   void *user) {
+  if (x1 <= x0 || y1 <= y0)
+    return;
+  if (tile_width <= 0)
+    tile_width = TILE_POOL_TILE_SIZE;
+  if (tile_height <= 0)
+    tile_height = TILE_POOL_TILE_SIZE;
+
+  int columns = (x1 - x0 + tile_width - 1) / tile_width;
+  int rows = (y1 - y0 + tile_height - 1) / tile_height;
+  int count = columns * rows;
+
+  pthread_mutex_lock(&pool->run_lock);
+
+  pool->x0 = x0;
+  pool->y0 = y0;
+  pool->x1 = x1;
+  pool->y1 = y1;
+  pool->columns = columns;
+  pool->tile_width = tile_width;
+  pool->tile_height = tile_height;
+  pool->function = function;
+  pool->user = user;
+
+  // contiguous runs keep each worker on neighbouring tiles
+  int workers = pool->thread_count < count ? pool->thread_count : count;
+  for (int i = 0; i < pool->thread_count; i++) {
+    TileQueue *queue = &pool->queues[i];
+    pthread_mutex_lock(&queue->lock);
+    queue->head = i < workers ? (int)((long long)count * i / workers) : 0;
+    queue->tail =
+        i < workers ? (int)((long long)count * (i + 1) / workers) : 0;
+    pthread_mutex_unlock(&queue->lock);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->busy = pool->thread_count;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  work_on_tiles(pool, 0);
+
+  // wait for the workers to go idle too, not just for the tiles, so none of
+  // them is still looking at this run's queues when the next one starts
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0)
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+
+  pthread_mutex_unlock(&pool->run_lock);
+}
+
+#endif // TILE_POOL_IMPLEMENTATION
@@ -0,0 +1,492 @@
+/*
+ * tiled_image.h - copy-on-write tiled image storage
+ *
+ * usage:
+ *   #define TILED_IMAGE_IMPLEMENTATION
+ *   #include "tiled_image.h"
+ *
+ * a TiledImage is a grid of 256x256 rgba8 tiles, each one reference counted.
+ * copying an image only copies the grid and bumps the counts, the pixels are
+ * shared until somebody writes to a tile, which then gets its own copy. so
+ * an edit that touches a corner of a 100 megapixel photo costs a few tiles,
+ * not another 400mb.
+ *
+ * the counts are atomic, copies may live on different threads. writing the
+ * same TiledImage from two threads at once is only fine for different tiles.
+ *
+ * images bigger than the memory you want to spend on them can keep their
+ * tiles in a temporary cache file instead, mapped back in with mmap. only a
+ * capped amount of it stays resident: the least recently used tiles are
+ * dropped and the kernel reads them back from the file the next time they're
+ * touched. mapped tiles are never written, editing one copies it to the heap
+ * like any other shared tile. without mmap (windows) the tiles just go on
+ * the heap.
+ *
+ * such an image is built with a TiledImageWriter, from rows handed in top to
+ * bottom by a decoder that never holds the whole picture either (see
+ * jpeg_decode_rows()). the writer only keeps one row of tiles in memory and
+ * writes each to the file once it's full.
+ *
+ * the implementation needs posix.1-2008 and madvise(), define _GNU_SOURCE
+ * (or build with -std=gnu11) before including any system header.
+ */
+
+#include "raylib.h"
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TILED_IMAGE_TILE_SIZE 256
+
+typedef struct ImageTile ImageTile;
+typedef struct TiledImageWriter TiledImageWriter;
+
+typedef struct {
+  int width;
+  int height;
+  // size of the tile grid, edge tiles are padded to the full tile size
+  int columns;
+  int rows;
+  ImageTile **tiles;
+} TiledImage;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// image has to be rgba8, it stays owned by the caller
+TiledImage tiled_image_from_image(Image image);
+
+// an image of width x height filled in by rows. if it's bigger than
+// memory_cap bytes its tiles live in a cache file and at most memory_cap
+// bytes of them are resident at a time
+TiledImageWriter *tiled_image_writer_open(int width, int height,
+                                          size_t memory_cap);
+// count rows of width pixels each, packed one after the other
+bool tiled_image_writer_write_rows(TiledImageWriter *writer, const Color *rows,
+                                   int count);
+// frees the writer. the image has no tiles if anything failed along the way,
+// including rows missing
+TiledImage tiled_image_writer_close(TiledImageWriter *writer);
+
+// shares every tile with image, costs nothing until one of them is written
+TiledImage tiled_image_copy(const TiledImage *image);
+void tiled_image_free(TiledImage *image);
+
+// pixels of one tile, TILED_IMAGE_TILE_SIZE apart per row
+const Color *tiled_image_tile(const TiledImage *image, int column, int row);
+// same, but the tile is copied first if anybody else still shares it
+Color *tiled_image_tile_for_writing(TiledImage *image, int column, int row);
+
+// copy a rectangle out of or into the tiles, stride is in pixels. writing
+// only copies the tiles the rectangle touches
+void tiled_image_read(const TiledImage *image, int x, int y, int width,
+                      int height, Color *dst, int stride);
+void tiled_image_write(TiledImage *image, int x, int y, int width, int height,
+                       const Color *src, int stride);
+
+// the whole thing as one plain rgba8 image, owned by the caller
+Image tiled_image_to_image(const TiledImage *image);
+
+// pixels held by heap tiles across every image, mapped tiles don't count
+size_t tiled_image_heap_bytes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TILED_IMAGE_H
+
+/*
+ * TILED_IMAGE IMPLEMENTATION
+ */
+#if defined(TILED_IMAGE_IMPLEMENTATION)
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>  // Required for: snprintf()
+#include <stdlib.h> // Required for: malloc(), calloc(), free(), getenv()
+#include <string.h> // Required for: memcpy()
+
+#if !defined(_WIN32)
+#define TILED_IMAGE_MMAP
+#include <sys/mman.h> // Required for: mmap(), munmap(), madvise()
+#include <unistd.h>   // Required for: mkstemp(), pwrite(), ftruncate()
+#endif
+
+#define TILE_BYTES                                                             \
+  ((size_t)TILED_IMAGE_TILE_SIZE * TILED_IMAGE_TILE_SIZE * sizeof(Color))
+
+// the cache file behind mapped tiles. every mapped tile holds a reference,
+// the mapping goes away with the last of them
+typedef struct {
+  atomic_int refs;
+  int fd;
+  unsigned char *base;
+  size_t size;
+  size_t memory_cap;
+
+  // tiles that are (probably) resident, most recently used first. the
+  // kernel may drop pages on its own too, this is only what we know of
+  pthread_mutex_t lock;
+  int *newer;
+  int *older;
+  bool *resident;
+  int newest;
+  int oldest;
+  int resident_count;
+} TileCache;
+
+struct ImageTile {
+  atomic_int refs;
+  Color *pixels;
+  // NULL for heap tiles
+  TileCache *cache;
+  int cache_index;
+};
+
+static atomic_size_t heap_bytes;
+
+static ImageTile *new_tile(void) {
+  ImageTile *tile = malloc(sizeof(ImageTile) + TILE_BYTES);
+  atomic_fetch_add_explicit(&heap_bytes, TILE_BYTES, memory_order_relaxed);
+  atomic_init(&tile->refs, 1);
+  tile->pixels = (Color *)(tile + 1);
+  tile->cache = NULL;
+  tile->cache_index = 0;
+  return tile;
+}
+
+static void release_cache(TileCache *cache) {
+  if (atomic_fetch_sub(&cache->refs, 1) != 1)
+    return;
+#if defined(TILED_IMAGE_MMAP)
+  munmap(cache->base, cache->size);
+  close(cache->fd);
+#endif
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->newer);
+  free(cache->older);
+  free(cache->resident);
+  free(cache);
+}
+
+static void release_tile(ImageTile *tile) {
+  if (tile == NULL || atomic_fetch_sub(&tile->refs, 1) != 1)
+    return;
+  if (tile->cache)
+    release_cache(tile->cache);
+  else
+    atomic_fetch_sub_explicit(&heap_bytes, TILE_BYTES, memory_order_relaxed);
+  free(tile);
+}
+
+#if defined(TILED_IMAGE_MMAP)
+static void unlink_lru(TileCache *cache, int index) {
+  int newer = cache->newer[index], older = cache->older[index];
+  if (newer >= 0)
+    cache->older[newer] = older;
+  else
+    cache->newest = older;
+  if (older >= 0)
+    cache->newer[older] = newer;
+  else
+    cache->oldest = newer;
+}
+
+// called for every tile that gets read. dropping a tile is only a hint to
+// the kernel, its pages come straight back from the file, so a tile some
+// other thread is still reading can be dropped without harm
+static void touch_tile(TileCache *cache, int index) {
+  pthread_mutex_lock(&cache->lock);
+  if (cache->resident[index]) {
+    if (cache->newest == index) {
+      pthread_mutex_unlock(&cache->lock);
+      return;
+    }
+    unlink_lru(cache, index);
+  } else {
+    cache->resident[index] = true;
+    cache->resident_count++;
+  }
+
+  cache->older[index] = cache->newest;
+  cache->newer[index] = -1;
+  if (cache->newest >= 0)
+    cache->newer[cache->newest] = index;
+  cache->newest = index;
+  if (cache->oldest < 0)
+    cache->oldest = index;
+
+  while ((size_t)cache->resident_count * TILE_BYTES > cache->memory_cap &&
+         cache->oldest != index) {
+    int victim = cache->oldest;
+    unlink_lru(cache, victim);
+    cache->resident[victim] = false;
+    cache->resident_count--;
+    madvise(cache->base + victim * TILE_BYTES, TILE_BYTES, MADV_DONTNEED);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+#endif
+
+static TiledImage new_tiled_image(int width, int height) {
+  TiledImage image = {width, height,
+                      (width + TILED_IMAGE_TILE_SIZE - 1) /
+                          TILED_IMAGE_TILE_SIZE,
+                      (height + TILED_IMAGE_TILE_SIZE - 1) /
+                          TILED_IMAGE_TILE_SIZE,
+                      NULL};
+  image.tiles =
+      calloc((size_t)image.columns * image.rows, sizeof(ImageTile *));
+  return image;
+}
+
+TiledImage tiled_image_from_image(Image image) {
+  TiledImage tiled = new_tiled_image(image.width, image.height);
+  for (int i = 0; i < tiled.columns * tiled.rows; i++)
+    tiled.tiles[i] = new_tile();
+  tiled_image_write(&tiled, 0, 0, image.width, image.height, image.data,
+                    image.width);
+  return tiled;
+}
+
+struct TiledImageWriter {
+  TiledImage image;
+  size_t memory_cap;
+  // rows written so far
+  int y;
+  bool failed;
+  // the cache file, -1 while the tiles are on the heap
+  int fd;
+  // the row of tiles being filled, tile after tile like in the file
+  Color *band;
+};
+
+TiledImageWriter *tiled_image_writer_open(int width, int height,
+                                          size_t memory_cap) {
+  TiledImageWriter *writer = calloc(1, sizeof(TiledImageWriter));
+  writer->image = new_tiled_image(width, height);
+  writer->memory_cap = memory_cap;
+  writer->fd = -1;
+  int count = writer->image.columns * writer->image.rows;
+
+#if defined(TILED_IMAGE_MMAP)
+  if ((size_t)width * height * sizeof(Color) > memory_cap) {
+    // unlinked right away, the file is gone as soon as it is unmapped
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/daisy-tiles-XXXXXX", dir ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+      unlink(path);
+      writer->band = malloc(writer->image.columns * TILE_BYTES);
+      if (writer->band && ftruncate(fd, count * TILE_BYTES) == 0) {
+        writer->fd = fd;
+        return writer;
+      }
+      free(writer->band);
+      writer->band = NULL;
+      close(fd);
+    }
+  }
+#endif
+
+  for (int i = 0; i < count; i++)
+    writer->image.tiles[i] = new_tile();
+  return writer;
+}
+
+bool tiled_image_writer_write_rows(TiledImageWriter *writer, const Color *rows,
+                                   int count) {
+  TiledImage *image = &writer->image;
+  if (writer->failed || count > image->height - writer->y) {
+    writer->failed = true;
+    return false;
+  }
+  if (writer->fd < 0) {
+    tiled_image_write(image, 0, writer->y, image->width, count, rows,
+                      image->width);
+    writer->y += count;
+    return true;
+  }
+
+#if defined(TILED_IMAGE_MMAP)
+  // the band goes out with pwrite as soon as its tiles are full, so the dirty
+  // pages never count against our own memory
+  const int size = TILED_IMAGE_TILE_SIZE;
+  for (int i = 0; i < count; i++, writer->y++) {
+    int line = writer->y % size;
+    for (int column = 0; column < image->columns; column++) {
+      int x = column * size;
+      int width = image->width - x < size ? image->width - x : size;
+      memcpy(writer->band + ((size_t)column * size + line) * size,
+             rows + (size_t)i * image->width + x, width * sizeof(Color));
+    }
+    if (line == size - 1 || writer->y == image->height - 1) {
+      size_t bytes = image->columns * TILE_BYTES;
+      off_t offset = (off_t)(writer->y / size) * bytes;
+      if (pwrite(writer->fd, writer->band, bytes, offset) != (ssize_t)bytes) {
+        writer->failed = true;
+        return false;
+      }
+    }
+  }
+#endif
+  return true;
+}
+
+TiledImage tiled_image_writer_close(TiledImageWriter *writer) {
+  TiledImage tiled = writer->image;
+  bool ok = !writer->failed && writer->y == tiled.height;
+
+#if defined(TILED_IMAGE_MMAP)
+  if (writer->fd >= 0) {
+    int count = tiled.columns * tiled.rows;
+    void *base = ok ? mmap(NULL, count * TILE_BYTES, PROT_READ, MAP_SHARED,
+                           writer->fd, 0)
+                    : MAP_FAILED;
+    free(writer->band);
+    if (base == MAP_FAILED) {
+      close(writer->fd);
+      // the tiles were never made, nothing to release
+      free(tiled.tiles);
+      free(writer);
+      return (TiledImage){0};
+    }
+
+    TileCache *cache = calloc(1, sizeof(TileCache));
+    atomic_init(&cache->refs, count);
+    cache->fd = writer->fd;
+    cache->base = base;
+    cache->size = count * TILE_BYTES;
+    cache->memory_cap =
+        writer->memory_cap > TILE_BYTES ? writer->memory_cap : TILE_BYTES;
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->newer = malloc(count * sizeof(int));
+    cache->older = malloc(count * sizeof(int));
+    cache->resident = calloc(count, sizeof(bool));
+    cache->newest = cache->oldest = -1;
+
+    for (int i = 0; i < count; i++) {
+      ImageTile *tile = malloc(sizeof(ImageTile));
+      atomic_init(&tile->refs, 1);
+      tile->pixels = (Color *)(cache->base + i * TILE_BYTES);
+      tile->cache = cache;
+      tile->cache_index = i;
+      tiled.tiles[i] = tile;
+    }
+  }
+#endif
+
+  free(writer);
+  if (!ok)
+    tiled_image_free(&tiled);
+  return tiled;
+}
+
+TiledImage tiled_image_copy(const TiledImage *image) {
+  TiledImage copy = new_tiled_image(image->width, image->height);
+  for (int i = 0; i < copy.columns * copy.rows; i++) {
+    copy.tiles[i] = image->tiles[i];
+    atomic_fetch_add(&copy.tiles[i]->refs, 1);
+  }
+  return copy;
+}
+
+void tiled_image_free(TiledImage *image) {
+  if (image->tiles) {
+    for (int i = 0; i < image->columns * image->rows; i++)
+      release_tile(image->tiles[i]);
+    free(image->tiles);
+  }
+  *image = (TiledImage){0};
+}
+
+const Color *tiled_image_tile(const TiledImage *image, int column, int row) {
+  ImageTile *tile = image->tiles[row * image->columns + column];
+#if defined(TILED_IMAGE_MMAP)
+  if (tile->cache)
+    touch_tile(tile->cache, tile->cache_index);
+#endif
+  return tile->pixels;
+}
+
+Color *tiled_image_tile_for_writing(TiledImage *image, int column, int row) {
+  ImageTile **slot = &image->tiles[row * image->columns + column];
+  // we hold one of the references, so if it is the only one nobody can take
+  // another before we're done. mapped tiles are read only
+  if (atomic_load(&(*slot)->refs) > 1 || (*slot)->cache) {
+    ImageTile *copy = new_tile();
+    memcpy(copy->pixels, tiled_image_tile(image, column, row), TILE_BYTES);
+    release_tile(*slot);
+    *slot = copy;
+  }
+  return (*slot)->pixels;
+}
+
+// the part of [start, start + length) that falls into tile number index
+static void tile_span(int index, int start, int length, int *from, int *to) {
+  int lo = index * TILED_IMAGE_TILE_SIZE;
+  int hi = lo + TILED_IMAGE_TILE_SIZE;
+  *from = lo > start ? lo : start;
+  *to = hi < start + length ? hi : start + length;
+}
+
+void tiled_image_read(const TiledImage *image, int x, int y, int width,
+                      int height, Color *dst, int stride) {
+  const int size = TILED_IMAGE_TILE_SIZE;
+  if (width <= 0 || height <= 0)
+    return;
+  for (int row = y / size; row * size < y + height; row++) {
+    int y0, y1;
+    tile_span(row, y, height, &y0, &y1);
+    for (int column = x / size; column * size < x + width; column++) {
+      int x0, x1;
+      tile_span(column, x, width, &x0, &x1);
+      const Color *tile = tiled_image_tile(image, column, row);
+      for (int line = y0; line < y1; line++) {
+        memcpy(dst + (size_t)(line - y) * stride + (x0 - x),
+               tile + (line - row * size) * size + (x0 - column * size),
+               (x1 - x0) * sizeof(Color));
+      }
+    }
+  }
+}
+
+void tiled_image_write(TiledImage *image, int x, int y, int width, int height,
+                       const Color *src, int stride) {
+  const int size = TILED_IMAGE_TILE_SIZE;
+  if (width <= 0 || height <= 0)
+    return;
+  for (int row = y / size; row * size < y + height; row++) {
+    int y0, y1;
+    tile_span(row, y, height, &y0, &y1);
+    for (int column = x / size; column * size < x + width; column++) {
+      int x0, x1;
+      tile_span(column, x, width, &x0, &x1);
+      Color *tile = tiled_image_tile_for_writing(image, column, row);
+      for (int line = y0; line < y1; line++) {
+        memcpy(tile + (line - row * size) * size + (x0 - column * size),
+               src + (size_t)(line - y) * stride + (x0 - x),
+               (x1 - x0) * sizeof(Color));
+      }
+    }
+  }
+}
+
+Image tiled_image_to_image(const TiledImage *image) {
+  size_t bytes = (size_t)image->width * image->height * sizeof(Color);
+  Image flat = {RL_MALLOC(bytes), image->width, image->height, 1,
+                PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  tiled_image_read(image, 0, 0, image->width, image->height, flat.data,
+                   image->width);
+  return flat;
+}
+
+size_t tiled_image_heap_bytes(void) { return atomic_load(&heap_bytes); }
+
+#endif // TILED_IMAGE_IMPLEMENTATION